@@ -0,0 +1,223 @@
+/*
+ * Project Name: Radio Firmware
+ * File: civ_bench.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Throughput and latency benchmark of the CI-V request/response loop
+ * (processCIVCommand() + processSerialQueue()) over an in-memory stream.
+ *
+ * NOTES:
+ * - Usage: icomsim_bench [frames-per-workload]
+ * - Cycles come from rdtsc on x86 and from steady_clock nanoseconds elsewhere.
+ * - "dropped" counts reply bytes that were expected but never reached the stream.
+ * - The last line is the cost of one CivTrace event, micros() of the host shim included.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	static inline uint64_t cycles() { return __rdtsc(); }
+	static const char* cycleUnit = "cycles";
+#else
+	static inline uint64_t cycles()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	static const char* cycleUnit = "ns";
+#endif
+
+namespace
+{
+	const size_t UART_FIFO = 64;                            // Spazio di trasmissione visto dalla libreria ad ogni giro
+
+	struct Chunk
+	{
+		std::vector<uint8_t> bytes;
+		uint32_t frames;                                    // Frame validi contenuti
+		uint32_t replyBytes;                                // Byte di risposta attesi
+		uint32_t gapUs;                                     // Pausa simulata prima del blocco
+	};
+
+	struct Workload
+	{
+		const char* name;
+		std::vector<Chunk> chunks;
+	};
+
+	uint32_t rng = 0x12345678;
+	uint8_t random8()
+	{
+		rng ^= rng << 13;
+		rng ^= rng >> 17;
+		rng ^= rng << 5;
+		return (uint8_t)rng;
+	}
+
+	void appendFrame(std::vector<uint8_t>& out, uint8_t command, const uint8_t* data, size_t length)
+	{
+		const uint8_t head[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, command };
+		out.insert(out.end(), head, head + sizeof(head));
+		out.insert(out.end(), data, data + length);
+		out.push_back(0xFD);
+	}
+
+	void appendSetFrequency(std::vector<uint8_t>& out, uint32_t frequency)
+	{
+		uint8_t bcd[6];
+		for (int i = 0; i < 6; i++)
+		{
+			bcd[i] = (uint8_t)(((frequency % 10) << 4) | (frequency / 10 % 10));  // Formato atteso da COMMAND_SET_FREQUENCY
+			frequency /= 100;
+		}
+		appendFrame(out, COMMAND_SET_FREQUENCY, bcd, sizeof(bcd));
+	}
+
+	// Polling della frequenza a 100 Hz: un frame ogni 10 ms, una risposta da 12 byte ciascuno
+	Workload pollWorkload(size_t frames)
+	{
+		Workload w = { "poll 100Hz", {} };
+		for (size_t i = 0; i < frames; i++)
+		{
+			Chunk c = { {}, 1, 12, 10000 };
+			appendFrame(c.bytes, COMMAND_GET_FREQUENCY, nullptr, 0);
+			w.chunks.push_back(c);
+		}
+		return w;
+	}
+
+	// Manopola di sintonia: raffiche di 16 SET_FREQUENCY consecutivi, un FB da 6 byte ciascuno
+	Workload knobWorkload(size_t frames)
+	{
+		Workload w = { "knob burst", {} };
+		uint32_t frequency = 145000000;
+		for (size_t i = 0; i < frames; i += 16)
+		{
+			Chunk c = { {}, 0, 0, 50000 };
+			for (size_t j = 0; j < 16 && i + j < frames; j++, c.frames++, c.replyBytes += 6)
+			{
+				frequency += 12500;
+				appendSetFrequency(c.bytes, frequency);
+			}
+			w.chunks.push_back(c);
+		}
+		return w;
+	}
+
+	// Rumore sulla linea: spazzatura, jam 0xFC e preamboli interrotti intorno a richieste valide
+	Workload noiseWorkload(size_t frames)
+	{
+		Workload w = { "noise", {} };
+		for (size_t i = 0; i < frames; i++)
+		{
+			Chunk c = { {}, 1, 12, 1000 };
+			size_t garbage = random8() & 7;
+			for (size_t j = 0; j < garbage; j++) c.bytes.push_back(random8());
+
+			switch (random8() & 3)
+			{
+				case 0:                                     // Collisione: frame troncato dal jam
+				{
+					const uint8_t jam[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, 0xFC, 0xFC };
+					c.bytes.insert(c.bytes.end(), jam, jam + sizeof(jam));
+					break;
+				}
+				case 1:                                     // Preambolo interrotto da un nuovo frame
+				{
+					const uint8_t cut[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER };
+					c.bytes.insert(c.bytes.end(), cut, cut + sizeof(cut));
+					break;
+				}
+				default:
+					c.bytes.push_back(0xFD);                // Chiude l'eventuale spazzatura
+					break;
+			}
+			appendFrame(c.bytes, COMMAND_GET_FREQUENCY, nullptr, 0);
+			w.chunks.push_back(c);
+		}
+		return w;
+	}
+
+	void run(const Workload& w)
+	{
+		VfoData_t vfo[2] = {};
+		vfo[0].Frequency = 145500000;
+
+		LoopbackStream link(1 << 16);
+		link.setTxLimit(UART_FIFO);
+
+		IcomSim sim(link);
+		sim.Initialize(&vfo[0], &vfo[1]);
+
+		std::vector<uint64_t> samples;
+		samples.reserve(w.chunks.size() * 16);
+
+		uint64_t expectedBytes = 0, receivedBytes = 0, frames = 0;
+		uint8_t sink[256];
+
+		auto start = std::chrono::steady_clock::now();
+		for (const Chunk& c : w.chunks)
+		{
+			HostClock::advanceMicros(c.gapUs);
+			link.inject(c.bytes.data(), c.bytes.size());
+
+			uint64_t t0 = cycles();
+			sim.processCIVCommand();
+			sim.processSerialQueue();
+			uint64_t t1 = cycles();
+
+			for (size_t n; (n = link.drain(sink, sizeof(sink))) > 0; ) receivedBytes += n;
+			sim.processSerialQueue();                       // Residuo oltre la FIFO simulata
+			for (size_t n; (n = link.drain(sink, sizeof(sink))) > 0; ) receivedBytes += n;
+
+			expectedBytes += c.replyBytes;
+			frames += c.frames;
+			uint64_t perFrame = c.frames ? (t1 - t0) / c.frames : (t1 - t0);
+			for (uint32_t i = 0; i < (c.frames ? c.frames : 1); i++) samples.push_back(perFrame);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::sort(samples.begin(), samples.end());
+		uint64_t p50 = samples[samples.size() / 2];
+		uint64_t p99 = samples[samples.size() * 99 / 100];
+		uint64_t dropped = expectedBytes > receivedBytes ? expectedBytes - receivedBytes : 0;
+
+		printf("%-12s %10llu %12.0f %10llu %10llu %10llu\n", w.name,
+		       (unsigned long long)frames, frames / seconds,
+		       (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)dropped);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t frames = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+
+	HostClock::useManual(true);
+
+	printf("%-12s %10s %12s %10s %10s %10s\n", "workload", "frames", "frames/s", "p50", "p99", "dropped");
+	printf("(per-frame cost in %s, dropped in bytes)\n", cycleUnit);
+
+	run(pollWorkload(frames));
+	run(knobWorkload(frames));
+	run(noiseWorkload(frames));
+
+	// Costo di un evento di traccia (CivTrace::record), al netto del ciclo
+	CivTrace<32> trace;
+	uint64_t t0 = cycles();
+	for (size_t i = 0; i < frames; i++) trace.record(CIV_TRACE_RX_FRAME, (uint8_t)i, 0, 0);
+	uint64_t t1 = cycles();
+	printf("trace record: %.1f %s/event (%u stored)\n", (double)(t1 - t0) / frames, cycleUnit, trace.available());
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Project Name: Radio Firmware
+ * File: executor_bench.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Request-to-reply latency of IcomSim polled from a loop() thread versus the
+ * event-driven IcomSimThreadExecutor.
+ *
+ * NOTES:
+ * - Usage: icomsim_executor_bench [requests] [loop-period-us]
+ * - Requests enter through the receive ring as a UART ISR would deliver them;
+ *   replies are timestamped by the frame sink in the context that produced them.
+ * - Also checks that a SET_FREQUENCY reaches the application through the change queue.
+ */
+
+#include "IcomSim.h"
+#include "IcomSimThreadExecutor.h"
+#include "LoopbackStream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	std::atomic<uint32_t> replies(0);
+	std::atomic<int64_t> replyTime(0);
+
+	int64_t nowNs()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	bool onReply(void*, const uint8_t*, uint16_t)
+	{
+		replyTime.store(nowNs());
+		replies.fetch_add(1);
+		return true;
+	}
+
+	void push(IcomSim& sim, const uint8_t* frame, size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			while (!sim.pushRxByte(frame[i])) std::this_thread::yield();
+		}
+	}
+
+	// Attende la risposta numero target; restituisce la latenza in ns o -1 allo scadere del tempo
+	int64_t waitReply(uint32_t target, int64_t sentNs)
+	{
+		Clock::time_point limit = Clock::now() + std::chrono::seconds(1);
+		while (replies.load() < target)
+		{
+			if (Clock::now() > limit) return -1;
+			std::this_thread::yield();
+		}
+		return replyTime.load() - sentNs;
+	}
+
+	void report(const char* name, std::vector<int64_t>& samples, uint32_t lost)
+	{
+		std::sort(samples.begin(), samples.end());
+		if (samples.empty())
+		{
+			printf("%-10s no replies\n", name);
+			return;
+		}
+		printf("%-10s %10zu %10.1f %10.1f %10.1f %8u\n", name, samples.size(),
+		       samples[samples.size() / 2] / 1000.0, samples[samples.size() * 99 / 100] / 1000.0,
+		       samples.back() / 1000.0, lost);
+	}
+
+	const uint8_t getFrequency[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_FREQUENCY, 0xFD };
+}
+
+int main(int argc, char** argv)
+{
+	size_t requests = argc > 1 ? (size_t)strtoul(argv[1], nullptr, 10) : 2000;
+	unsigned loopPeriodUs = argc > 2 ? (unsigned)strtoul(argv[2], nullptr, 10) : 1000;
+
+	VfoData_t vfo[2] = {};
+	vfo[0].Frequency = 145500000;
+
+	LoopbackStream link;
+	IcomSim sim(link);
+	if (!sim.Initialize(&vfo[0], &vfo[1])) return 1;
+	sim.enableRxRing(true);
+	sim.setFrameSink(&onReply, nullptr);
+
+	printf("%-10s %10s %10s %10s %10s %8s\n", "mode", "requests", "p50 us", "p99 us", "max us", "lost");
+
+	// ---------------------------------------------------- loop() con periodo fisso
+	{
+		std::atomic<bool> running(true);
+		std::thread loop([&]
+		{
+			while (running.load())
+			{
+				sim.processCIVCommand();
+				sim.processSerialQueue();
+				std::this_thread::sleep_for(std::chrono::microseconds(loopPeriodUs));
+			}
+		});
+
+		std::vector<int64_t> samples;
+		uint32_t lost = 0;
+		for (size_t i = 0; i < requests; i++)
+		{
+			uint32_t target = replies.load() + 1;
+			int64_t sent = nowNs();
+			push(sim, getFrequency, sizeof(getFrequency));
+			int64_t latency = waitReply(target, sent);
+			if (latency < 0) lost++;
+			else samples.push_back(latency);
+		}
+		running = false;
+		loop.join();
+		report("polled", samples, lost);
+	}
+
+	// ---------------------------------------------------- executor a eventi
+	IcomSimThreadExecutor executor(sim);
+	executor.start();
+	{
+		std::vector<int64_t> samples;
+		uint32_t lost = 0;
+		for (size_t i = 0; i < requests; i++)
+		{
+			uint32_t target = replies.load() + 1;
+			int64_t sent = nowNs();
+			push(sim, getFrequency, sizeof(getFrequency));
+			executor.notify(ICOMSIM_EVENT_RX);
+			int64_t latency = waitReply(target, sent);
+			if (latency < 0) lost++;
+			else samples.push_back(latency);
+		}
+		report("executor", samples, lost);
+	}
+
+	// Le modifiche arrivano dalla coda, i dati si leggono sotto lock
+	const uint8_t setFrequency[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SET_FREQUENCY,
+	                                 0x00, 0x00, 0x04, 0x34, 0x10, 0xFD };   // 143.400.000 Hz
+	push(sim, setFrequency, sizeof(setFrequency));
+	executor.notify(ICOMSIM_EVENT_RX);
+
+	IcomSimChange_t change = { 0, 0 };
+	bool ok = executor.waitChange(change, 1000) && change.vfo == ICOMSIM_VFO_A && (change.flags & FLAG_FREQUENCY_CHANGED);
+	uint32_t frequency;
+	{
+		IcomSimLock guard(executor);
+		frequency = vfo[0].Frequency;
+	}
+	executor.stop();
+
+	printf("change queue: %s (vfo %u, flags 0x%04X, %lu Hz)\n", ok ? "ok" : "FAILED",
+	       change.vfo, change.flags, (unsigned long)frequency);
+	return ok && frequency == 143400000 ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/*
+ * Project Name: Radio Firmware
+ * File: latency_bench.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Where the time goes between the 0xFD of a request and the last reply byte handed
+ * to the UART: runs a mixed CI-V workload on a build with ICOMSIM_LATENCY=1 and prints
+ * the per-command, per-stage histograms kept by IcomSimLatency.
+ *
+ * NOTES:
+ * - Usage: icomsim_latency_bench [requests]
+ * - Percentiles are bucket upper bounds (power of two), max is exact.
+ * - The simulated UART accepts UART_FIFO bytes per call, so long replies show up in
+ *   DRAIN and TOTAL.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+
+#include <vector>
+
+#if !ICOMSIM_LATENCY
+	#error "latency_bench va compilato con ICOMSIM_LATENCY=1 (target icomsim_latency_bench)"
+#endif
+
+namespace
+{
+	const size_t UART_FIFO = 8;
+
+	const char* const stageNames[ICOMSIM_LATENCY_STAGES] = { "parse", "dispatch", "handler", "enqueue", "drain", "total" };
+
+	void appendFrame(std::vector<uint8_t>& out, uint8_t command, const uint8_t* data, size_t length)
+	{
+		const uint8_t head[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, command };
+		out.insert(out.end(), head, head + sizeof(head));
+		out.insert(out.end(), data, data + length);
+		out.push_back(0xFD);
+	}
+
+	uint32_t percentile(const IcomSimHistogram_t& h, uint32_t count, uint32_t permille)
+	{
+		uint32_t target = (count * permille + 999) / 1000, seen = 0;
+
+		for (uint8_t b = 0; b < ICOMSIM_LATENCY_BUCKETS; b++)
+		{
+			seen += h.bucket[b];
+			if (seen >= target) return IcomSimLatency::bucketLimit(b);
+		}
+		return h.max;
+	}
+
+	void printSlot(const IcomSimLatency& latency, uint8_t slot, const char* name)
+	{
+		for (uint8_t stage = 0; stage < ICOMSIM_LATENCY_STAGES; stage++)
+		{
+			const IcomSimHistogram_t& h = latency.getHistogram(slot, stage);
+			uint32_t count = 0;
+			for (uint8_t b = 0; b < ICOMSIM_LATENCY_BUCKETS; b++) count += h.bucket[b];
+			if (count == 0) continue;
+
+			printf("%-8s %-9s %8u %9u %9u %9u\n", stage == 0 ? name : "", stageNames[stage], count,
+			       percentile(h, count, 500), percentile(h, count, 990), h.max);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t requests = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+	HostClock::useManual(true);
+
+	VfoData_t vfo[2] = {};
+	vfo[0].Frequency = 145500000;
+	vfo[0].Step = 12500;
+
+	LoopbackStream link(1 << 16);
+	link.setTxLimit(UART_FIFO);
+
+	IcomSim sim(link);
+	sim.Initialize(&vfo[0], &vfo[1]);
+
+	// Richieste tipiche di un programma CAT: lettura frequenza e stato, impostazioni, un comando sconosciuto
+	const uint8_t setFrequency[] = { 0x00, 0x00, 0x50, 0x45, 0x01 };
+	const uint8_t squelch[] = { 0x05 };
+	std::vector<std::vector<uint8_t>> mix(5);
+	appendFrame(mix[0], COMMAND_GET_FREQUENCY, nullptr, 0);
+	appendFrame(mix[1], COMMAND_SET_FREQUENCY, setFrequency, sizeof(setFrequency));
+	appendFrame(mix[2], COMMAND_GET_STATUS, nullptr, 0);
+	appendFrame(mix[3], COMMAND_SET_SQUELCH, squelch, sizeof(squelch));
+	appendFrame(mix[4], 0x7E, nullptr, 0);
+
+	uint8_t sink[256];
+	for (size_t i = 0; i < requests; i++)
+	{
+		const std::vector<uint8_t>& request = mix[i % mix.size()];
+		link.inject(request.data(), request.size());
+		sim.processCIVCommand();
+
+		// La UART si svuota a blocchi di UART_FIFO byte, come una FIFO hardware tra due chiamate del loop
+		do
+		{
+			sim.processSerialQueue();
+		} while (link.drain(sink, sizeof(sink)) > 0);
+		HostClock::advanceMicros(1000);
+	}
+
+	const IcomSimLatency& latency = sim.getLatency();
+	printf("%-8s %-9s %8s %9s %9s %9s   (%s)\n", "command", "stage", "samples", "p50<", "p99<", "max", ICOMSIM_CYCLES_UNIT);
+
+	char name[16];
+	for (uint8_t slot = 0; slot < latency.getCommandCount(); slot++)
+	{
+		snprintf(name, sizeof(name), "%02X", latency.getCommand(slot));
+		printSlot(latency, slot, name);
+	}
+	printSlot(latency, ICOMSIM_LATENCY_COMMANDS, "other");
+	return 0;
+}
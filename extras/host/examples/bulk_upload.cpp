@@ -0,0 +1,241 @@
+/*
+ * Project Name: Radio Firmware
+ * File: bulk_upload.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: uploads the whole memory bank over a simulated 9600 baud CI-V link,
+ * first one channel at a time with the standard commands (08, 05, 06, 09), then with
+ * the bulk transfer (7F 05/06/07), and finally with a corrupted block and a cable
+ * pulled halfway, resumed by a second upload.
+ *
+ * NOTES:
+ * - Usage: icomsim_bulk_upload [window] [bank-file]
+ * - 7F 07 replies before the write cache reaches the bank file; the example checks
+ *   that processSerialQueue() drains and commits it without waiting.
+ * - Time is line time (10 bits per byte) plus TURNAROUND_US every time the PC waits
+ *   for a reply (USB-serial latency and software).
+ */
+
+#include "IcomSim.h"
+#include "IcomSimMemory.h"
+#include "IcomSimBulk.h"
+#include "IcomSimFileStore.h"
+#include "CivBulkClient.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+
+#include <string.h>
+
+namespace
+{
+	const uint64_t BYTE_US = 10 * 1000000ULL / 9600;
+	const uint64_t TURNAROUND_US = 10000;
+	const uint64_t TIMEOUT_US = 200000;
+
+	struct Radio
+	{
+		LoopbackStream& link;
+		IcomSim& sim;
+	};
+
+	void send(Radio& r, const std::vector<uint8_t>& frame)
+	{
+		r.link.inject(frame.data(), frame.size());
+		HostClock::advanceMicros(frame.size() * BYTE_US);
+		r.sim.process();
+	}
+
+	// Primo frame in uscita dalla radio, se c'e'
+	bool receive(Radio& r, std::vector<uint8_t>& frame)
+	{
+		uint8_t byte;
+		frame.clear();
+		while (r.link.drain(&byte, 1) == 1)
+		{
+			frame.push_back(byte);
+			if (byte == 0xFD) break;
+		}
+		HostClock::advanceMicros(frame.size() * BYTE_US);
+		return !frame.empty();
+	}
+
+	// Ogni richiesta ha una risposta: dati, FB o FA
+	bool exchange(Radio& r, const std::vector<uint8_t>& request, CivBulkReply* reply = nullptr)
+	{
+		std::vector<uint8_t> frame;
+		send(r, request);
+		HostClock::advanceMicros(TURNAROUND_US);
+		if (!receive(r, frame)) return false;
+		return reply ? civBulkDecodeReply(frame.data(), frame.size(), *reply) : frame[4] != CIV_ACK_NG;
+	}
+
+	VfoData_t channelVfo(uint16_t channel)
+	{
+		VfoData_t vfo = {};
+		vfo.Frequency = 430000000UL + channel * 25000UL;
+		vfo.Step = 12500;
+		vfo.Mode = static_cast<BK4819_Mode_t>(channel & 1);
+		return vfo;
+	}
+
+	// Programmazione classica: selezione, frequenza, modo, scrittura, ognuno con la sua risposta
+	bool uploadPerChannel(Radio& r, uint16_t count)
+	{
+		for (uint16_t ch = 0; ch < count; ch++)
+		{
+			VfoData_t vfo = channelVfo(ch);
+			uint8_t bcd[2], frequency[5], mode = (uint8_t)vfo.Mode;
+			civBcdEncode<2, CIV_BCD_MSB_FIRST>(ch, bcd);
+			civBcdEncode<5, CIV_BCD_RX_LAYOUT>(vfo.Frequency, frequency);
+
+			std::vector<uint8_t> select = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SELECT_MEMORY, bcd[0], bcd[1], 0xFD };
+			std::vector<uint8_t> setFrequency = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SET_FREQUENCY };
+			setFrequency.insert(setFrequency.end(), frequency, frequency + sizeof(frequency));
+			setFrequency.push_back(0xFD);
+			std::vector<uint8_t> setMode = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SET_MODE, mode, 0xFD };
+			std::vector<uint8_t> write = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_MEMORY_WRITE, 0xFD };
+
+			if (!exchange(r, select) || !exchange(r, setFrequency) || !exchange(r, setMode) || !exchange(r, write)) return false;
+		}
+		return true;
+	}
+
+	// Trasferimento a blocchi. corruptBlock/unplugAfter simulano un disturbo e un cavo staccato (-1 = mai)
+	bool uploadBulk(Radio& r, const std::vector<uint8_t>& units, uint8_t window, long corruptBlock = -1, long unplugAfter = -1)
+	{
+		const uint16_t count = (uint16_t)(units.size() / ICOMSIM_MEMORY_RECORD_SIZE);
+		std::vector<uint8_t> frame;
+		CivBulkReply reply;
+		long blocks = 0;
+
+		if (!exchange(r, civBulkBeginFrame(CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, CIV_BULK_TARGET_CHANNELS, 0, count, window), &reply)) return false;
+		if (reply.status != CIV_BULK_OK) return false;
+
+		uint16_t next = reply.next;
+		const uint8_t perBlock = reply.unitsPerBlock;
+		if (next > 0) printf("  resuming at unit %u\n", next);
+
+		while (next < count)
+		{
+			uint16_t offset = next;
+			bool early = false;
+
+			for (uint8_t sent = 0; sent < window && offset < count && !early; sent++)
+			{
+				uint16_t n = (uint16_t)(count - offset < perBlock ? count - offset : perBlock);
+				frame = civBulkDataFrame(CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, offset,
+				                         &units[offset * ICOMSIM_MEMORY_RECORD_SIZE], (uint16_t)(n * ICOMSIM_MEMORY_RECORD_SIZE));
+				if (blocks == unplugAfter)
+				{
+					printf("  cable pulled after %ld blocks\n", blocks);
+					return false;
+				}
+				if (blocks++ == corruptBlock) frame[8] ^= 0x01;
+
+				send(r, frame);
+				offset += n;
+
+				// Collegamento full duplex (USB): una segnalazione d'errore arriva prima della fine della finestra
+				early = r.link.pending() > 0 && offset < count && sent + 1 < window;
+			}
+
+			if (!early) HostClock::advanceMicros(TURNAROUND_US);
+			if (!receive(r, frame) || !civBulkDecodeReply(frame.data(), frame.size(), reply))
+			{
+				HostClock::advanceMicros(TIMEOUT_US);
+				if (!exchange(r, civBulkBeginFrame(CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, CIV_BULK_TARGET_CHANNELS, 0, count, window), &reply)) return false;
+			}
+			else if (reply.status != CIV_BULK_OK)
+			{
+				printf("  radio: %s, resend from %u\n", civBulkStatusName(reply.status), reply.next);
+				if (reply.status != CIV_BULK_CRC && reply.status != CIV_BULK_SEQUENCE && reply.status != CIV_BULK_BUSY) return false;
+			}
+			next = reply.next;
+		}
+
+		return exchange(r, civBulkEndFrame(CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER), &reply) && reply.status == CIV_BULK_OK;
+	}
+
+	// Dal programma, non via CI-V: a cache piena si svuota con flush() e si riprova
+	void clearBank(IcomSimMemory& bank)
+	{
+		for (uint16_t ch = 0; ch < bank.getChannelCount(); ch++)
+		{
+			if (!bank.clear(ch) && bank.flush()) bank.clear(ch);
+		}
+		bank.flush();
+	}
+
+	bool verify(IcomSimMemory& bank)
+	{
+		for (uint16_t ch = 0; ch < bank.getChannelCount(); ch++)
+		{
+			VfoData_t vfo = {};
+			if (!bank.load(ch, vfo) || vfo.Frequency != channelVfo(ch).Frequency || vfo.Mode != channelVfo(ch).Mode) return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint8_t window = argc > 1 ? (uint8_t)atoi(argv[1]) : 8;
+	const char* path = argc > 2 ? argv[2] : "icomsim_bulk.bin";
+	remove(path);
+	HostClock::useManual(true);
+
+	VfoData_t vfo[2] = {};
+	IcomSimFileStore file(ICOMSIM_MEMORY_CHANNELS);
+	IcomSimMemory bank(file);
+	IcomSimChannelBulk channels(bank);
+	if (!file.open(path) || !bank.begin()) return 1;
+
+	LoopbackStream link;
+	IcomSim sim(link);
+	if (!sim.Initialize(&vfo[0], &vfo[1])) return 1;
+	sim.attachMemory(&bank);
+	sim.attachBulkTarget(CIV_BULK_TARGET_CHANNELS, &channels);
+	Radio radio = { link, sim };
+
+	const uint16_t count = bank.getChannelCount();
+	std::vector<uint8_t> units(count * ICOMSIM_MEMORY_RECORD_SIZE);
+	for (uint16_t ch = 0; ch < count; ch++)
+	{
+		IcomSimMemoryRecord_t record;
+		IcomSimMemory::encode(channelVfo(ch), record);
+		memcpy(&units[ch * ICOMSIM_MEMORY_RECORD_SIZE], &record, sizeof(record));
+	}
+
+	uint64_t start = HostClock::nowMicros();
+	bool ok = uploadPerChannel(radio, count) && verify(bank);
+	printf("per channel: %u channels in %.2f s %s\n", count, (HostClock::nowMicros() - start) / 1e6, ok ? "OK" : "FAILED");
+
+	clearBank(bank);
+
+	start = HostClock::nowMicros();
+	ok = uploadBulk(radio, units, window) && verify(bank);
+	printf("bulk, window %u: %u channels in %.2f s %s\n", window, count, (HostClock::nowMicros() - start) / 1e6, ok ? "OK" : "FAILED");
+	if (!ok) return 1;
+
+	// 7F 07 non scrive la cache: process() la svuota un record per giro, senza attendere ICOMSIM_MEMORY_FLUSH_MS
+	uint8_t cached = bank.getPending();
+	for (uint8_t i = 0; i <= ICOMSIM_MEMORY_CACHE; i++) sim.processSerialQueue();
+	printf("  %u cached records written back by %u processSerialQueue() calls\n", cached, ICOMSIM_MEMORY_CACHE + 1);
+	if (bank.getPending() != 0 || bank.getFlushDelay() != ICOMSIM_WAIT_FOREVER) return 1;
+
+	clearBank(bank);
+
+	printf("bulk with a corrupted block and an interruption:\n");
+	start = HostClock::nowMicros();
+	bool first = uploadBulk(radio, units, window, 5, count / 2);
+	ok = !first && uploadBulk(radio, units, window, 20) && verify(bank);
+	printf("  %u channels in %.2f s %s\n", count, (HostClock::nowMicros() - start) / 1e6, ok ? "OK" : "FAILED");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+/*
+ * Project Name: Radio Firmware
+ * File: capture_record.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: records a logger-like CI-V session to a capture file, to be replayed
+ * with icomsim_civ_replay.
+ *
+ *   icomsim_capture_record [file]        (default session.civc)
+ *
+ * NOTES:
+ * - The session polls frequency, squelch and RF gain every 100 ms, changes frequency and
+ *   mode now and then, and contains a line glitch that the parser rejects.
+ * - The capture starts with the VFO state (CIV_CAPTURE_STATE), so the replay begins
+ *   from the same values.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+#include "CivCaptureFile.h"
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "session.civc";
+	HostClock::useManual(true);
+
+	VfoData_t vfo[2] = {};
+	vfo[0].Frequency = 145500000;
+	vfo[0].Step = 12500;
+	vfo[0].Sql = 3;
+	vfo[1].Frequency = 433500000;
+	vfo[1].Step = 25000;
+
+	LoopbackStream link;
+	IcomSim sim(link);
+	if (!sim.Initialize(&vfo[0], &vfo[1])) return 1;
+
+	CivCaptureWriter capture;
+	if (!capture.open(path, 9600))
+	{
+		perror(path);
+		return 1;
+	}
+	capture.state(ICOMSIM_VFO_A, vfo[0]);
+	capture.state(ICOMSIM_VFO_B, vfo[1]);
+	sim.setCaptureHook(&CivCaptureWriter::hook, &capture);
+
+	auto send = [&](std::vector<uint8_t> frame)
+	{
+		link.inject(frame.data(), frame.size());
+		sim.process();
+		uint8_t reply[256];
+		link.drain(reply, sizeof(reply));
+		HostClock::advanceMicros(2000);
+	};
+
+	const uint8_t polls[] = { COMMAND_GET_FREQUENCY, COMMAND_GET_SQUELCH, COMMAND_GET_RFGAIN };
+	for (int cycle = 0; cycle < 500; cycle++)
+	{
+		for (uint8_t command : polls) send({ 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, command, 0xFD });
+
+		if (cycle % 25 == 10)
+		{
+			std::vector<uint8_t> set = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SET_FREQUENCY, 0, 0, 0, 0, 0, 0xFD };
+			civBcdEncode<5, CIV_BCD_RX_LAYOUT>((uint32_t)(145500000 + 12500 * cycle), &set[5]);
+			send(set);
+		}
+		if (cycle % 50 == 20) send({ 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SET_MODE, (uint8_t)(cycle / 50 % 2), 0xFD });
+		if (cycle == 300) send({ 0xFE, 0xFE, CIV_ADDRESS_RADIO, 0xFD });   // Disturbo sulla linea: frame troncato
+
+		HostClock::advanceMicros(100000 - 3 * 2000);
+	}
+
+	sim.setCaptureHook(nullptr, nullptr);
+	printf("%u records written to %s\n", capture.getRecords(), path);
+	return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * Project Name: Radio Firmware
+ * File: controller_pipeline.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: IcomSimController driving an IcomSim device over a simulated serial
+ * line (9600 and 115200 baud). The same SET/GET frequency sequence runs with one GET at a time (the classic
+ * request/wait loop) and with up to 4 pairs in flight, then through a future and a coroutine,
+ * and finally against a device that does not answer (timeout).
+ *
+ * NOTES:
+ * - Each loop iteration pays TURNAROUND_US (adapter latency, scheduling), as in
+ *   snapshot_poll.cpp: pipelining pays it once per batch instead of once per request.
+ *   At 9600 baud the line time dominates and the gain is small; at 115200 it halves the
+ *   time per pair.
+ * - Every SET must end with FB (also through civRequestSetFuture/civRequestSetAwait) and
+ *   every GET must return the frequency of the SET queued just before it: this checks that FB and replies are matched in order with
+ *   several requests in flight. Exit code 1 on a mismatch.
+ */
+
+#include "IcomSim.h"
+#include "IcomSimController.h"
+#include "IcomSimControllerAsync.h"
+#include "SimSerialLink.h"
+#include "HostClock.h"
+
+#include <deque>
+
+namespace
+{
+	const uint32_t BAUDS[] = { 9600, 115200 };
+	const uint64_t TURNAROUND_US = 4000;
+	const uint8_t DEVICE = CIV_ADDRESS_RADIO;
+	const int PAIRS = 200;                              // SET + GET
+
+	// Lato controller di SimSerialLink come Stream
+	class ControllerPort : public Stream
+	{
+	public:
+		explicit ControllerPort(SimSerialLink& link) : link(link) {}
+
+		int available() override
+		{
+			if (in.empty())
+			{
+				std::vector<uint8_t> bytes;
+				link.controllerReceive(bytes);
+				in.insert(in.end(), bytes.begin(), bytes.end());
+			}
+			return (int)in.size();
+		}
+		int read() override
+		{
+			if (available() == 0) return -1;
+			uint8_t byte = in.front();
+			in.pop_front();
+			return byte;
+		}
+		int peek() override { return available() ? in.front() : -1; }
+		int availableForWrite() override { return 256; }
+		size_t write(uint8_t byte) override { return write(&byte, 1); }
+		size_t write(const uint8_t* data, size_t length) override
+		{
+			link.controllerSend(data, length);
+			return length;
+		}
+
+	private:
+		SimSerialLink& link;
+		std::deque<uint8_t> in;
+	};
+
+	struct Bench
+	{
+		SimSerialLink link;
+		ControllerPort port;
+		VfoData_t vfo[2];
+		IcomSim sim;
+		IcomSimController controller;
+		bool deviceOn;
+
+		explicit Bench(uint32_t baud = 9600) : link(baud, baud), port(link), vfo(), sim(link), controller(port), deviceOn(true)
+		{
+			vfo[0].Frequency = 145500000;
+			vfo[0].Step = 12500;
+			vfo[1].Frequency = 433500000;
+			sim.Initialize(&vfo[0], &vfo[1]);
+		}
+
+		// Un giro del loop principale: richieste in uscita, dispositivo, risposte
+		void turn()
+		{
+			controller.process();
+			if (deviceOn) sim.process();
+			controller.process();
+			HostClock::advanceMicros(TURNAROUND_US);
+		}
+	};
+
+	struct Sequence
+	{
+		int issued = 0;
+		int done = 0;
+		int errors = 0;
+		uint32_t lastSet = 0;
+	};
+
+	struct Pending
+	{
+		Sequence* sequence;
+		uint32_t expected;
+	};
+
+	Pending slots[ICOMSIM_CONTROLLER_MAX_PENDING * 2];
+
+	void onSet(void* ctx, const CivReply_t& reply)
+	{
+		if (reply.status != CIV_REPLY_OK) static_cast<Sequence*>(ctx)->errors++;
+	}
+
+	void onReply(void* ctx, const CivReply_t& reply)
+	{
+		Pending* p = static_cast<Pending*>(ctx);
+		uint32_t frequency = 0;
+		if (!IcomSimController::decodeFrequency(reply, frequency) || frequency != p->expected) p->sequence->errors++;
+		p->sequence->done++;
+		p->sequence = nullptr;
+	}
+
+	Pending* freeSlot()
+	{
+		for (Pending& p : slots)
+		{
+			if (p.sequence == nullptr) return &p;
+		}
+		return nullptr;
+	}
+
+	// Coppie SET f, GET (atteso f) con al massimo depth coppie in volo: ogni richiesta occupa uno slot
+	double runSequence(uint32_t baud, uint8_t depth, Sequence& s)
+	{
+		Bench bench(baud);
+		uint64_t start = HostClock::nowMicros();
+
+		while (s.done < PAIRS)
+		{
+			// Spazio in coda per SET (5 byte di dati) e GET insieme
+			while (s.issued < PAIRS && bench.controller.getPending() + 2 <= 2 * depth && bench.controller.canRequest(5 + CIV_FRAME_OVERHEAD))
+			{
+				Pending* p = freeSlot();
+				p->sequence = &s;
+				p->expected = 144000000 + 5000 * (uint32_t)s.issued;
+
+				bench.controller.setFrequency(DEVICE, p->expected, &onSet, &s);
+				bench.controller.getFrequency(DEVICE, &onReply, p);
+				s.issued++;
+			}
+			bench.turn();
+		}
+		return (HostClock::nowMicros() - start) / 1000.0;
+	}
+
+#if defined(__cpp_impl_coroutine)
+	IcomSimTask tuneAndRead(IcomSimController& controller, uint32_t frequency, int& errors, bool& finished)
+	{
+		uint32_t before = 0;
+		uint32_t after = 0;
+
+		CivAsyncReply get = co_await civRequestAwait(controller, DEVICE, COMMAND_GET_FREQUENCY);
+		if (!get.frequency(before)) errors++;
+
+		uint8_t bcd[5];
+		civBcdEncode<5, ICOMSIM_CONTROLLER_SET_LAYOUT>(frequency, bcd);
+		CivAsyncReply set = co_await civRequestSetAwait(controller, DEVICE, COMMAND_SET_FREQUENCY, bcd, sizeof(bcd));
+		if (set.status != CIV_REPLY_OK) errors++;
+
+		get = co_await civRequestAwait(controller, DEVICE, COMMAND_GET_FREQUENCY);
+		if (!get.frequency(after) || after != frequency) errors++;
+
+		printf("coroutine: %u -> %u, SET %s\n", before, after, set.status == CIV_REPLY_OK ? "FB" : "not acknowledged");
+		finished = true;
+	}
+#endif
+}
+
+int main()
+{
+	HostClock::useManual(true);
+	int errors = 0;
+
+	bool faster = true;
+
+	printf("%d SET+GET pairs, turnaround %.1f ms\n", PAIRS, TURNAROUND_US / 1000.0);
+	for (uint32_t baud : BAUDS)
+	{
+		Sequence serial;
+		double serialMs = runSequence(baud, 1, serial);
+		Sequence pipelined;
+		double pipelinedMs = runSequence(baud, ICOMSIM_CONTROLLER_MAX_PENDING / 2, pipelined);
+		errors += serial.errors + pipelined.errors;
+		faster = faster && pipelinedMs < serialMs;
+
+		printf("%6u baud, one at a time:     %8.1f ms (%5.2f ms/pair), %d errors\n", baud, serialMs, serialMs / PAIRS, serial.errors);
+		printf("%6u baud, %u pairs in flight: %8.1f ms (%5.2f ms/pair), %d errors\n", baud, ICOMSIM_CONTROLLER_MAX_PENDING / 2, pipelinedMs,
+		       pipelinedMs / PAIRS, pipelined.errors);
+	}
+
+	Bench bench;
+
+	// Future: pronta dentro process(), il loop la interroga senza bloccarsi
+	std::future<CivAsyncReply> future = civRequestFuture(bench.controller, DEVICE, COMMAND_GET_FREQUENCY);
+	while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) bench.turn();
+	uint32_t frequency = 0;
+	if (!future.get().frequency(frequency) || frequency != 145500000) errors++;
+	printf("future: frequency %u\n", frequency);
+
+	// SET tramite future: completata dal FB, non dal timeout
+	uint8_t bcd[5];
+	civBcdEncode<5, ICOMSIM_CONTROLLER_SET_LAYOUT>(145525000UL, bcd);
+	uint64_t setStart = HostClock::nowMicros();
+	std::future<CivAsyncReply> setFuture = civRequestSetFuture(bench.controller, DEVICE, COMMAND_SET_FREQUENCY, bcd, sizeof(bcd));
+	while (setFuture.wait_for(std::chrono::seconds(0)) != std::future_status::ready) bench.turn();
+	CivReplyStatus_t setStatus = setFuture.get().status;
+	if (setStatus != CIV_REPLY_OK || bench.vfo[0].Frequency != 145525000UL) errors++;
+	printf("future: SET %s after %.1f ms\n", setStatus == CIV_REPLY_OK ? "FB" : "not acknowledged", (HostClock::nowMicros() - setStart) / 1000.0);
+
+#if defined(__cpp_impl_coroutine)
+	bool finished = false;
+	tuneAndRead(bench.controller, 145612500, errors, finished);
+	while (!finished) bench.turn();
+#endif
+
+	// Dispositivo spento: la richiesta scade dopo il suo timeout
+	bench.deviceOn = false;
+	Sequence silent;
+	Pending* p = freeSlot();
+	p->sequence = &silent;
+	p->expected = 0;
+	bench.controller.getFrequency(DEVICE, &onReply, p, 50);     // Scade: conta come errore della sequenza silent
+	uint64_t start = HostClock::nowMicros();
+	while (silent.done == 0) bench.turn();
+	printf("device off: request ended after %.1f ms, %u timeouts\n", (HostClock::nowMicros() - start) / 1000.0, bench.controller.getTimeouts());
+	if (bench.controller.getTimeouts() != 1) errors++;
+
+	return errors == 0 && faster ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+/*
+ * Project Name: Radio Firmware
+ * File: linerate_demo.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example on a simulated serial line (SimSerialLink): auto-baud against
+ * controllers at different rates, a negotiated rate change (7F 08), a controller that
+ * does not follow the change, and a negotiated rate that degrades (clock drift).
+ *
+ * NOTES:
+ * - The controller polls the frequency (03) every POLL_MS; a poll succeeds when the
+ *   reply is a well-formed 03 frame.
+ */
+
+#include "IcomSim.h"
+#include "SimSerialLink.h"
+#include "HostClock.h"
+
+#include <memory>
+
+namespace
+{
+	const uint64_t POLL_MS = 100;
+
+	struct Bench
+	{
+		SimSerialLink link;
+		VfoData_t vfo[2];
+		IcomSim sim;
+
+		Bench(uint32_t radioBaud, uint32_t controllerBaud, bool autoBaud)
+			: link(radioBaud, controllerBaud), vfo(), sim(link)
+		{
+			vfo[0].Frequency = 145500000;
+			sim.Initialize(&vfo[0], &vfo[1]);
+			sim.getLineRate().begin(setRate, this, radioBaud);
+			sim.getLineRate().setAutoBaud(autoBaud);
+		}
+
+		// Hook della radio: in un firmware Serial.flush() e Serial.updateBaudRate()
+		static bool setRate(void* ctx, uint32_t baud)
+		{
+			static_cast<Bench*>(ctx)->link.setRadioBaud(baud);
+			return true;
+		}
+
+		bool request(const std::vector<uint8_t>& frame, std::vector<uint8_t>& reply)
+		{
+			link.controllerSend(frame.data(), frame.size());
+			sim.process();
+			reply.clear();
+			link.controllerReceive(reply);
+			HostClock::advanceMicros(POLL_MS * 1000);
+			sim.process();                                  // Scadenze (prova di un cambio di velocita')
+			return reply.size() >= 6 && reply.size() <= CIV_MAX_FRAME_SIZE && reply[0] == 0xFE && reply[1] == 0xFE && reply[2] == CIV_ADDRESS_COMPUTER &&
+			       reply[reply.size() - 1] == 0xFD;
+		}
+
+		bool poll()
+		{
+			std::vector<uint8_t> reply;
+			const std::vector<uint8_t> frame = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_FREQUENCY, 0xFD };
+			return request(frame, reply) && reply[3] == CIV_ADDRESS_RADIO && reply[4] == COMMAND_GET_FREQUENCY;
+		}
+
+		bool negotiate(uint32_t baud)
+		{
+			uint8_t raw[4] = { (uint8_t)baud, (uint8_t)(baud >> 8), (uint8_t)(baud >> 16), (uint8_t)(baud >> 24) };
+			std::vector<uint8_t> frame = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_VENDOR, CIV_VENDOR_LINE_RATE };
+			frame.resize(6 + CIV_7BIT_PACKED_SIZE(4));
+			civPack7(raw, 4, &frame[6]);
+			frame.push_back(0xFD);
+
+			std::vector<uint8_t> reply;
+			return request(frame, reply) && reply[4] == CIV_ACK_OK;
+		}
+
+		// Poll fino al primo successo; restituisce i poll falliti, -1 se oltre il limite
+		int pollUntilOk(int limit)
+		{
+			for (int failed = 0; failed < limit; failed++)
+			{
+				if (poll()) return failed;
+			}
+			return -1;
+		}
+	};
+
+	double seconds() { return HostClock::nowMicros() / 1e6; }
+}
+
+int main()
+{
+	HostClock::useManual(true);
+	bool ok = true;
+
+	// Auto-baud: la radio parte a 9600, il controller e' fisso ad un'altra velocita'
+	const uint32_t controllerRates[] = { 4800, 19200, 38400, 115200 };
+	for (uint32_t rate : controllerRates)
+	{
+		std::unique_ptr<Bench> b(new Bench(9600, rate, true));
+		double start = seconds();
+		int failed = b->pollUntilOk(100);
+		printf("auto-baud, controller %6u: locked at %6u after %d failed polls, %.2f s\n", rate,
+		       b->sim.getLineRate().getRate(), failed, seconds() - start);
+		ok = ok && failed >= 0 && b->sim.getLineRate().getState() == ICOMSIM_RATE_LOCKED;
+	}
+
+	// Cambio concordato 9600 -> 115200
+	{
+		std::unique_ptr<Bench> b(new Bench(9600, 9600, false));
+		bool accepted = b->negotiate(115200);
+		b->link.setControllerBaud(115200);                  // Il controller segue dopo l'ACK
+		bool polled = b->poll();
+		printf("negotiate 115200: %s, first poll %s, radio at %u (state %u)\n", accepted ? "ACK" : "NG",
+		       polled ? "OK" : "failed", b->sim.getLineRate().getRate(), b->sim.getLineRate().getState());
+		ok = ok && accepted && polled && b->sim.getLineRate().getRate() == 115200;
+
+		// La linea peggiora: il clock del controller deriva del 6%, oltre la tolleranza di una UART
+		b->link.setControllerBaud(122000);
+		int failed = b->pollUntilOk(3);
+		b->link.setControllerBaud(9600);                    // Senza risposte il controller torna alla velocita' base
+		if (failed < 0) failed = 3 + b->pollUntilOk(10);
+		printf("drift at 115200: %d failed polls, radio back at %u\n", failed, b->sim.getLineRate().getRate());
+		ok = ok && failed >= 0 && b->sim.getLineRate().getRate() == 9600;
+	}
+
+	// Il controller accetta ma non cambia velocita': la radio torna indietro
+	{
+		std::unique_ptr<Bench> b(new Bench(9600, 9600, false));
+		double start = seconds();
+		bool accepted = b->negotiate(57600);
+		int failed = b->pollUntilOk(40);
+		printf("negotiate 57600, controller stays at 9600: %s, %d failed polls, %.2f s, radio at %u\n", accepted ? "ACK" : "NG",
+		       failed, seconds() - start, b->sim.getLineRate().getRate());
+		ok = ok && accepted && failed >= 0 && b->sim.getLineRate().getRate() == 9600;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+/*
+ * Project Name: Radio Firmware
+ * File: loopback_demo.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: drives IcomSim through an in-memory stream and prints the replies.
+ *
+ * NOTES:
+ * - Frames for another address, FB/FA and broadcast frames must get no reply, and a
+ *   broadcast SET must still be applied: exit code 1 otherwise.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+
+static size_t exchange(IcomSim& sim, LoopbackStream& link, const uint8_t* request, size_t length)
+{
+	link.inject(request, length);
+	sim.pumpRx();                                           // Con il ring di ricezione attivo lo farebbe l'ISR della UART
+	sim.processCIVCommand();
+	sim.processSerialQueue();
+
+	uint8_t reply[64];
+	size_t n = link.drain(reply, sizeof(reply));
+
+	printf(">");
+	for (size_t i = 0; i < length; i++) printf(" %02X", request[i]);
+	printf("\n<");
+	for (size_t i = 0; i < n; i++) printf(" %02X", reply[i]);
+	printf("\n");
+	return n;
+}
+
+int main()
+{
+	VfoData_t vfo[2] = {};
+	vfo[0].Frequency = 145500000;
+	vfo[0].Step = 12500;
+
+	LoopbackStream link;
+	IcomSim sim(link);
+	if (!sim.Initialize(&vfo[0], &vfo[1])) return 1;
+
+	const uint8_t getFrequency[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_FREQUENCY, 0xFD };
+	const uint8_t getStep[]      = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_STEP, 0xFD };
+	const uint8_t unknown[]      = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, 0x7E, 0xFD };
+
+	exchange(sim, link, getFrequency, sizeof(getFrequency));
+	exchange(sim, link, getStep, sizeof(getStep));
+	exchange(sim, link, unknown, sizeof(unknown));
+
+	// Nessuna risposta: altro destinatario, conferma di un altro dispositivo, qualunque broadcast
+	const uint8_t otherDevice[]  = { 0xFE, 0xFE, 0xA4, CIV_ADDRESS_COMPUTER, COMMAND_GET_FREQUENCY, 0xFD };
+	const uint8_t ack[]          = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, 0xA4, CIV_ACK_OK, 0xFD };
+	const uint8_t broadcast[]    = { 0xFE, 0xFE, CIV_ADDRESS_BROADCAST, 0xA4, 0x7E, 0xFD };
+	const uint8_t broadcastGet[] = { 0xFE, 0xFE, CIV_ADDRESS_BROADCAST, 0xA4, COMMAND_GET_FREQUENCY, 0xFD };
+	const uint8_t broadcastSet[] = { 0xFE, 0xFE, CIV_ADDRESS_BROADCAST, 0xA4, COMMAND_SET_SQUELCH, 0x05, 0xFD };
+	int errors = 0;
+
+	if (exchange(sim, link, otherDevice, sizeof(otherDevice)) != 0) errors++;
+	if (exchange(sim, link, ack, sizeof(ack)) != 0) errors++;
+	if (exchange(sim, link, broadcast, sizeof(broadcast)) != 0) errors++;
+	if (exchange(sim, link, broadcastGet, sizeof(broadcastGet)) != 0) errors++;
+	if (exchange(sim, link, broadcastSet, sizeof(broadcastSet)) != 0 || vfo[0].Sql != 0x05) errors++;     // Eseguito, senza FB
+
+	// Stessa richiesta, ma ricevuta attraverso il ring alimentato dal produttore
+	sim.enableRxRing(true);
+	exchange(sim, link, getFrequency, sizeof(getFrequency));
+
+	// Due consumatori indipendenti delle modifiche: ognuno le vede tutte, con il numero di ripetizioni
+	IcomSimSubscriber_t display, logger;
+	sim.subscribe(display);
+	sim.subscribe(logger);
+
+	const uint8_t setSquelch[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SET_SQUELCH, 0x03, 0xFD };
+	exchange(sim, link, setSquelch, sizeof(setSquelch));
+	exchange(sim, link, setSquelch, sizeof(setSquelch));
+
+	uint8_t counts[ICOMSIM_CHANGE_FIELDS];
+	uint16_t changed = sim.pollChanges(display, ICOMSIM_VFO_A, counts);
+	printf("display: flags 0x%04X, squelch x%u\n", changed, counts[2]);     // Bit 2 = FLAG_SQL_CHANGED
+	printf("logger:  flags 0x%04X\n", sim.pollChanges(logger, ICOMSIM_VFO_A));
+	printf("display: flags 0x%04X\n", sim.pollChanges(display, ICOMSIM_VFO_A));
+	return errors == 0 ? 0 : 1;
+}
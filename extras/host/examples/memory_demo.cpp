@@ -0,0 +1,118 @@
+/*
+ * Project Name: Radio Firmware
+ * File: memory_demo.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: a channel editor programs the whole memory bank over CI-V
+ * (0x08 select, 0x05 frequency, 0x06 mode, 0x09 write), then channels are recalled
+ * and cleared, and the bank file is reopened to check what reached the "flash".
+ *
+ * NOTES:
+ * - Usage: icomsim_memory_demo [bank-file]   (default icomsim_memory.bin, recreated)
+ */
+
+#include "IcomSim.h"
+#include "IcomSimMemory.h"
+#include "IcomSimFileStore.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+
+#include <vector>
+
+static uint32_t frames = 0;
+
+static bool exchange(IcomSim& sim, LoopbackStream& link, uint8_t command, const uint8_t* data, size_t length)
+{
+	std::vector<uint8_t> request = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, command };
+	request.insert(request.end(), data, data + length);
+	request.push_back(0xFD);
+
+	link.inject(request.data(), request.size());
+	sim.process();
+	HostClock::advanceMicros(2000);                         // ~2 ms per richiesta, come a 19200 baud
+	frames++;
+
+	uint8_t reply[32];
+	size_t n = link.drain(reply, sizeof(reply));
+	return n == 0 || reply[4] != CIV_ACK_NG;
+}
+
+static bool selectChannel(IcomSim& sim, LoopbackStream& link, uint16_t channel)
+{
+	uint8_t bcd[2];
+	civBcdEncode<2, CIV_BCD_MSB_FIRST>(channel, bcd);
+	return exchange(sim, link, COMMAND_SELECT_MEMORY, bcd, sizeof(bcd));
+}
+
+int main(int argc, char** argv)
+{
+	const char* path = argc > 1 ? argv[1] : "icomsim_memory.bin";
+	remove(path);
+	HostClock::useManual(true);
+
+	VfoData_t vfo[2] = {};
+	vfo[0].Frequency = 145500000;
+	vfo[0].Step = 12500;
+
+	IcomSimFileStore file(ICOMSIM_MEMORY_CHANNELS);
+	IcomSimMemory bank(file);
+	if (!file.open(path) || !bank.begin()) return 1;
+
+	LoopbackStream link;
+	IcomSim sim(link);
+	if (!sim.Initialize(&vfo[0], &vfo[1])) return 1;
+	sim.attachMemory(&bank);
+
+	// Programmazione completa, due passate come fa un editor che riscrive dopo la verifica
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (uint16_t ch = 0; ch < bank.getChannelCount(); ch++)
+		{
+			uint8_t frequency[5], mode = (uint8_t)(ch & 1);
+			civBcdEncode<5, CIV_BCD_RX_LAYOUT>(430000000UL + ch * 25000UL, frequency);
+
+			if (!selectChannel(sim, link, ch)) return 1;
+			exchange(sim, link, COMMAND_SET_FREQUENCY, frequency, sizeof(frequency));
+			exchange(sim, link, COMMAND_SET_MODE, &mode, 1);
+			if (!exchange(sim, link, COMMAND_MEMORY_WRITE, nullptr, 0)) return 1;
+		}
+	}
+	printf("programmed %u channels x2 with %u frames: %u record writes, %u pending\n",
+	       bank.getChannelCount(), frames, file.getWrites(), bank.getPending());
+
+	// L'editor tace: la cache finisce nel file, un record per giro del loop, poi un solo commit
+	for (int i = 0; i < 20; i++)
+	{
+		HostClock::advanceMicros(ICOMSIM_MEMORY_FLUSH_MS * 1000UL);
+		sim.process();
+	}
+	printf("after idle: %u record writes, %u commits, %u pending\n", file.getWrites(), file.getCommits(), bank.getPending());
+
+	// Richiamo e cancellazione
+	if (!selectChannel(sim, link, 42)) return 1;
+	printf("channel 42 -> VFO A %lu Hz, mode %u\n", (unsigned long)vfo[0].Frequency, (unsigned)vfo[0].Mode);
+	exchange(sim, link, COMMAND_MEMORY_CLEAR, nullptr, 0);
+	bool recalled = exchange(sim, link, COMMAND_MEMORY_TO_VFO, nullptr, 0);
+	printf("channel 42 cleared, memory to VFO %s\n", recalled ? "OK" : "NG");
+	bank.flush();
+
+	// Nuova istanza sullo stesso file: l'indice si ricostruisce dal supporto
+	IcomSimFileStore reopened(ICOMSIM_MEMORY_CHANNELS);
+	IcomSimMemory check(reopened);
+	if (!reopened.open(path) || !check.begin()) return 1;
+
+	uint16_t used = 0;
+	for (uint16_t ch = 0; ch < check.getChannelCount(); ch++) used += check.isUsed(ch) ? 1 : 0;
+
+	VfoData_t last = {};
+	check.load(check.getChannelCount() - 1, last);
+	printf("reopened: %u channels in use, last %lu Hz\n", used, (unsigned long)last.Frequency);
+
+	return used == check.getChannelCount() - 1 && !recalled ? 0 : 1;
+}
@@ -0,0 +1,197 @@
+/*
+ * Project Name: Radio Firmware
+ * File: meter_demo.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: meter commands over CI-V through an in-memory stream. Reads the cached
+ * RSSI (19), runs the periodic RSSI stream (19 nn) on a manual clock, reads the VFO
+ * status (22) and sets/reads the AGC (16), checking the BCD payloads.
+ *
+ * NOTES:
+ * - The stream must send a sample only when the value changed and never faster than
+ *   the requested interval (ICOMSIM_RSSI_MIN_INTERVAL_MS at least).
+ * - Exit code 1 on any wrong reply or stream timing.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	const uint8_t FB[] = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, CIV_ACK_OK, 0xFD };
+	const uint8_t FA[] = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, CIV_ACK_NG, 0xFD };
+	const size_t RSSI_FRAME = 8;
+
+	int errors = 0;
+
+	struct Sample
+	{
+		uint32_t ms;
+		uint16_t value;
+	};
+
+	struct Radio
+	{
+		LoopbackStream link;
+		VfoData_t vfo[2];
+		IcomSim sim;
+
+		Radio() : vfo(), sim(link)
+		{
+			vfo[0].Frequency = 145500000;
+			vfo[0].Flag.Flags = 1234;
+			vfo[1].Frequency = 433500000;
+			vfo[1].Flag.Flags = 0xFFFF;
+			if (!sim.Initialize(&vfo[0], &vfo[1])) errors++;
+		}
+
+		// Invia un frame e confronta la risposta byte per byte
+		void command(const char* what, uint8_t command, std::vector<uint8_t> data, const std::vector<uint8_t>& reply)
+		{
+			std::vector<uint8_t> frame = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, command };
+			frame.insert(frame.end(), data.begin(), data.end());
+			frame.push_back(0xFD);
+
+			link.inject(frame.data(), frame.size());
+			sim.pumpRx();
+			sim.processCIVCommand();
+			sim.processSerialQueue();
+
+			uint8_t received[64];
+			size_t n = link.drain(received, sizeof(received));
+			bool ok = n == reply.size() && memcmp(received, reply.data(), n) == 0;
+			if (!ok) errors++;
+
+			printf("%-22s <", what);
+			for (size_t i = 0; i < n; i++) printf(" %02X", received[i]);
+			printf("%s\n", ok ? "" : "  FAILED");
+		}
+
+		// Un millisecondo alla volta; raccoglie i campioni inviati senza richiesta
+		void run(uint32_t ms, std::vector<Sample>& samples, uint16_t (*level)(uint32_t))
+		{
+			for (uint32_t t = 0; t < ms; t++)
+			{
+				HostClock::advanceMicros(1000);
+				sim.setRssi(level(t));
+				sim.processSerialQueue();
+
+				uint8_t frame[RSSI_FRAME];
+				while (link.drain(frame, sizeof(frame)) == sizeof(frame))
+				{
+					uint16_t value = 0;
+					bool ok = frame[2] == CIV_ADDRESS_COMPUTER && frame[3] == CIV_ADDRESS_RADIO && frame[4] == COMMAND_GET_RSSI &&
+					          frame[7] == 0xFD && civBcdDecode<2, CIV_BCD_TX_LAYOUT>(&frame[5], value);
+					if (!ok) errors++;
+					samples.push_back({ (uint32_t)(HostClock::nowMicros() / 1000), value });
+				}
+			}
+		}
+	};
+
+	std::vector<uint8_t> reply(uint8_t command, std::vector<uint8_t> data)
+	{
+		std::vector<uint8_t> frame = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, command };
+		frame.insert(frame.end(), data.begin(), data.end());
+		frame.push_back(0xFD);
+		return frame;
+	}
+
+	void check(const char* what, bool ok)
+	{
+		if (!ok) errors++;
+		printf("  %-46s %s\n", what, ok ? "OK" : "FAILED");
+	}
+
+	// Campioni distanti almeno intervalMs, ognuno diverso dal precedente
+	void checkStream(const char* what, const std::vector<Sample>& samples, uint32_t intervalMs, size_t minCount, size_t maxCount)
+	{
+		bool ok = samples.size() >= minCount && samples.size() <= maxCount;
+		for (size_t i = 1; i < samples.size(); i++)
+		{
+			if (samples[i].ms - samples[i - 1].ms < intervalMs || samples[i].value == samples[i - 1].value) ok = false;
+		}
+
+		if (!ok) errors++;
+		printf("  %-46s %zu samples", what, samples.size());
+		for (size_t i = 0; i < samples.size() && i < 8; i++) printf(" %u@%u", samples[i].value, samples[i].ms);
+		printf(" %s\n", ok ? "OK" : "FAILED");
+	}
+
+	uint16_t steady(uint32_t) { return 321; }
+	uint16_t ramp(uint32_t t) { return (uint16_t)(400 + t); }	// Cambia ogni millisecondo
+	uint16_t slowSteps(uint32_t t) { return (uint16_t)(500 + t / 100 * 10); }	// Cambia ogni 100 ms
+}
+
+int main()
+{
+	HostClock::useManual(true);
+	Radio r;
+
+	// 19: ultimo valore fornito dal firmware, BCD su due byte, limitato a 9999
+	r.sim.setRssi(123);
+	r.command("get rssi", COMMAND_GET_RSSI, {}, reply(COMMAND_GET_RSSI, { 0x01, 0x23 }));
+	r.sim.setRssi(12345);
+	r.command("get rssi (clamped)", COMMAND_GET_RSSI, {}, reply(COMMAND_GET_RSSI, { 0x99, 0x99 }));
+	r.command("bad interval", COMMAND_GET_RSSI, { 0x5A }, std::vector<uint8_t>(FA, FA + sizeof(FA)));
+
+	// 19 05: invio ogni 50 ms; il primo campione parte subito dietro al FB
+	r.sim.setRssi(321);
+	std::vector<uint8_t> started(FB, FB + sizeof(FB));
+	std::vector<uint8_t> first = reply(COMMAND_GET_RSSI, { 0x03, 0x21 });
+	started.insert(started.end(), first.begin(), first.end());
+	r.command("stream 50 ms", COMMAND_GET_RSSI, { 0x05 }, started);
+
+	std::vector<Sample> samples;
+	r.run(300, samples, steady);
+	check("steady value: nothing sent", samples.empty());
+
+	samples.clear();
+	r.run(500, samples, ramp);
+	checkStream("changing every ms: one sample per 50 ms", samples, 50, 9, 10);
+
+	samples.clear();
+	r.run(1000, samples, slowSteps);
+	checkStream("changing every 100 ms: one sample per change", samples, 50, 10, 10);
+
+	// 19 01: 10 ms chiesti, ICOMSIM_RSSI_MIN_INTERVAL_MS applicati; riparte dall'ultimo valore (590)
+	std::vector<uint8_t> restarted(FB, FB + sizeof(FB));
+	std::vector<uint8_t> last = reply(COMMAND_GET_RSSI, { 0x05, 0x90 });
+	restarted.insert(restarted.end(), last.begin(), last.end());
+	r.command("stream 10 ms", COMMAND_GET_RSSI, { 0x01 }, restarted);
+	samples.clear();
+	r.run(200, samples, ramp);
+	checkStream("10 ms requested: capped to the minimum", samples, ICOMSIM_RSSI_MIN_INTERVAL_MS, 9, 10);
+
+	// 19 00: invio fermato
+	r.command("stop stream", COMMAND_GET_RSSI, { 0x00 }, std::vector<uint8_t>(FB, FB + sizeof(FB)));
+	samples.clear();
+	r.run(200, samples, ramp);
+	check("stopped: nothing sent", samples.empty());
+
+	// 22: flag di stato del VFO in BCD su tre byte
+	r.command("get status", COMMAND_GET_STATUS, {}, reply(COMMAND_GET_STATUS, { 0x00, 0x12, 0x34 }));
+	r.command("get status B", COMMAND_GET_STATUS, { 0x01 }, reply(COMMAND_GET_STATUS, { 0x06, 0x55, 0x35 }));
+	r.command("get status bad vfo", COMMAND_GET_STATUS, { 0x02 }, std::vector<uint8_t>(FA, FA + sizeof(FA)));
+
+	// 16: SET -> FB e flag AGC, lettura senza dati, valore fuori intervallo -> FA
+	r.sim.isChanged();
+	r.command("set agc fast", COMMAND_SET_AGC, { AGC_FAST }, std::vector<uint8_t>(FB, FB + sizeof(FB)));
+	check("AGC fast, FLAG_AGC_CHANGED", r.sim.getAgc() == AGC_FAST && r.sim.isChanged(ICOMSIM_RADIO_FLAGS) == FLAG_AGC_CHANGED);
+	r.command("get agc", COMMAND_SET_AGC, {}, reply(COMMAND_SET_AGC, { AGC_FAST }));
+	r.command("set agc out of range", COMMAND_SET_AGC, { AGC_FAST + 1 }, std::vector<uint8_t>(FA, FA + sizeof(FA)));
+	check("AGC unchanged", r.sim.getAgc() == AGC_FAST && r.sim.isChanged(ICOMSIM_RADIO_FLAGS) == 0);
+
+	printf("meter: %s\n", errors == 0 ? "OK" : "FAILED");
+	return errors == 0 ? 0 : 1;
+}
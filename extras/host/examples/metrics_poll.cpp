@@ -0,0 +1,110 @@
+/*
+ * Project Name: Radio Firmware
+ * File: metrics_poll.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: feeds IcomSim good and broken traffic, then polls its counters over
+ * CI-V (7F 02 / 7F 03) the way a monitoring tool on the CAT link would.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+#include "CivMetricsDecoder.h"
+
+static size_t exchange(IcomSim& sim, LoopbackStream& link, const uint8_t* request, size_t length, uint8_t* reply, size_t size)
+{
+	link.inject(request, length);
+	sim.processCIVCommand();
+	sim.processSerialQueue();
+	HostClock::advanceMicros(1000);
+	return link.drain(reply, size);
+}
+
+int main()
+{
+	HostClock::useManual(true);
+
+	VfoData_t vfo[2] = {};
+	vfo[0].Frequency = 145500000;
+	vfo[0].Step = 12500;
+
+	LoopbackStream link;
+	IcomSim sim(link);
+	if (!sim.Initialize(&vfo[0], &vfo[1])) return 1;
+
+	uint8_t reply[64];
+
+	const uint8_t getFrequency[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_FREQUENCY, 0xFD };
+	const uint8_t unknown[]      = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, 0x7E, 0xFD };
+	const uint8_t tooShort[]     = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, 0xFD };
+	const uint8_t badSplit[]     = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SPLIT, 0x05, 0xFD };
+
+	for (int i = 0; i < 5; i++) exchange(sim, link, getFrequency, sizeof(getFrequency), reply, sizeof(reply));
+	exchange(sim, link, unknown, sizeof(unknown), reply, sizeof(reply));
+	exchange(sim, link, tooShort, sizeof(tooShort), reply, sizeof(reply));
+	exchange(sim, link, badSplit, sizeof(badSplit), reply, sizeof(reply));
+
+	// Frame piu' lungo del buffer del parser
+	uint8_t oversized[CIV_MAX_FRAME_SIZE + 8];
+	oversized[0] = 0xFE;
+	oversized[1] = 0xFE;
+	oversized[2] = CIV_ADDRESS_RADIO;
+	oversized[3] = CIV_ADDRESS_COMPUTER;
+	for (size_t i = 4; i < sizeof(oversized) - 1; i++) oversized[i] = 0x01;
+	oversized[sizeof(oversized) - 1] = 0xFD;
+	exchange(sim, link, oversized, sizeof(oversized), reply, sizeof(reply));
+
+	// UART senza spazio: le risposte restano in coda
+	link.setTxLimit(0);
+	for (int i = 0; i < 3; i++) exchange(sim, link, getFrequency, sizeof(getFrequency), reply, sizeof(reply));
+	link.setTxLimit(4096);
+	sim.processSerialQueue();
+	link.drain(reply, sizeof(reply));
+
+	// Lettura dei contatori a blocchi
+	CivMetricsBlock metrics = {};
+	uint16_t values[ICOMSIM_METRIC_COUNT] = {};
+	uint8_t index = 0;
+
+	do
+	{
+		const uint8_t read[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_VENDOR, CIV_VENDOR_METRICS_READ, index, 0xFD };
+		size_t n = exchange(sim, link, read, sizeof(read), reply, sizeof(reply));
+		if (!civMetricsDecodeFrame(reply, n, metrics)) return 1;
+
+		for (size_t i = 0; i < metrics.values.size() && metrics.index + i < ICOMSIM_METRIC_COUNT; i++) values[metrics.index + i] = metrics.values[i];
+		index = (uint8_t)(metrics.index + metrics.values.size());
+	} while (!metrics.values.empty() && index < metrics.total);
+
+	printf("counters (%u)\n", metrics.total);
+	for (uint8_t i = 0; i < ICOMSIM_METRIC_COUNT; i++) printf("  %-14s %5u\n", civMetricName(i), values[i]);
+
+	// Frame per gestore: solo quelli usati
+	CivHitsBlock hits = {};
+	index = 0;
+
+	printf("handler hits\n");
+	do
+	{
+		const uint8_t read[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_VENDOR, CIV_VENDOR_HITS_READ, index, 0xFD };
+		size_t n = exchange(sim, link, read, sizeof(read), reply, sizeof(reply));
+		if (!civHitsDecodeFrame(reply, n, hits)) return 1;
+
+		for (const CivHandlerHits& h : hits.slots)
+		{
+			if (h.hits == 0) continue;
+			if (h.subcommand == CIV_SUBCMD_ANY) printf("  cmd %02X     %5u\n", h.command, h.hits);
+			else printf("  cmd %02X %02X  %5u\n", h.command, h.subcommand, h.hits);
+		}
+		index = (uint8_t)(hits.index + hits.slots.size());
+	} while (!hits.slots.empty() && index < hits.total);
+
+	return values[ICOMSIM_METRIC_RX_FRAMES] >= 10 && values[ICOMSIM_METRIC_NG_UNKNOWN] == 1 ? 0 : 1;
+}
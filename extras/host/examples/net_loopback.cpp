@@ -0,0 +1,230 @@
+/*
+ * Project Name: Radio Firmware
+ * File: net_loopback.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example over 127.0.0.1: IcomSim behind IcomSimRouter and IcomSimNet, with several
+ * TCP and UDP controllers talking to it at the same time.
+ *
+ * NOTES:
+ * - Server and controllers share one thread: every wait drives router.process() and
+ *   net.process() until the expected bytes arrive, so the run is deterministic.
+ * - Checks: replies go only to the controller that asked, transceive frames reach every
+ *   controller, a client beyond the slots is refused, a freed slot is reused, several
+ *   frames in one datagram come back in one datagram. Exit code 1 on any failure.
+ */
+
+#include "IcomSim.h"
+#include "IcomSimRouter.h"
+#include "IcomSimNet.h"
+#include "LoopbackStream.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+namespace
+{
+	struct Server
+	{
+		VfoData_t vfo[2];
+		LoopbackStream unused;          // Con il router la Stream del costruttore non serve
+		IcomSim sim;
+		IcomSimRouter router;
+		IcomSimNet net;
+
+		explicit Server(uint8_t protocol) : vfo(), sim(unused), router(sim)
+		{
+			vfo[0].Frequency = 145500000;
+			vfo[0].Step = 12500;
+			sim.Initialize(&vfo[0], &vfo[1]);
+			for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++) router.addPort(net.port(i));
+			net.begin(protocol, 0, true);
+		}
+
+		// Il router legge ICOMSIM_ROUTER_RX_BUDGET byte per porta a turno: si gira finche' i datagrammi arrivati sono
+		// consumati, cosi' tutte le risposte partono insieme con il net.process() successivo
+		void pump()
+		{
+			bool pending;
+			do
+			{
+				router.process();
+				pending = false;
+				for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++) pending = pending || net.port(i).available() > 0;
+			} while (pending);
+			net.process();
+		}
+	};
+
+	int connectTo(uint8_t protocol, uint16_t port)
+	{
+		int fd = socket(AF_INET, protocol == ICOMSIM_NET_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+		struct sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) return -1;
+
+		int one = 1;
+		if (protocol == ICOMSIM_NET_TCP) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		return fd;
+	}
+
+	// Riceve finche' arrivano count frame (o scade il numero di giri); datagrams conta le recv() andate a buon fine
+	std::vector<uint8_t> collect(Server& server, int fd, size_t frames, int* datagrams = nullptr, int turns = 2000)
+	{
+		std::vector<uint8_t> out;
+		size_t seen = 0;
+		for (int t = 0; t < turns && seen < frames; t++)
+		{
+			server.pump();
+			uint8_t data[512];
+			ssize_t n = recv(fd, data, sizeof(data), MSG_DONTWAIT);
+			if (n <= 0) continue;
+			if (datagrams) (*datagrams)++;
+			for (ssize_t i = 0; i < n; i++)
+			{
+				out.push_back(data[i]);
+				if (data[i] == 0xFD) seen++;
+			}
+		}
+		return out;
+	}
+
+	std::vector<uint8_t> getFrequency(uint8_t controller)
+	{
+		return { 0xFE, 0xFE, CIV_ADDRESS_RADIO, controller, COMMAND_GET_FREQUENCY, 0xFD };
+	}
+
+	// Frame per frame: destinatario atteso e comando
+	bool repliesTo(const std::vector<uint8_t>& data, uint8_t controller, uint8_t command, size_t frames)
+	{
+		size_t found = 0;
+		for (size_t start = 0, i = 0; i < data.size(); i++)
+		{
+			if (data[i] != 0xFD) continue;
+			if (i - start < 5 || data[start + 2] != controller || data[start + 4] != command) return false;
+			found++;
+			start = i + 1;
+		}
+		return found == frames;
+	}
+}
+
+int main()
+{
+	bool ok = true;
+
+	// TCP: tre controller con indirizzi diversi, ognuno manda tre richieste in una sola write()
+	{
+		Server server(ICOMSIM_NET_TCP);
+		const uint8_t addresses[ICOMSIM_NET_MAX_CLIENTS] = { 0xE1, 0xE2, 0xE3 };
+		int fds[ICOMSIM_NET_MAX_CLIENTS];
+
+		for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++) fds[i] = connectTo(ICOMSIM_NET_TCP, server.net.getPort());
+		for (int t = 0; t < 100 && server.net.getClientCount() < ICOMSIM_NET_MAX_CLIENTS; t++) server.pump();
+
+		for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++)
+		{
+			std::vector<uint8_t> batch;
+			for (int k = 0; k < 3; k++)
+			{
+				std::vector<uint8_t> f = getFrequency(addresses[i]);
+				batch.insert(batch.end(), f.begin(), f.end());
+			}
+			send(fds[i], batch.data(), batch.size(), 0);
+		}
+		for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++)
+		{
+			bool mine = repliesTo(collect(server, fds[i], 3), addresses[i], COMMAND_GET_FREQUENCY, 3);
+			printf("tcp client %u (%02X): 3 replies %s\n", i, addresses[i], mine ? "OK" : "WRONG");
+			ok = ok && mine;
+		}
+
+		// Modifica locale con transceive: il frame 00 arriva a tutti
+		server.sim.setTransceive(true, 0);
+		server.vfo[0].Frequency = 146000000;
+		server.sim.notifyLocalChange(FLAG_FREQUENCY_CHANGED);
+		for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++)
+		{
+			bool got = repliesTo(collect(server, fds[i], 1), CIV_ADDRESS_BROADCAST, COMMAND_TRANSCEIVE_FREQUENCY, 1);
+			ok = ok && got;
+		}
+		printf("transceive broadcast to %u clients: %s\n", ICOMSIM_NET_MAX_CLIENTS, ok ? "OK" : "FAILED");
+
+		// Un client di troppo viene chiuso; liberato uno slot, il nuovo client viene servito
+		int extra = connectTo(ICOMSIM_NET_TCP, server.net.getPort());
+		for (int t = 0; t < 100; t++) server.pump();
+		uint8_t byte;
+		bool refused = recv(extra, &byte, 1, MSG_DONTWAIT) == 0;
+		close(extra);
+
+		close(fds[0]);
+		for (int t = 0; t < 100 && server.net.getClientCount() == ICOMSIM_NET_MAX_CLIENTS; t++) server.pump();
+		fds[0] = connectTo(ICOMSIM_NET_TCP, server.net.getPort());
+		std::vector<uint8_t> f = getFrequency(0xE4);
+		send(fds[0], f.data(), f.size(), 0);
+		bool reused = repliesTo(collect(server, fds[0], 1), 0xE4, COMMAND_GET_FREQUENCY, 1);
+		printf("extra client refused: %s, freed slot reused: %s\n", refused ? "yes" : "no", reused ? "yes" : "no");
+		ok = ok && refused && reused;
+
+		// Tempo di andata e ritorno su loopback, server e client nello stesso thread
+		const int rounds = 2000;
+		auto start = std::chrono::steady_clock::now();
+		int answered = 0;
+		for (int r = 0; r < rounds; r++)
+		{
+			send(fds[1], getFrequency(addresses[1]).data(), 6, 0);
+			answered += collect(server, fds[1], 1).empty() ? 0 : 1;
+		}
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+		printf("tcp round trip: %.1f us (%d/%d answered)\n", us, answered, rounds);
+		ok = ok && answered == rounds;
+
+		for (int fd : fds) close(fd);
+	}
+
+	// UDP: due controller, quattro richieste in un datagramma, quattro risposte in un datagramma
+	{
+		Server server(ICOMSIM_NET_UDP);
+		const uint8_t addresses[2] = { 0xE1, 0xE2 };
+		int fds[2];
+
+		for (int i = 0; i < 2; i++)
+		{
+			fds[i] = connectTo(ICOMSIM_NET_UDP, server.net.getPort());
+			std::vector<uint8_t> batch;
+			for (int k = 0; k < 4; k++)
+			{
+				std::vector<uint8_t> f = getFrequency(addresses[i]);
+				batch.insert(batch.end(), f.begin(), f.end());
+			}
+			send(fds[i], batch.data(), batch.size(), 0);
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			int datagrams = 0;
+			std::vector<uint8_t> replies = collect(server, fds[i], 4, &datagrams);
+			bool mine = repliesTo(replies, addresses[i], COMMAND_GET_FREQUENCY, 4);
+			printf("udp client %d (%02X): 4 replies %s in %d datagram(s)\n", i, addresses[i], mine ? "OK" : "WRONG", datagrams);
+			ok = ok && mine && datagrams == 1;
+		}
+		ok = ok && server.net.getClientCount() == 2;
+
+		for (int fd : fds) close(fd);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+/*
+ * Project Name: Radio Firmware
+ * File: snapshot_poll.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example on a simulated 9600 baud line: a CAT poll cycle made of one GET per
+ * field (03, 15, 1D, 1F, 21, 24) against the same state read with one snapshot (7F 09),
+ * then the "changed only" snapshot after a controller changes the frequency.
+ *
+ * NOTES:
+ * - Each exchange also pays TURNAROUND_US, the fixed cost of a request/reply cycle
+ *   (USB serial adapter latency, controller scheduling); line time comes from
+ *   SimSerialLink.
+ * - The mode has no GET command in IcomSim, so the per-field cycle cannot read it at
+ *   all: the snapshot also carries the mode.
+ */
+
+#include "IcomSim.h"
+#include "SimSerialLink.h"
+#include "HostClock.h"
+#include "CivSnapshotDecoder.h"
+
+namespace
+{
+	const uint32_t BAUD = 9600;
+	const uint64_t TURNAROUND_US = 4000;
+	const int CYCLES = 50;
+
+	struct Bench
+	{
+		SimSerialLink link;
+		VfoData_t vfo[2];
+		IcomSim sim;
+		size_t bytes;
+
+		Bench() : link(BAUD, BAUD), vfo(), sim(link), bytes(0)
+		{
+			vfo[0].Frequency = 145500000;
+			vfo[0].Step = 12500;
+			vfo[0].Sql = 3;
+			vfo[0].txp = 2;
+			vfo[1].Frequency = 433500000;
+			vfo[1].Step = 25000;
+			sim.Initialize(&vfo[0], &vfo[1]);
+		}
+
+		std::vector<uint8_t> exchange(const std::vector<uint8_t>& frame)
+		{
+			std::vector<uint8_t> reply;
+			link.controllerSend(frame.data(), frame.size());
+			sim.process();
+			link.controllerReceive(reply);
+			HostClock::advanceMicros(TURNAROUND_US);
+			bytes += frame.size() + reply.size();
+			return reply;
+		}
+
+		// Divide la risposta nei frame FE FE ... FD
+		static std::vector<std::vector<uint8_t>> frames(const std::vector<uint8_t>& reply)
+		{
+			std::vector<std::vector<uint8_t>> out;
+			std::vector<uint8_t> current;
+			for (uint8_t byte : reply)
+			{
+				current.push_back(byte);
+				if (byte == 0xFD)
+				{
+					out.push_back(current);
+					current.clear();
+				}
+			}
+			return out;
+		}
+
+		bool snapshot(uint8_t select, uint8_t options, CivSnapshot& result)
+		{
+			result = CivSnapshot();
+			std::vector<uint8_t> reply = exchange(civSnapshotRequest(CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, select, options));
+			for (const auto& frame : frames(reply))
+			{
+				if (!civSnapshotDecodeFrame(frame.data(), frame.size(), result)) return false;
+			}
+			return !result.records.empty() || (options & CIV_SNAPSHOT_CHANGED_ONLY);
+		}
+	};
+
+	double millisSince(uint64_t start) { return (HostClock::nowMicros() - start) / 1000.0; }
+}
+
+int main()
+{
+	HostClock::useManual(true);
+	bool ok = true;
+
+	// Un GET per campo, sul solo VFO selezionato
+	{
+		Bench b;
+		const uint8_t gets[] = { COMMAND_GET_FREQUENCY, COMMAND_GET_SQUELCH, COMMAND_GET_RFGAIN,
+		                         COMMAND_GET_BANDWIDTH, COMMAND_GET_TX_POWER, COMMAND_GET_STEP };
+		uint64_t start = HostClock::nowMicros();
+		for (int c = 0; c < CYCLES; c++)
+		{
+			for (uint8_t command : gets)
+			{
+				std::vector<uint8_t> reply = b.exchange({ 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, command, 0xFD });
+				ok = ok && reply.size() > 6 && reply[4] == command;
+			}
+		}
+		printf("per-field GET : %zu exchanges/cycle, %5.1f ms/cycle, %3zu bytes/cycle (selected VFO, no mode)\n",
+		       sizeof(gets), millisSince(start) / CYCLES, b.bytes / CYCLES);
+	}
+
+	// Istantanea: VFO selezionato, poi entrambi
+	const uint8_t selections[] = { CIV_SNAPSHOT_SELECTED, CIV_SNAPSHOT_BOTH };
+	for (uint8_t select : selections)
+	{
+		Bench b;
+		CivSnapshot s;
+		uint64_t start = HostClock::nowMicros();
+		for (int c = 0; c < CYCLES; c++) ok = b.snapshot(select, 0, s) && ok;
+
+		printf("snapshot %-5s: 1 exchange/cycle,  %5.1f ms/cycle, %3zu bytes/cycle, %zu record(s)\n",
+		       select == CIV_SNAPSHOT_BOTH ? "both" : "sel", millisSince(start) / CYCLES, b.bytes / CYCLES, s.records.size());
+
+		VfoData_t cached[2] = {};
+		for (const auto& r : s.records) r.apply(cached[r.vfo]);
+		ok = ok && s.version == CIV_SNAPSHOT_VERSION && cached[0].Frequency == b.vfo[0].Frequency && cached[0].Step == b.vfo[0].Step &&
+		     cached[0].Sql == b.vfo[0].Sql && cached[0].txp == b.vfo[0].txp;
+		if (select == CIV_SNAPSHOT_BOTH) ok = ok && s.records.size() == 2 && cached[1].Frequency == b.vfo[1].Frequency;
+	}
+
+	// Solo i campi cambiati: la prima richiesta e' completa, poi vuota finche' qualcosa non cambia
+	{
+		Bench b;
+		CivSnapshot s;
+		VfoData_t cached[2] = {};
+
+		ok = b.snapshot(CIV_SNAPSHOT_BOTH, CIV_SNAPSHOT_CHANGED_ONLY, s) && ok;
+		for (const auto& r : s.records) r.apply(cached[r.vfo]);
+		printf("changed-only, first  : masks %04X %04X\n", s.records[0].mask, s.records[1].mask);
+
+		b.bytes = 0;
+		ok = b.snapshot(CIV_SNAPSHOT_BOTH, CIV_SNAPSHOT_CHANGED_ONLY, s) && ok;
+		printf("changed-only, idle   : masks %04X %04X, %zu bytes\n", s.records[0].mask, s.records[1].mask, b.bytes);
+		ok = ok && s.records[0].mask == 0 && s.records[1].mask == 0;
+
+		// Un altro programma CAT cambia la frequenza del VFO A
+		std::vector<uint8_t> set = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_SET_FREQUENCY, 0, 0, 0, 0, 0, 0xFD };
+		civBcdEncode<5, CIV_BCD_RX_LAYOUT>((uint32_t)146520000, &set[5]);
+		b.exchange(set);
+
+		b.bytes = 0;
+		ok = b.snapshot(CIV_SNAPSHOT_BOTH, CIV_SNAPSHOT_CHANGED_ONLY, s) && ok;
+		for (const auto& r : s.records) r.apply(cached[r.vfo]);
+		printf("changed-only, set 05 : masks %04X %04X, %zu bytes, VFO A %u Hz\n", s.records[0].mask, s.records[1].mask, b.bytes,
+		       cached[0].Frequency);
+		ok = ok && (s.state & CIV_SNAPSHOT_STATE_CHANGED) && s.records[0].mask == FLAG_FREQUENCY_CHANGED && cached[0].Frequency == 146520000 &&
+		     cached[0].Step == 12500;
+	}
+
+	// Versione o selezione sconosciute: NG
+	{
+		Bench b;
+		std::vector<uint8_t> reply = b.exchange(civSnapshotRequest(CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, 0x04, 0));
+		ok = ok && reply.size() == 6 && reply[4] == CIV_ACK_NG;
+	}
+
+	return ok ? 0 : 1;
+}
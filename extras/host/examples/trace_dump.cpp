@@ -0,0 +1,97 @@
+/*
+ * Project Name: Radio Firmware
+ * File: trace_dump.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: generates some CI-V traffic, then reads the trace back over CI-V
+ * (freeze, read, resume) the way a PC tool would and decodes it.
+ *
+ * NOTES:
+ * - With --hex only the captured replies are printed, ready for trace_decode:
+ *   icomsim_trace_dump --hex | icomsim_trace_decode
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+#include "CivTraceDecoder.h"
+
+#include <string.h>
+
+static bool hexOnly = false;
+
+static size_t exchange(IcomSim& sim, LoopbackStream& link, const uint8_t* request, size_t length, uint8_t* reply, size_t size)
+{
+	link.inject(request, length);
+	sim.processCIVCommand();
+	sim.processSerialQueue();
+	HostClock::advanceMicros(250);
+
+	size_t n = link.drain(reply, size);
+
+	if (hexOnly)
+	{
+		for (size_t i = 0; i < n; i++) printf("%02X%c", reply[i], i + 1 < n ? ' ' : '\n');
+	}
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	hexOnly = argc > 1 && strcmp(argv[1], "--hex") == 0;
+	HostClock::useManual(true);
+
+	VfoData_t vfo[2] = {};
+	vfo[0].Frequency = 145500000;
+	vfo[0].Step = 12500;
+
+	LoopbackStream link;
+	IcomSim sim(link);
+	if (!sim.Initialize(&vfo[0], &vfo[1])) return 1;
+
+	uint8_t reply[64];
+
+	// Traffico da tracciare: una lettura, un comando sconosciuto, un frame interrotto da un jam
+	const uint8_t getFrequency[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_FREQUENCY, 0xFD };
+	const uint8_t unknown[]      = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, 0x7E, 0xFD };
+	const uint8_t jammed[]       = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_STEP, 0xFC, 0xFD };
+
+	exchange(sim, link, getFrequency, sizeof(getFrequency), reply, sizeof(reply));
+	exchange(sim, link, unknown, sizeof(unknown), reply, sizeof(reply));
+	exchange(sim, link, jammed, sizeof(jammed), reply, sizeof(reply));
+
+	// Lettura: si congela la traccia, si chiedono i record a blocchi, poi si riprende
+	const uint8_t freeze[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_VENDOR, CIV_VENDOR_TRACE_CONTROL, 0x01, 0xFD };
+	const uint8_t resume[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_VENDOR, CIV_VENDOR_TRACE_CONTROL, 0x00, 0xFD };
+
+	exchange(sim, link, freeze, sizeof(freeze), reply, sizeof(reply));
+
+	std::vector<CivTraceRecord_t> records;
+	CivTraceBlock block = {};
+	uint16_t index = 0;
+
+	do
+	{
+		const uint8_t read[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_VENDOR, CIV_VENDOR_TRACE_READ,
+		                         (uint8_t)(index & 0x7F), (uint8_t)(index >> 7), 0xFD };
+
+		size_t n = exchange(sim, link, read, sizeof(read), reply, sizeof(reply));
+		if (!civTraceDecodeFrame(reply, n, block)) return 1;
+
+		records.insert(records.end(), block.records.begin(), block.records.end());
+		index += (uint16_t)block.records.size();
+	} while (!block.records.empty() && index < block.available);
+
+	exchange(sim, link, resume, sizeof(resume), reply, sizeof(reply));
+	if (hexOnly) return 0;
+
+	printf("%zu records, sequence %u\n", records.size(), block.sequence);
+	for (const CivTraceRecord_t& r : records) printf("%s\n", civTraceFormat(r, records[0].time).c_str());
+	return records.size() == block.available ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+/*
+ * Project Name: Radio Firmware
+ * File: transceive_demo.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: transceive frames (00 frequency, 01 mode) for local changes, on a
+ * manual clock. A tuning knob turned several times inside the coalescing window must
+ * produce a single frame carrying the last value, sent when the window expires.
+ *
+ * NOTES:
+ * - The window opens at the first change not yet sent (setTransceive(), default
+ *   ICOMSIM_TRANSCEIVE_WINDOW_MS).
+ * - Exit code 1 on a missing, extra, early or wrong frame.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+
+#include <vector>
+
+namespace
+{
+	int errors = 0;
+
+	struct Sent
+	{
+		uint32_t ms;
+		std::vector<uint8_t> frame;
+	};
+
+	struct Radio
+	{
+		LoopbackStream link;
+		VfoData_t vfo[2];
+		IcomSim sim;
+		uint32_t origin;									// ms dell'inizio dello scenario
+		std::vector<Sent> sent;
+
+		Radio() : vfo(), sim(link), origin(0)
+		{
+			vfo[0].Frequency = 145500000;
+			vfo[0].Mode = MODE_FM;
+			vfo[1].Frequency = 433500000;
+			if (!sim.Initialize(&vfo[0], &vfo[1])) errors++;
+		}
+
+		uint32_t now() const { return (uint32_t)(HostClock::nowMicros() / 1000) - origin; }
+
+		void start()
+		{
+			origin = (uint32_t)(HostClock::nowMicros() / 1000);
+			sent.clear();
+		}
+
+		// Avanza fino a until ms dall'inizio, un millisecondo alla volta, separando i frame inviati
+		void runUntil(uint32_t until)
+		{
+			while (now() < until)
+			{
+				HostClock::advanceMicros(1000);
+				sim.processSerialQueue();
+
+				uint8_t bytes[64];
+				size_t n = link.drain(bytes, sizeof(bytes));
+				for (size_t i = 0; i < n; i++)
+				{
+					if (i == 0 || bytes[i - 1] == 0xFD) sent.push_back({ now(), {} });
+					sent.back().frame.push_back(bytes[i]);
+				}
+			}
+		}
+
+		void tune(uint32_t frequency)
+		{
+			vfo[0].Frequency = frequency;
+			sim.notifyLocalChange(FLAG_FREQUENCY_CHANGED);
+		}
+
+		void changeMode(BK4819_Mode_t mode)
+		{
+			vfo[0].Mode = mode;
+			sim.notifyLocalChange(FLAG_MODE_CHANGED);
+		}
+	};
+
+	std::vector<uint8_t> frequencyFrame(uint32_t frequency)
+	{
+		std::vector<uint8_t> frame = { 0xFE, 0xFE, CIV_ADDRESS_BROADCAST, CIV_ADDRESS_RADIO, COMMAND_TRANSCEIVE_FREQUENCY };
+		uint8_t bcd[6];
+		civBcdEncode<6, CIV_BCD_TX_LAYOUT>(frequency, bcd);
+		frame.insert(frame.end(), bcd, bcd + sizeof(bcd));
+		frame.push_back(0xFD);
+		return frame;
+	}
+
+	std::vector<uint8_t> modeFrame(uint8_t mode)
+	{
+		return { 0xFE, 0xFE, CIV_ADDRESS_BROADCAST, CIV_ADDRESS_RADIO, COMMAND_TRANSCEIVE_MODE, mode, 0xFD };
+	}
+
+	// Frame attesi, tutti inviati a sentAt ms
+	void expect(const char* what, const Radio& r, uint32_t sentAt, const std::vector<std::vector<uint8_t>>& frames)
+	{
+		bool ok = r.sent.size() == frames.size();
+		for (size_t i = 0; ok && i < frames.size(); i++)
+		{
+			ok = r.sent[i].frame == frames[i] && r.sent[i].ms == sentAt;
+		}
+		if (!ok) errors++;
+
+		printf("%-40s %s\n", what, ok ? "OK" : "FAILED");
+		for (const Sent& s : r.sent)
+		{
+			printf("  %4u ms <", s.ms);
+			for (uint8_t b : s.frame) printf(" %02X", b);
+			printf("\n");
+		}
+	}
+}
+
+int main()
+{
+	HostClock::useManual(true);
+	Radio r;
+
+	// Transceive spento: nessun frame
+	r.start();
+	r.tune(145512500);
+	r.runUntil(200);
+	expect("transceive off: nothing sent", r, 0, {});
+
+	r.sim.setTransceive(true);
+
+	// Manopola: cinque scatti a 10 ms l'uno dall'altro, tutti dentro la finestra aperta dal primo
+	r.start();
+	for (uint32_t i = 1; i <= 5; i++)
+	{
+		r.tune(145500000 + i * 12500);
+		r.runUntil(i * 10);
+	}
+	r.runUntil(300);
+	expect("5 steps in the window: one frame", r, ICOMSIM_TRANSCEIVE_WINDOW_MS, { frequencyFrame(145562500) });
+
+	// Frequenza e modo nella stessa finestra: un frame per campo, insieme
+	r.start();
+	r.tune(145600000);
+	r.runUntil(20);
+	r.changeMode(MODE_AM);
+	r.runUntil(30);
+	r.tune(145612500);
+	r.runUntil(300);
+	expect("frequency and mode: one frame each", r, ICOMSIM_TRANSCEIVE_WINDOW_MS, { frequencyFrame(145612500), modeFrame(MODE_AM) });
+
+	// Modifiche che il transceive non riporta
+	r.start();
+	r.vfo[0].Sql = 4;
+	r.sim.notifyLocalChange(FLAG_SQL_CHANGED);
+	r.runUntil(200);
+	expect("squelch only: nothing sent", r, 0, {});
+
+	// Finestra piu' lunga: un solo frame anche per modifiche distanti piu' di ICOMSIM_TRANSCEIVE_WINDOW_MS
+	r.sim.setTransceive(true, 200);
+	r.start();
+	r.tune(145700000);
+	r.runUntil(120);
+	r.tune(145712500);
+	r.runUntil(500);
+	expect("200 ms window: one frame", r, 200, { frequencyFrame(145712500) });
+
+	// Una modifica dopo l'invio apre una nuova finestra
+	r.start();
+	r.changeMode(MODE_FM);
+	r.runUntil(250);
+	r.changeMode(MODE_SSB);
+	r.runUntil(600);
+	bool ok = r.sent.size() == 2 && r.sent[0].ms == 200 && r.sent[0].frame == modeFrame(MODE_FM) &&
+	          r.sent[1].ms == 450 && r.sent[1].frame == modeFrame(MODE_SSB);
+	if (!ok) errors++;
+	printf("%-40s %s\n", "change after the send: new window", ok ? "OK" : "FAILED");
+
+	printf("transceive: %s\n", errors == 0 ? "OK" : "FAILED");
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+/*
+ * Project Name: Radio Firmware
+ * File: vfo_demo.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host example: VFO A/B over CI-V through an in-memory stream. Selects VFO B (07 01),
+ * copies it onto A (07 A0), exchanges them (07 B0) and toggles split (0F), checking
+ * the replies, the VFO each SET_FREQUENCY lands on and the per-VFO isChanged() flags.
+ *
+ * NOTES:
+ * - Exit code 1 on any wrong reply, frequency or flag.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+
+#include <string.h>
+#include <vector>
+
+namespace
+{
+	const uint8_t FB[] = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, CIV_ACK_OK, 0xFD };
+	const uint8_t FA[] = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, CIV_ACK_NG, 0xFD };
+
+	int errors = 0;
+
+	struct Radio
+	{
+		LoopbackStream link;
+		VfoData_t vfo[2];
+		IcomSim sim;
+
+		Radio() : vfo(), sim(link)
+		{
+			vfo[0].Frequency = 145500000;
+			vfo[0].Step = 12500;
+			vfo[1].Frequency = 433500000;
+			vfo[1].Step = 25000;
+			vfo[1].Mode = MODE_FM;
+			if (!sim.Initialize(&vfo[0], &vfo[1])) errors++;
+		}
+
+		// Invia un frame e confronta la risposta byte per byte
+		void expect(const char* what, const std::vector<uint8_t>& request, const uint8_t* reply, size_t replyLength)
+		{
+			link.inject(request.data(), request.size());
+			sim.pumpRx();
+			sim.processCIVCommand();
+			sim.processSerialQueue();
+
+			uint8_t received[64];
+			size_t n = link.drain(received, sizeof(received));
+			bool ok = n == replyLength && memcmp(received, reply, n) == 0;
+			if (!ok) errors++;
+
+			printf("%-22s <", what);
+			for (size_t i = 0; i < n; i++) printf(" %02X", received[i]);
+			printf("%s\n", ok ? "" : "  FAILED");
+		}
+
+		void command(const char* what, uint8_t command, std::vector<uint8_t> data, const uint8_t* reply, size_t replyLength)
+		{
+			std::vector<uint8_t> frame = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, command };
+			frame.insert(frame.end(), data.begin(), data.end());
+			frame.push_back(0xFD);
+			expect(what, frame, reply, replyLength);
+		}
+
+		void setFrequency(uint32_t frequency)
+		{
+			std::vector<uint8_t> bcd(5);
+			civBcdEncode<5, CIV_BCD_RX_LAYOUT>(frequency, bcd.data());
+			command("set frequency", COMMAND_SET_FREQUENCY, bcd, FB, sizeof(FB));
+		}
+	};
+
+	void check(const char* what, bool ok)
+	{
+		if (!ok) errors++;
+		printf("  %-40s %s\n", what, ok ? "OK" : "FAILED");
+	}
+
+	// Flag di un VFO letti (e azzerati) da isChanged(vfo)
+	void checkFlags(IcomSim& sim, uint16_t a, uint16_t b, uint16_t radio)
+	{
+		uint16_t gotA = sim.isChanged(ICOMSIM_VFO_A);
+		uint16_t gotB = sim.isChanged(ICOMSIM_VFO_B);
+		uint16_t gotRadio = sim.isChanged(ICOMSIM_RADIO_FLAGS);
+		bool ok = gotA == a && gotB == b && gotRadio == radio;
+		if (!ok) errors++;
+		printf("  flags A 0x%04X  B 0x%04X  radio 0x%04X %s\n", gotA, gotB, gotRadio, ok ? "OK" : "FAILED");
+	}
+}
+
+int main()
+{
+	Radio r;
+	r.sim.isChanged();                                      // Parte da flag puliti
+
+	// 07 01: VFO B selezionato, il SET successivo va su B
+	r.command("select B", COMMAND_SELECT_VFO, { CIV_VFO_B }, FB, sizeof(FB));
+	check("VFO B selected", r.sim.getSelectedVfo() == ICOMSIM_VFO_B);
+	checkFlags(r.sim, 0, 0, FLAG_VFO_CHANGED);
+
+	r.setFrequency(433600000);
+	check("SET landed on B, A untouched", r.vfo[1].Frequency == 433600000 && r.vfo[0].Frequency == 145500000);
+	checkFlags(r.sim, 0, FLAG_FREQUENCY_CHANGED, 0);
+
+	const uint8_t frequencyB[] = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, COMMAND_GET_FREQUENCY,
+	                               0x00, 0x04, 0x33, 0x60, 0x00, 0x00, 0xFD };
+	r.command("get frequency (B)", COMMAND_GET_FREQUENCY, {}, frequencyB, sizeof(frequencyB));
+
+	// 07 A0: il VFO selezionato (B) copiato su A; solo A risulta modificato
+	r.command("A=B", COMMAND_SELECT_VFO, { CIV_VFO_EQUALIZE }, FB, sizeof(FB));
+	check("A is a copy of B", r.vfo[0].Frequency == 433600000 && r.vfo[0].Step == 25000 && r.vfo[0].Mode == MODE_FM);
+	checkFlags(r.sim, FLAG_VFO_FIELDS, 0, 0);
+
+	// Di nuovo su A, poi scambio: la selezione resta su A, che ora contiene il vecchio B
+	r.command("select A", COMMAND_SELECT_VFO, { CIV_VFO_A }, FB, sizeof(FB));
+	r.setFrequency(145525000);
+	check("SET landed on A", r.vfo[0].Frequency == 145525000 && r.vfo[1].Frequency == 433600000);
+	checkFlags(r.sim, FLAG_FREQUENCY_CHANGED, 0, FLAG_VFO_CHANGED);
+
+	r.command("exchange", COMMAND_SELECT_VFO, { CIV_VFO_EXCHANGE }, FB, sizeof(FB));
+	check("A and B swapped", r.vfo[0].Frequency == 433600000 && r.vfo[1].Frequency == 145525000);
+	checkFlags(r.sim, FLAG_VFO_FIELDS, FLAG_VFO_FIELDS, 0);
+
+	r.setFrequency(144800000);
+	check("SET after exchange landed on A", r.sim.getSelectedVfo() == ICOMSIM_VFO_A &&
+	      r.vfo[0].Frequency == 144800000 && r.vfo[1].Frequency == 145525000);
+	checkFlags(r.sim, FLAG_FREQUENCY_CHANGED, 0, 0);
+
+	// Riselezionare il VFO gia' attivo non e' una modifica
+	r.command("select A again", COMMAND_SELECT_VFO, { CIV_VFO_A }, FB, sizeof(FB));
+	checkFlags(r.sim, 0, 0, 0);
+	r.command("bad subcommand", COMMAND_SELECT_VFO, { 0x05 }, FA, sizeof(FA));
+
+	// 0F: split attivo, lettura dello stato, richieste non valide
+	const uint8_t splitOn[] = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, COMMAND_SPLIT, 0x01, 0xFD };
+	const uint8_t splitOff[] = { 0xFE, 0xFE, CIV_ADDRESS_COMPUTER, CIV_ADDRESS_RADIO, COMMAND_SPLIT, 0x00, 0xFD };
+
+	r.command("get split", COMMAND_SPLIT, {}, splitOff, sizeof(splitOff));
+	r.command("split on", COMMAND_SPLIT, { 0x01 }, FB, sizeof(FB));
+	check("split enabled", r.sim.isSplit());
+	checkFlags(r.sim, 0, 0, FLAG_SPLIT_CHANGED);
+
+	r.command("get split", COMMAND_SPLIT, {}, splitOn, sizeof(splitOn));
+	r.command("split on again", COMMAND_SPLIT, { 0x01 }, FB, sizeof(FB));
+	checkFlags(r.sim, 0, 0, 0);
+	r.command("bad split value", COMMAND_SPLIT, { 0x02 }, FA, sizeof(FA));
+
+	r.command("split off", COMMAND_SPLIT, { 0x00 }, FB, sizeof(FB));
+	check("split disabled", !r.sim.isSplit());
+	checkFlags(r.sim, 0, 0, FLAG_SPLIT_CHANGED);
+
+	printf("vfo: %s\n", errors == 0 ? "OK" : "FAILED");
+	return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+/*
+ * Project Name: Radio Firmware
+ * File: Arduino.h (host shim)
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Minimal stand-in for the Arduino core, used only by the host (Linux) build.
+ *
+ * NOTES:
+ * - Provides just what IcomSim touches: Print/Stream, String, millis()/micros() and
+ *   the interrupt macros. It is not a general Arduino emulation layer.
+ * - Time can be switched to a manual clock (see HostClock.h) for deterministic simulations.
+ */
+
+#ifndef ICOMSIM_HOST_ARDUINO_H
+#define ICOMSIM_HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#define A2 16
+#define A3 17
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+class String
+{
+public:
+	String(const char* text = "") : value(text) {}
+	const char* c_str() const { return value.c_str(); }
+	unsigned int length() const { return (unsigned int)value.size(); }
+
+private:
+	std::string value;
+};
+
+class Print
+{
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t byte) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size)
+	{
+		size_t n = 0;
+		while (n < size && write(buffer[n])) n++;
+		return n;
+	}
+	virtual int availableForWrite() { return 0; }
+	virtual void flush() {}
+
+	size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+	size_t println(const char* text) { size_t n = print(text); return n + print("\r\n"); }
+	size_t println(const String& text) { return println(text.c_str()); }
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+#endif
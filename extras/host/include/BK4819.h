@@ -0,0 +1,49 @@
+/*
+ * Project Name: Radio Firmware
+ * File: BK4819.h (host shim)
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Stand-in for the radio firmware's BK4819 definitions used by IcomSim.
+ * Only the VFO fields reached over CI-V are modelled.
+ */
+
+#ifndef ICOMSIM_HOST_BK4819_H
+#define ICOMSIM_HOST_BK4819_H
+
+#include <stdint.h>
+
+typedef enum
+{
+	MODE_AM = 0x00,
+	MODE_FM = 0x01,
+	MODE_SSB = 0x02
+} BK4819_Mode_t;
+
+typedef enum
+{
+	BK4819_FILTER_BW_WIDE = 0,
+	BK4819_FILTER_BW_NARROW,
+	BK4819_FILTER_BW_NARROWER
+} BK4819_Filter_Bandwidth_t;
+
+typedef struct
+{
+	uint32_t Frequency;
+	uint32_t Step;
+	BK4819_Mode_t Mode;
+	BK4819_Filter_Bandwidth_t bw;
+	uint8_t Sql;
+	uint8_t Gain;
+	uint8_t txp;
+	struct
+	{
+		uint16_t Flags;
+	} Flag;
+} VfoData_t;
+#endif
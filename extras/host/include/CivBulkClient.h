@@ -0,0 +1,104 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivBulkClient.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * PC side of the IcomSim bulk transfer (7F 05/06/07, see IcomSimBulk.h): builds the
+ * request frames and decodes the replies.
+ *
+ * NOTES:
+ * - The sending loop belongs to the application: stream `window` blocks from next,
+ *   then wait for the 7F 06 reply. A reply arriving earlier is an error report: restart
+ *   from its next. No reply within the timeout: send the 7F 05 request again, its
+ *   reply says where to resume. extras/host/examples/bulk_upload.cpp is a complete loop.
+ * - On a single-wire CI-V bus an early error report collides with the block being
+ *   sent; the controller then sees no reply and resumes through 7F 05 as above.
+ */
+
+#ifndef ICOMSIM_HOST_CIVBULKCLIENT_H
+#define ICOMSIM_HOST_CIVBULKCLIENT_H
+
+#include "IcomSimBulk.h"
+#include "CivMetricsDecoder.h"
+
+#include <algorithm>
+#include <vector>
+
+struct CivBulkReply
+{
+	uint8_t subcommand;                 // CIV_VENDOR_BULK_*
+	uint8_t status;                     // CIV_BULK_*
+	uint16_t next;                      // Prossima unita' attesa dalla radio
+	uint8_t window;                     // Solo 7F 05
+	uint8_t unitsPerBlock;              // Solo 7F 05
+};
+
+inline std::vector<uint8_t> civBulkFrame(uint8_t radio, uint8_t controller, uint8_t subcommand, const uint8_t* raw, uint16_t length)
+{
+	std::vector<uint8_t> frame = { 0xFE, 0xFE, radio, controller, COMMAND_VENDOR, subcommand };
+	frame.resize(6 + CIV_7BIT_PACKED_SIZE(length));
+	civPack7(raw, length, &frame[6]);
+	frame.push_back(0xFD);
+	return frame;
+}
+
+inline std::vector<uint8_t> civBulkBeginFrame(uint8_t radio, uint8_t controller, uint8_t target, uint16_t first, uint16_t count, uint8_t window)
+{
+	const uint8_t raw[6] = { target, (uint8_t)first, (uint8_t)(first >> 8), (uint8_t)count, (uint8_t)(count >> 8), window };
+	return civBulkFrame(radio, controller, CIV_VENDOR_BULK_BEGIN, raw, sizeof(raw));
+}
+
+// Blocco di unita' a partire da offset (relativo a first); length = unita' * dimensione dell'unita'
+inline std::vector<uint8_t> civBulkDataFrame(uint8_t radio, uint8_t controller, uint16_t offset, const uint8_t* units, uint16_t length)
+{
+	std::vector<uint8_t> raw(2 + length + 2);
+	raw[0] = (uint8_t)offset;
+	raw[1] = (uint8_t)(offset >> 8);
+	std::copy(units, units + length, raw.begin() + 2);
+
+	uint16_t crc = civCrc16(raw.data(), (uint16_t)(2 + length));
+	raw[2 + length] = (uint8_t)crc;
+	raw[3 + length] = (uint8_t)(crc >> 8);
+	return civBulkFrame(radio, controller, CIV_VENDOR_BULK_DATA, raw.data(), (uint16_t)raw.size());
+}
+
+inline std::vector<uint8_t> civBulkEndFrame(uint8_t radio, uint8_t controller, bool abort = false)
+{
+	std::vector<uint8_t> frame = { 0xFE, 0xFE, radio, controller, COMMAND_VENDOR, CIV_VENDOR_BULK_END };
+	if (abort) frame.push_back(0x01);
+	frame.push_back(0xFD);
+	return frame;
+}
+
+inline bool civBulkDecodeReply(const uint8_t* frame, size_t length, CivBulkReply& reply)
+{
+	if (length < 8) return false;
+
+	uint8_t raw[8];
+	uint8_t subcommand = frame[5];
+	if (subcommand < CIV_VENDOR_BULK_BEGIN || subcommand > CIV_VENDOR_BULK_END) return false;
+	if (length - 7 > CIV_7BIT_PACKED_SIZE(sizeof(raw))) return false;
+
+	uint16_t n = civVendorPayload(frame, length, subcommand, raw);
+	if (n != (subcommand == CIV_VENDOR_BULK_BEGIN ? 5 : 3)) return false;
+
+	reply.subcommand = subcommand;
+	reply.status = raw[0];
+	reply.next = (uint16_t)(raw[1] | (raw[2] << 8));
+	reply.window = n == 5 ? raw[3] : 0;
+	reply.unitsPerBlock = n == 5 ? raw[4] : 0;
+	return true;
+}
+
+inline const char* civBulkStatusName(uint8_t status)
+{
+	static const char* const names[] = { "ok", "crc error", "out of sequence", "write failed", "no session", "incomplete", "busy" };
+	return status < sizeof(names) / sizeof(names[0]) ? names[status] : "?";
+}
+#endif
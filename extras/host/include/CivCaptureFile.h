@@ -0,0 +1,176 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivCaptureFile.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Capture files (CivCapture.h) on the host: a writer that plugs into
+ * IcomSim::setCaptureHook() and a reader that memory-maps the file.
+ *
+ * NOTES:
+ * - The writer takes timestamps from micros(), so with a manual HostClock the capture
+ *   carries the simulated times.
+ * - The reader never copies: records point into the mapping, which stays valid until
+ *   close() or the destructor.
+ */
+
+#ifndef ICOMSIM_HOST_CIVCAPTUREFILE_H
+#define ICOMSIM_HOST_CIVCAPTUREFILE_H
+
+#include "IcomSim.h"
+#include "CivSnapshotDecoder.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class CivCaptureWriter
+{
+public:
+	CivCaptureWriter() : file(nullptr), last(0), records(0) {}
+	~CivCaptureWriter() { close(); }
+
+	bool open(const char* path, uint32_t baud)
+	{
+		close();
+		file = fopen(path, "wb");
+		if (file == nullptr) return false;
+
+		uint8_t header[CIV_CAPTURE_HEADER_SIZE] = { 'C', 'I', 'V', 'C', CIV_CAPTURE_VERSION };
+		for (int i = 0; i < 4; i++) header[8 + i] = (uint8_t)(baud >> (8 * i));
+		fwrite(header, 1, sizeof(header), file);
+		last = micros();
+		records = 0;
+		return true;
+	}
+
+	void close()
+	{
+		if (file != nullptr) fclose(file);
+		file = nullptr;
+	}
+
+	// Stato iniziale dei VFO, da scrivere prima del traffico
+	void state(uint8_t vfo, const VfoData_t& data)
+	{
+		uint8_t raw[CIV_SNAPSHOT_RECORD_MAX];
+		record(CIV_CAPTURE_STATE, raw, civSnapshotEncodeRecord(data, vfo, raw));
+	}
+
+	void record(uint8_t type, const uint8_t* data, uint16_t length)
+	{
+		if (file == nullptr || length > 0xFF) return;
+
+		uint32_t now = micros();
+		uint8_t header[7];
+		uint8_t n = civCaptureRecordHeader(type, (uint8_t)length, now - last, header);
+		last = now;
+
+		fwrite(header, 1, n, file);
+		fwrite(data, 1, length, file);
+		records++;
+	}
+
+	uint32_t getRecords() const { return records; }
+
+	// Da passare a IcomSim::setCaptureHook() con il writer come contesto
+	static void hook(void* ctx, uint8_t type, const uint8_t* data, uint16_t length)
+	{
+		static_cast<CivCaptureWriter*>(ctx)->record(type, data, length);
+	}
+
+private:
+	FILE* file;
+	uint32_t last;
+	uint32_t records;
+};
+
+struct CivCaptureRecord
+{
+	uint8_t type;                       // CIV_CAPTURE_*
+	uint8_t length;
+	uint64_t time;                      // us dall'inizio della cattura
+	const uint8_t* data;                // Nella mappatura del file
+};
+
+class CivCaptureMap
+{
+public:
+	CivCaptureMap() : base(nullptr), size(0), offset(0), time(0) {}
+	~CivCaptureMap() { close(); }
+
+	bool open(const char* path)
+	{
+		close();
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size >= CIV_CAPTURE_HEADER_SIZE)
+		{
+			void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED)
+			{
+				base = static_cast<const uint8_t*>(p);
+				size = (size_t)st.st_size;
+				madvise(p, size, MADV_SEQUENTIAL);
+			}
+		}
+		::close(fd);
+
+		if (base == nullptr || memcmp(base, "CIVC", 4) != 0 || base[4] != CIV_CAPTURE_VERSION)
+		{
+			close();
+			return false;
+		}
+		rewind();
+		return true;
+	}
+
+	void close()
+	{
+		if (base != nullptr) munmap(const_cast<uint8_t*>(base), size);
+		base = nullptr;
+		size = 0;
+	}
+
+	uint32_t getBaud() const { return base[8] | (base[9] << 8) | (base[10] << 16) | ((uint32_t)base[11] << 24); }
+	size_t getSize() const { return size; }
+
+	void rewind()
+	{
+		offset = CIV_CAPTURE_HEADER_SIZE;
+		time = 0;
+	}
+
+	// Record successivo; false a fine file o su un record troncato
+	bool next(CivCaptureRecord& r)
+	{
+		uint32_t delta;
+		uint8_t n = civCaptureParseHeader(base + offset, (uint32_t)(size - offset), r.type, r.length, delta);
+		if (n == 0 || offset + n + r.length > size) return false;
+
+		time += delta;
+		r.time = time;
+		r.data = base + offset + n;
+		offset += n + r.length;
+		return true;
+	}
+
+	bool atEnd() const { return offset >= size; }
+
+private:
+	const uint8_t* base;
+	size_t size;
+	size_t offset;
+	uint64_t time;
+};
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivMetricsDecoder.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * PC side of the IcomSim counters: decodes the replies to the metrics read (7F 02)
+ * and handler hits read (7F 03) vendor commands.
+ *
+ * NOTES:
+ * - Counters are 16 bit and wrap: a monitor polling periodically should work on the
+ *   difference between two reads, modulo 65536. High-water marks and the maximum
+ *   frame time are not counters and are reported as read.
+ */
+
+#ifndef ICOMSIM_HOST_CIVMETRICSDECODER_H
+#define ICOMSIM_HOST_CIVMETRICSDECODER_H
+
+#include "IcomSim.h"
+
+#include <vector>
+
+struct CivMetricsBlock
+{
+	uint8_t total;                      // Contatori (7F 02) o slot (7F 03) presenti sulla radio
+	uint8_t index;                      // Primo elemento contenuto nella risposta
+	std::vector<uint16_t> values;       // 7F 02
+};
+
+struct CivHandlerHits
+{
+	uint8_t command;
+	uint16_t subcommand;                // CIV_SUBCMD_ANY se il gestore riceve tutto il comando
+	uint16_t hits;
+};
+
+struct CivHitsBlock
+{
+	uint8_t total;
+	uint8_t index;
+	std::vector<CivHandlerHits> slots;  // 7F 03
+};
+
+// Intestazione comune: FE FE .. 7F sub <payload a 7 bit> FD
+inline uint16_t civVendorPayload(const uint8_t* frame, size_t length, uint8_t subcommand, uint8_t* raw)
+{
+	if (length < 8 || frame[0] != 0xFE || frame[1] != 0xFE || frame[length - 1] != 0xFD) return 0;
+	if (frame[4] != COMMAND_VENDOR || frame[5] != subcommand) return 0;
+	return civUnpack7(&frame[6], (uint16_t)(length - 7), raw);
+}
+
+inline bool civMetricsDecodeFrame(const uint8_t* frame, size_t length, CivMetricsBlock& block)
+{
+	uint8_t raw[256];
+	uint16_t n = civVendorPayload(frame, length, CIV_VENDOR_METRICS_READ, raw);
+	if (n < 3 || n != 3 + raw[2] * 2) return false;
+
+	block.total = raw[0];
+	block.index = raw[1];
+	block.values.clear();
+	for (uint8_t i = 0; i < raw[2]; i++) block.values.push_back((uint16_t)(raw[3 + i * 2] | (raw[4 + i * 2] << 8)));
+	return true;
+}
+
+inline bool civHitsDecodeFrame(const uint8_t* frame, size_t length, CivHitsBlock& block)
+{
+	uint8_t raw[256];
+	uint16_t n = civVendorPayload(frame, length, CIV_VENDOR_HITS_READ, raw);
+	if (n < 3 || n != 3 + raw[2] * 5) return false;
+
+	block.total = raw[0];
+	block.index = raw[1];
+	block.slots.clear();
+	for (uint8_t i = 0; i < raw[2]; i++)
+	{
+		const uint8_t* p = &raw[3 + i * 5];
+		CivHandlerHits h;
+		h.command = p[0];
+		h.subcommand = (uint16_t)(p[1] | (p[2] << 8));
+		h.hits = (uint16_t)(p[3] | (p[4] << 8));
+		block.slots.push_back(h);
+	}
+	return true;
+}
+
+inline const char* civMetricName(uint8_t id)
+{
+	static const char* const names[ICOMSIM_METRIC_COUNT] =
+	{
+		"rx frames", "rx too short", "rx overflow", "rx collision", "rx ring lost",
+		"ng unknown", "ng rejected", "tx frames", "tx dropped", "tx stalls",
+		"tx high water", "rx high water", "max frame us"
+	};
+	return id < ICOMSIM_METRIC_COUNT ? names[id] : "?";
+}
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivSnapshotDecoder.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * PC side of the IcomSim snapshot (7F 09): decodes the reply frames into VFO
+ * records, following the versioned layout described in IcomSim.h.
+ *
+ * NOTES:
+ * - A reply may be split over several frames (one record per frame with 32-byte
+ *   frames): decode each frame and merge the records.
+ * - Replies with a version other than CIV_SNAPSHOT_VERSION are rejected: fields are
+ *   not self-describing, so a newer layout cannot be read by an older decoder.
+ * - In a "changed only" snapshot a record carries only the fields whose bit is set in
+ *   mask; apply() copies exactly those into a cached VfoData_t.
+ */
+
+#ifndef ICOMSIM_HOST_CIVSNAPSHOTDECODER_H
+#define ICOMSIM_HOST_CIVSNAPSHOTDECODER_H
+
+#include "IcomSim.h"
+#include "CivMetricsDecoder.h"
+
+#include <vector>
+
+struct CivSnapshotRecord
+{
+	uint8_t vfo;                        // ICOMSIM_VFO_A / ICOMSIM_VFO_B
+	uint16_t mask;                      // FLAG_* dei campi presenti
+	VfoData_t data;                     // Solo i campi in mask sono significativi
+
+	void apply(VfoData_t& cached) const
+	{
+		if (mask & FLAG_FREQUENCY_CHANGED) cached.Frequency = data.Frequency;
+		if (mask & FLAG_MODE_CHANGED)      cached.Mode = data.Mode;
+		if (mask & FLAG_SQL_CHANGED)       cached.Sql = data.Sql;
+		if (mask & FLAG_GAIN_CHANGED)      cached.Gain = data.Gain;
+		if (mask & FLAG_BW_CHANGED)        cached.bw = data.bw;
+		if (mask & FLAG_TXP_CHANGED)       cached.txp = data.txp;
+		if (mask & FLAG_STEP_CHANGED)      cached.Step = data.Step;
+	}
+};
+
+struct CivSnapshot
+{
+	uint8_t version;
+	uint8_t state;                      // CIV_SNAPSHOT_STATE_*
+	uint8_t agc;                        // AGC_*, 0xFF se la radio non lo gestisce
+	std::vector<CivSnapshotRecord> records;
+};
+
+inline std::vector<uint8_t> civSnapshotRequest(uint8_t radio, uint8_t controller, uint8_t vfo = CIV_SNAPSHOT_BOTH, uint8_t options = 0)
+{
+	return { 0xFE, 0xFE, radio, controller, COMMAND_VENDOR, CIV_VENDOR_SNAPSHOT, vfo, options, 0xFD };
+}
+
+// Record che inizia in raw[p] (n byte validi); p avanza oltre il record. false se troncato o con campi sconosciuti
+inline bool civSnapshotDecodeRecord(const uint8_t* raw, uint16_t n, uint16_t& p, CivSnapshotRecord& r)
+{
+	if (p + 3 > n) return false;
+
+	r = CivSnapshotRecord();
+	r.vfo = raw[p];
+	r.mask = (uint16_t)(raw[p + 1] | (raw[p + 2] << 8));
+	p += 3;
+	if (r.mask & ~CIV_SNAPSHOT_FIELDS) return false;
+
+	uint16_t size = 0;
+	for (uint16_t bit = FLAG_FREQUENCY_CHANGED; bit <= FLAG_STEP_CHANGED; bit <<= 1)
+	{
+		if (r.mask & bit) size += (bit == FLAG_FREQUENCY_CHANGED || bit == FLAG_STEP_CHANGED) ? 4 : 1;
+	}
+	if (p + size > n) return false;
+
+	auto get32 = [&](uint32_t& value)
+	{
+		value = (uint32_t)raw[p] | ((uint32_t)raw[p + 1] << 8) | ((uint32_t)raw[p + 2] << 16) | ((uint32_t)raw[p + 3] << 24);
+		p += 4;
+	};
+
+	if (r.mask & FLAG_FREQUENCY_CHANGED) get32(r.data.Frequency);
+	if (r.mask & FLAG_MODE_CHANGED)      r.data.Mode = static_cast<BK4819_Mode_t>(raw[p++]);
+	if (r.mask & FLAG_SQL_CHANGED)       r.data.Sql = raw[p++];
+	if (r.mask & FLAG_GAIN_CHANGED)      r.data.Gain = raw[p++];
+	if (r.mask & FLAG_BW_CHANGED)        r.data.bw = static_cast<BK4819_Filter_Bandwidth_t>(raw[p++]);
+	if (r.mask & FLAG_TXP_CHANGED)       r.data.txp = raw[p++];
+	if (r.mask & FLAG_STEP_CHANGED)      get32(r.data.Step);
+	return true;
+}
+
+// Record completo di un VFO nello stesso formato (es. per i record CIV_CAPTURE_STATE); restituisce i byte scritti
+inline uint16_t civSnapshotEncodeRecord(const VfoData_t& v, uint8_t vfo, uint8_t* out)
+{
+	uint16_t n = 0;
+	auto put32 = [&](uint32_t value)
+	{
+		for (int i = 0; i < 4; i++) out[n++] = (uint8_t)(value >> (8 * i));
+	};
+
+	out[n++] = vfo;
+	out[n++] = (uint8_t)CIV_SNAPSHOT_FIELDS;
+	out[n++] = (uint8_t)(CIV_SNAPSHOT_FIELDS >> 8);
+	put32(v.Frequency);
+	out[n++] = (uint8_t)v.Mode;
+	out[n++] = v.Sql;
+	out[n++] = v.Gain;
+	out[n++] = (uint8_t)v.bw;
+	out[n++] = v.txp;
+	put32(v.Step);
+	return n;
+}
+
+// Aggiunge a snapshot i record del frame; l'intestazione e' quella dell'ultimo frame decodificato
+inline bool civSnapshotDecodeFrame(const uint8_t* frame, size_t length, CivSnapshot& snapshot)
+{
+	uint8_t raw[256];
+	uint16_t n = civVendorPayload(frame, length, CIV_VENDOR_SNAPSHOT, raw);
+	if (n < CIV_SNAPSHOT_HEADER || raw[0] != CIV_SNAPSHOT_VERSION) return false;
+
+	snapshot.version = raw[0];
+	snapshot.state = raw[1];
+	snapshot.agc = raw[2];
+
+	uint16_t p = CIV_SNAPSHOT_HEADER;
+	for (uint8_t i = 0; i < raw[3]; i++)
+	{
+		CivSnapshotRecord r;
+		if (!civSnapshotDecodeRecord(raw, n, p, r)) return false;
+		snapshot.records.push_back(r);
+	}
+	return p == n;
+}
+#endif
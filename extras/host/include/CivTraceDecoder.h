@@ -0,0 +1,113 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivTraceDecoder.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * PC side of the CI-V trace: decodes the replies to the trace read vendor command
+ * (7F 01) into CivTraceRecord_t and formats them as text.
+ *
+ * NOTES:
+ * - Shared by extras/host/tools/trace_decode and the host examples.
+ */
+
+#ifndef ICOMSIM_HOST_CIVTRACEDECODER_H
+#define ICOMSIM_HOST_CIVTRACEDECODER_H
+
+#include "IcomSim.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+struct CivTraceBlock
+{
+	uint16_t sequence;                  // Eventi registrati dalla radio al momento della lettura
+	uint16_t available;                 // Record presenti nel ring
+	std::vector<CivTraceRecord_t> records;
+};
+
+// frame: frame CI-V completo, da FE FE a FD. false se non e' una risposta 7F 01 valida.
+inline bool civTraceDecodeFrame(const uint8_t* frame, size_t length, CivTraceBlock& block)
+{
+	if (length < 8 || frame[0] != 0xFE || frame[1] != 0xFE || frame[length - 1] != 0xFD) return false;
+	if (frame[4] != COMMAND_VENDOR || frame[5] != CIV_VENDOR_TRACE_READ) return false;
+
+	uint8_t raw[256];
+	uint16_t n = civUnpack7(&frame[6], (uint16_t)(length - 7), raw);
+	if (n < 5 || n != 5 + raw[4] * CIV_TRACE_RECORD_SIZE) return false;
+
+	block.sequence = (uint16_t)(raw[0] | (raw[1] << 8));
+	block.available = (uint16_t)(raw[2] | (raw[3] << 8));
+	block.records.clear();
+
+	for (uint8_t i = 0; i < raw[4]; i++)
+	{
+		const uint8_t* p = &raw[5 + i * CIV_TRACE_RECORD_SIZE];
+		CivTraceRecord_t r;
+		r.time = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		r.event = p[4];
+		r.command = p[5];
+		r.length = p[6];
+		r.code = p[7];
+		block.records.push_back(r);
+	}
+	return true;
+}
+
+inline const char* civTraceEventName(uint8_t event)
+{
+	switch (event)
+	{
+		case CIV_TRACE_RX_FRAME: return "RX";
+		case CIV_TRACE_RX_ERROR: return "RX-ERR";
+		case CIV_TRACE_TX_FRAME: return "TX";
+		case CIV_TRACE_TX_DROP:  return "TX-DROP";
+		case CIV_TRACE_NG:       return "NG";
+		default:                 return "?";
+	}
+}
+
+inline const char* civTraceCodeName(uint8_t event, uint8_t code)
+{
+	if (event == CIV_TRACE_RX_ERROR)
+	{
+		switch (code)
+		{
+			case CIV_PARSE_TOO_SHORT: return "too short";
+			case CIV_PARSE_OVERFLOW:  return "overflow";
+			case CIV_PARSE_COLLISION: return "collision";
+			default:                  return "?";
+		}
+	}
+	if (event == CIV_TRACE_NG) return code == 0 ? "unknown command" : "rejected";
+	return "";
+}
+
+// Una riga per record; il tempo e' relativo al primo record (micros() a 32 bit, l'overflow si compensa da solo)
+inline std::string civTraceFormat(const CivTraceRecord_t& r, uint32_t origin)
+{
+	char line[96];
+
+	if (r.event == CIV_TRACE_RX_ERROR)
+	{
+		snprintf(line, sizeof(line), "%10lu us  %-7s  %s",
+		         (unsigned long)(uint32_t)(r.time - origin), civTraceEventName(r.event), civTraceCodeName(r.event, r.code));
+	}
+	else
+	{
+		snprintf(line, sizeof(line), "%10lu us  %-7s  cmd %02X  len %3u  %s",
+		         (unsigned long)(uint32_t)(r.time - origin), civTraceEventName(r.event), r.command, r.length,
+		         civTraceCodeName(r.event, r.code));
+	}
+
+	std::string text(line);
+	while (!text.empty() && text.back() == ' ') text.pop_back();
+	return text;
+}
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Project Name: Radio Firmware
+ * File: HostClock.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Control of the time base behind millis()/micros() in the host build.
+ * By default the shim follows the monotonic clock; simulations can switch to a
+ * manual clock and advance it explicitly to get reproducible timing.
+ */
+
+#ifndef ICOMSIM_HOST_CLOCK_H
+#define ICOMSIM_HOST_CLOCK_H
+
+#include <stdint.h>
+
+namespace HostClock
+{
+	void useManual(bool manual);
+	void advanceMicros(uint64_t us);
+	uint64_t nowMicros();
+}
+#endif
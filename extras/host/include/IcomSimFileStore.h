@@ -0,0 +1,52 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimFileStore.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * IcomSimMemoryStore on a file for the host build: same record layout as the EEPROM
+ * image, so a bank programmed on the PC can be inspected or written to a radio.
+ *
+ * NOTES:
+ * - open() creates the file filled with 0xFF (erased EEPROM) when it does not exist.
+ * - Writes are buffered by stdio; commit() flushes them to the file.
+ * - getWrites()/getCommits() count the calls that reached the file, to check the
+ *   write coalescing of IcomSimMemory.
+ */
+
+#ifndef ICOMSIM_HOST_FILESTORE_H
+#define ICOMSIM_HOST_FILESTORE_H
+
+#include "IcomSimMemory.h"
+
+#include <stdio.h>
+
+class IcomSimFileStore : public IcomSimMemoryStore
+{
+public:
+	explicit IcomSimFileStore(uint16_t channels) : file(nullptr), channels(channels), writes(0), commits(0) {}
+	~IcomSimFileStore() { close(); }
+
+	bool open(const char* path);
+	void close();
+
+	uint16_t capacity() const override { return channels; }
+	bool read(uint16_t slot, IcomSimMemoryRecord_t& record) override;
+	bool write(uint16_t slot, const IcomSimMemoryRecord_t& record) override;
+	bool commit() override;
+
+	uint32_t getWrites() const { return writes; }
+	uint32_t getCommits() const { return commits; }
+
+private:
+	FILE* file;
+	uint16_t channels;
+	uint32_t writes;
+	uint32_t commits;
+};
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimThreadExecutor.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * std::thread backend of IcomSimExecutor for the host build.
+ *
+ * NOTES:
+ * - Same contract as the FreeRTOS backend: events wake a condition variable, the
+ *   shared data is guarded by a mutex and changes go through a bounded queue.
+ * - Used to measure and test the event-driven mode on Linux.
+ */
+
+#ifndef ICOMSIM_HOST_THREADEXECUTOR_H
+#define ICOMSIM_HOST_THREADEXECUTOR_H
+
+#include "IcomSimExecutor.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class IcomSimThreadExecutor : public IcomSimExecutor
+{
+public:
+	explicit IcomSimThreadExecutor(IcomSim& sim, size_t queueDepth = ICOMSIM_CHANGE_QUEUE_SIZE);
+	~IcomSimThreadExecutor();
+
+	bool start() override;
+	void stop() override;
+	void notify(uint8_t events) override;
+
+	void lock() override { dataMutex.lock(); }
+	void unlock() override { dataMutex.unlock(); }
+
+	bool waitChange(IcomSimChange_t& change, uint32_t timeoutMs) override;
+
+protected:
+	bool postChange(const IcomSimChange_t& change) override;
+
+private:
+	void run();
+
+	std::thread thread;
+	std::mutex dataMutex;
+
+	std::mutex eventMutex;
+	std::condition_variable eventCv;
+	uint8_t events;
+
+	std::mutex changeMutex;
+	std::condition_variable changeCv;
+	std::deque<IcomSimChange_t> changes;
+	size_t queueDepth;
+};
+#endif
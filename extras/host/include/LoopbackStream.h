@@ -0,0 +1,96 @@
+/*
+ * Project Name: Radio Firmware
+ * File: LoopbackStream.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * In-memory Stream for the host build. The test side injects the bytes the radio
+ * will read and drains the bytes the radio wrote.
+ *
+ * NOTES:
+ * - Both directions are fixed-capacity rings allocated once in the constructor,
+ *   so driving the stream never touches the heap.
+ * - setTxLimit() models a UART FIFO: availableForWrite() never reports more than
+ *   the limit minus the bytes not yet drained.
+ */
+
+#ifndef ICOMSIM_HOST_LOOPBACKSTREAM_H
+#define ICOMSIM_HOST_LOOPBACKSTREAM_H
+
+#include "Arduino.h"
+#include <vector>
+
+class LoopbackStream : public Stream
+{
+public:
+	explicit LoopbackStream(size_t capacity = 4096)
+		: rx(capacity), tx(capacity), txLimit(capacity) {}
+
+	// Lato banco di prova
+	size_t inject(const uint8_t* data, size_t length) { return rx.put(data, length); }
+	size_t drain(uint8_t* data, size_t length) { return tx.get(data, length); }
+	size_t pending() const { return tx.used; }
+	void setTxLimit(size_t limit) { txLimit = limit < tx.data.size() ? limit : tx.data.size(); }
+
+	// Lato radio (Stream)
+	int available() override { return (int)rx.used; }
+	int read() override
+	{
+		uint8_t byte;
+		return rx.get(&byte, 1) ? byte : -1;
+	}
+	int peek() override { return rx.used ? rx.data[rx.tail] : -1; }
+
+	int availableForWrite() override { return tx.used >= txLimit ? 0 : (int)(txLimit - tx.used); }
+	size_t write(uint8_t byte) override { return write(&byte, 1); }
+	size_t write(const uint8_t* data, size_t length) override
+	{
+		size_t room = (size_t)availableForWrite();
+		return tx.put(data, length < room ? length : room);
+	}
+
+private:
+	struct Ring
+	{
+		explicit Ring(size_t capacity) : data(capacity), head(0), tail(0), used(0) {}
+
+		size_t put(const uint8_t* src, size_t length)
+		{
+			size_t n = 0;
+			while (n < length && used < data.size())
+			{
+				data[head] = src[n++];
+				head = (head + 1) % data.size();
+				used++;
+			}
+			return n;
+		}
+
+		size_t get(uint8_t* dst, size_t length)
+		{
+			size_t n = 0;
+			while (n < length && used > 0)
+			{
+				dst[n++] = data[tail];
+				tail = (tail + 1) % data.size();
+				used--;
+			}
+			return n;
+		}
+
+		std::vector<uint8_t> data;
+		size_t head;
+		size_t tail;
+		size_t used;
+	};
+
+	Ring rx;
+	Ring tx;
+	size_t txLimit;
+};
+#endif
@@ -0,0 +1,157 @@
+/*
+ * Project Name: Radio Firmware
+ * File: SimSerialLink.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Simulated serial line for the host build: each side has its own baud rate and the
+ * bytes are rebuilt the way a UART samples them, so mismatched rates give the same
+ * garbage, lost bytes and false start bits as a real cable.
+ *
+ * NOTES:
+ * - The radio side is a Stream (pass it to IcomSim); the controller side uses
+ *   controllerSend() / controllerReceive(). setRadioBaud() is what the line rate
+ *   hook of the radio calls.
+ * - A burst is 8N1 bytes back to back at the sender's rate. The receiver waits for a
+ *   low level, samples the middle of each bit at its own rate and delivers the byte
+ *   even on a framing error, as Arduino cores do.
+ * - controllerSend() and controllerReceive() advance HostClock by the line time of
+ *   the burst when the clock is manual, so timeouts in IcomSim see realistic delays.
+ * - setNoise() flips random bits (bit error rate), independent of the rates.
+ */
+
+#ifndef ICOMSIM_HOST_SIMSERIALLINK_H
+#define ICOMSIM_HOST_SIMSERIALLINK_H
+
+#include "Arduino.h"
+#include "HostClock.h"
+
+#include <deque>
+#include <random>
+#include <vector>
+
+class SimSerialLink : public Stream
+{
+public:
+	SimSerialLink(uint32_t radioBaud, uint32_t controllerBaud)
+		: radioRate(radioBaud), controllerRate(controllerBaud), noise(0), rng(1) {}
+
+	void setRadioBaud(uint32_t baud)
+	{
+		line(radioRate);                                    // Quanto la radio ha gia' scritto esce alla velocita' precedente
+		radioRate = baud;
+	}
+	void setControllerBaud(uint32_t baud) { controllerRate = baud; }
+	uint32_t getRadioBaud() const { return radioRate; }
+	uint32_t getControllerBaud() const { return controllerRate; }
+	void setNoise(double bitErrorRate, uint32_t seed = 1) { noise = bitErrorRate; rng.seed(seed); }
+
+	// Lato controller
+	void controllerSend(const uint8_t* data, size_t length)
+	{
+		std::vector<uint8_t> burst = transmit(data, length, controllerRate, radioRate);
+		rx.insert(rx.end(), burst.begin(), burst.end());
+		HostClock::advanceMicros(lineTime(length, controllerRate));
+	}
+
+	size_t controllerReceive(std::vector<uint8_t>& out)
+	{
+		line(radioRate);
+		size_t n = received.size();
+		out.insert(out.end(), received.begin(), received.end());
+		received.clear();
+		return n;
+	}
+
+	static uint64_t lineTime(size_t bytes, uint32_t baud) { return bytes * 10ULL * 1000000ULL / baud; }
+
+	// Lato radio (Stream)
+	int available() override { return (int)rx.size(); }
+	int read() override
+	{
+		if (rx.empty()) return -1;
+		uint8_t byte = rx.front();
+		rx.pop_front();
+		return byte;
+	}
+	int peek() override { return rx.empty() ? -1 : rx.front(); }
+	int availableForWrite() override { return 256; }
+	size_t write(uint8_t byte) override { tx.push_back(byte); return 1; }
+	size_t write(const uint8_t* data, size_t length) override
+	{
+		tx.insert(tx.end(), data, data + length);
+		return length;
+	}
+
+private:
+	uint32_t radioRate;
+	uint32_t controllerRate;
+	double noise;
+	std::mt19937 rng;
+	std::deque<uint8_t> rx;				// Byte ricostruiti dalla UART della radio
+	std::vector<uint8_t> tx;			// Byte scritti dalla radio, non ancora sulla linea
+	std::vector<uint8_t> received;		// Byte ricostruiti dalla UART del controller
+
+	void line(uint32_t baud)
+	{
+		std::vector<uint8_t> burst = transmit(tx.data(), tx.size(), baud, controllerRate);
+		HostClock::advanceMicros(lineTime(tx.size(), baud));
+		received.insert(received.end(), burst.begin(), burst.end());
+		tx.clear();
+	}
+
+	// Livello della linea al tempo t (in bit del trasmettitore): start 0, 8 bit LSB prima, stop 1, poi riposo 1
+	static int level(const std::vector<uint8_t>& bits, double t)
+	{
+		if (t < 0) return 1;
+		size_t cell = (size_t)t;
+		return cell < bits.size() ? bits[cell] : 1;
+	}
+
+	std::vector<uint8_t> transmit(const uint8_t* data, size_t length, uint32_t fromBaud, uint32_t toBaud)
+	{
+		std::vector<uint8_t> bits;
+		std::bernoulli_distribution flip(noise);
+		for (size_t i = 0; i < length; i++)
+		{
+			bits.push_back(0);
+			for (int b = 0; b < 8; b++) bits.push_back((data[i] >> b) & 1);
+			bits.push_back(1);
+		}
+		if (noise > 0)
+		{
+			for (auto& bit : bits) bit ^= flip(rng) ? 1 : 0;
+		}
+
+		// Campionamento del ricevitore, con il tempo misurato in bit del trasmettitore
+		const double ratio = (double)fromBaud / toBaud;
+		std::vector<uint8_t> out;
+		double t = 0;
+
+		while (t < bits.size())
+		{
+			while (t < bits.size() && level(bits, t) == 1) t = (double)((size_t)t + 1);
+			if (t >= bits.size()) break;
+
+			double start = t;
+			if (level(bits, start + ratio * 0.5) != 0)      // Falso bit di start
+			{
+				t = start + ratio * 0.5;
+				continue;
+			}
+
+			uint8_t byte = 0;
+			for (int b = 0; b < 8; b++) byte |= (uint8_t)(level(bits, start + ratio * (1.5 + b)) << b);
+			out.push_back(byte);                            // Consegnato anche con errore di stop, come i core Arduino
+
+			t = start + ratio * 9.5;                        // Dopo il centro dello stop il ricevitore cerca un nuovo start
+		}
+		return out;
+	}
+};
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Project Name: Radio Firmware
+ * File: SoftwareSerial.h (host shim)
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Debug serial stand-in for the host build: output goes to stderr when the
+ * ICOMSIM_HOST_DEBUG environment variable is set, and is discarded otherwise.
+ */
+
+#ifndef ICOMSIM_HOST_SOFTWARESERIAL_H
+#define ICOMSIM_HOST_SOFTWARESERIAL_H
+
+#include "Arduino.h"
+
+class SoftwareSerial : public Stream
+{
+public:
+	SoftwareSerial(uint8_t rxPin, uint8_t txPin) : enabled(false) { (void)rxPin; (void)txPin; }
+
+	void begin(long speed) { (void)speed; enabled = getenv("ICOMSIM_HOST_DEBUG") != nullptr; }
+
+	size_t write(uint8_t byte) override
+	{
+		if (enabled) fputc(byte, stderr);
+		return 1;
+	}
+	int availableForWrite() override { return 64; }
+	int available() override { return 0; }
+	int read() override { return -1; }
+	int peek() override { return -1; }
+
+private:
+	bool enabled;
+};
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Project Name: Radio Firmware
+ * File: Arduino.cpp (host shim)
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Time base of the host shim.
+ */
+
+#include "Arduino.h"
+#include "HostClock.h"
+
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	bool manualClock = false;
+	uint64_t manualMicros = 0;
+}
+
+void HostClock::useManual(bool manual)
+{
+	manualMicros = nowMicros();
+	manualClock = manual;
+}
+
+void HostClock::advanceMicros(uint64_t us)
+{
+	manualMicros += us;
+}
+
+uint64_t HostClock::nowMicros()
+{
+	if (manualClock) return manualMicros;
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+unsigned long micros()
+{
+	return (unsigned long)HostClock::nowMicros();
+}
+
+unsigned long millis()
+{
+	return (unsigned long)(HostClock::nowMicros() / 1000);
+}
+
+void delay(unsigned long ms)
+{
+	if (manualClock)
+	{
+		manualMicros += (uint64_t)ms * 1000;
+		return;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
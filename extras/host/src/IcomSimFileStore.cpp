@@ -0,0 +1,75 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimFileStore.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * IcomSimMemoryStore on a file for the host build.
+ */
+
+#include "IcomSimFileStore.h"
+
+#include <string.h>
+
+bool IcomSimFileStore::open(const char* path)
+{
+    close();
+
+    file = fopen(path, "r+b");
+    if (file == nullptr)
+    {
+        // File nuovo: immagine di una EEPROM cancellata
+        file = fopen(path, "w+b");
+        if (file == nullptr) return false;
+
+        IcomSimMemoryRecord_t erased;
+        memset(&erased, 0xFF, sizeof(erased));
+        for (uint16_t i = 0; i < channels; i++)
+        {
+            if (fwrite(&erased, sizeof(erased), 1, file) != 1) return false;
+        }
+        if (fflush(file) != 0) return false;
+    }
+    return true;
+}
+
+void IcomSimFileStore::close()
+{
+    if (file == nullptr) return;
+
+    fclose(file);
+    file = nullptr;
+}
+
+bool IcomSimFileStore::read(uint16_t slot, IcomSimMemoryRecord_t& record)
+{
+    if (file == nullptr || slot >= channels) return false;
+    if (fseek(file, (long)slot * ICOMSIM_MEMORY_RECORD_SIZE, SEEK_SET) != 0) return false;
+
+    // Oltre la fine di un file piu' corto: canale vuoto
+    if (fread(&record, sizeof(record), 1, file) != 1) memset(&record, 0xFF, sizeof(record));
+    return true;
+}
+
+bool IcomSimFileStore::write(uint16_t slot, const IcomSimMemoryRecord_t& record)
+{
+    if (file == nullptr || slot >= channels) return false;
+    if (fseek(file, (long)slot * ICOMSIM_MEMORY_RECORD_SIZE, SEEK_SET) != 0) return false;
+    if (fwrite(&record, sizeof(record), 1, file) != 1) return false;
+
+    writes++;
+    return true;
+}
+
+bool IcomSimFileStore::commit()
+{
+    if (file == nullptr) return false;
+
+    commits++;
+    return fflush(file) == 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimThreadExecutor.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * std::thread backend of IcomSimExecutor for the host build.
+ */
+
+#include "IcomSimThreadExecutor.h"
+
+#include <chrono>
+
+IcomSimThreadExecutor::IcomSimThreadExecutor(IcomSim& sim, size_t queueDepth)
+	: IcomSimExecutor(sim), events(0), queueDepth(queueDepth)
+{
+}
+
+IcomSimThreadExecutor::~IcomSimThreadExecutor()
+{
+	stop();
+}
+
+bool IcomSimThreadExecutor::start()
+{
+	if (thread.joinable()) return true;
+
+	events = 0;
+	thread = std::thread(&IcomSimThreadExecutor::run, this);
+	return true;
+}
+
+void IcomSimThreadExecutor::stop()
+{
+	if (!thread.joinable()) return;
+
+	notify(ICOMSIM_EVENT_STOP);
+	thread.join();
+}
+
+void IcomSimThreadExecutor::notify(uint8_t bits)
+{
+	{
+		std::lock_guard<std::mutex> guard(eventMutex);
+		events |= bits;
+	}
+	eventCv.notify_one();
+}
+
+bool IcomSimThreadExecutor::waitChange(IcomSimChange_t& change, uint32_t timeoutMs)
+{
+	std::unique_lock<std::mutex> guard(changeMutex);
+
+	if (timeoutMs == ICOMSIM_WAIT_FOREVER) changeCv.wait(guard, [this] { return !changes.empty(); });
+	else if (!changeCv.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this] { return !changes.empty(); })) return false;
+
+	change = changes.front();
+	changes.pop_front();
+	return true;
+}
+
+bool IcomSimThreadExecutor::postChange(const IcomSimChange_t& change)
+{
+	{
+		std::lock_guard<std::mutex> guard(changeMutex);
+		if (changes.size() >= queueDepth) return false;
+		changes.push_back(change);
+	}
+	changeCv.notify_one();
+	return true;
+}
+
+void IcomSimThreadExecutor::run()
+{
+	uint32_t wait = 0;
+
+	for (;;)
+	{
+		uint8_t pending;
+		{
+			std::unique_lock<std::mutex> guard(eventMutex);
+			auto woken = [this] { return events != 0; };
+
+			if (wait == ICOMSIM_WAIT_FOREVER) eventCv.wait(guard, woken);
+			else if (wait != 0) eventCv.wait_for(guard, std::chrono::milliseconds(wait), woken);
+
+			pending = events;
+			events = 0;
+		}
+
+		if (pending & ICOMSIM_EVENT_STOP) break;
+		wait = runOnce();
+	}
+}
@@ -0,0 +1,170 @@
+/*
+ * Project Name: Radio Firmware
+ * File: bcd_roundtrip.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Host test of the CivBcd kernels (ctest: bcd_roundtrip).
+ *
+ * NOTES:
+ * - Round-trip and nibble validation over every byte value at every position, for all
+ *   layouts; comparison with the original send_frequency()/SET FREQUENCY loops on the
+ *   legacy wire format; round-trip of all 2^32 32-bit values, split across the cores.
+ * - Exit code 1 on any mismatch.
+ */
+
+#include "CivBcd.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	std::atomic<int> failures(0);
+
+	void fail(const char* what, uint64_t value)
+	{
+		if (failures++ < 10) printf("MISMATCH %s: %llu\n", what, (unsigned long long)value);
+	}
+
+	uint64_t rng = 0x9E3779B97F4A7C15ULL;
+	uint64_t random64()
+	{
+		rng ^= rng << 13;
+		rng ^= rng >> 7;
+		rng ^= rng << 17;
+		return rng;
+	}
+
+	// Cicli originali di send_frequency() e COMMAND_SET_FREQUENCY
+	void legacyEncode(uint32_t frequency, uint8_t* message)
+	{
+		for (int i = 5; i >= 0; i--)
+		{
+			message[i] = (frequency % 10) | ((frequency / 10 % 10) << 4);
+			frequency /= 100;
+		}
+	}
+
+	uint32_t legacyDecode(const uint8_t* data)
+	{
+		uint32_t frequency = 0;
+		for (int i = 5; i >= 0; i--)
+		{
+			uint8_t inverted_byte = (data[i] << 4) | (data[i] >> 4);
+			uint8_t high_nibble = (inverted_byte >> 4) & 0x0F;
+			uint8_t low_nibble = inverted_byte & 0x0F;
+			frequency = (frequency * 100) + (high_nibble * 10) + low_nibble;
+		}
+		return frequency;
+	}
+
+	bool isDecimal(uint8_t b) { return (b >> 4) <= 9 && (b & 0x0F) <= 9; }
+
+	template <uint8_t WIDTH, uint8_t LAYOUT>
+	void checkLayout(const char* name)
+	{
+		uint8_t wire[WIDTH];
+
+		for (uint8_t position = 0; position < WIDTH; position++)
+		{
+			// Ogni byte possibile in ogni posizione: accettato solo se entrambi i nibble sono decimali
+			for (int b = 0; b < 256; b++)
+			{
+				memset(wire, 0, sizeof(wire));
+				wire[position] = (uint8_t)b;
+
+				uint64_t value;
+				bool ok = civBcdDecode<WIDTH, LAYOUT>(wire, value);
+				uint8_t logical = (LAYOUT & CIV_BCD_NIBBLE_SWAP) ? CivBcd::swapNibbles((uint8_t)b) : (uint8_t)b;
+				if (ok != isDecimal(logical)) fail(name, (uint64_t)b);
+				if (!ok) continue;
+
+				uint8_t again[WIDTH];
+				if (!civBcdEncode<WIDTH, LAYOUT>(value, again) || memcmp(wire, again, WIDTH) != 0) fail(name, value);
+			}
+		}
+
+		for (int i = 0; i < 2000000; i++)
+		{
+			uint64_t value = random64() % CivBcd::Limit<WIDTH>::value;
+			uint64_t back = 0;
+			if (!civBcdEncode<WIDTH, LAYOUT>(value, wire) || !civBcdDecode<WIDTH, LAYOUT>(wire, back) || back != value) fail(name, value);
+
+			uint32_t narrow;
+			bool fits = value <= 0xFFFFFFFFULL;
+			if (civBcdDecode<WIDTH, LAYOUT>(wire, narrow) != fits || (fits && narrow != value)) fail(name, value);
+		}
+
+		if (civBcdEncode<WIDTH, LAYOUT>(CivBcd::Limit<WIDTH>::value, wire)) fail(name, CivBcd::Limit<WIDTH>::value);
+	}
+
+	void checkLegacy()
+	{
+		for (int i = 0; i < 2000000; i++)
+		{
+			uint32_t value = (uint32_t)random64();
+			uint8_t expected[6], actual[6];
+
+			legacyEncode(value, expected);
+			civBcdEncode<6, CIV_BCD_MSB_FIRST>(value, actual);
+			if (memcmp(expected, actual, 6) != 0) fail("legacy encode", value);
+
+			// Formato di ricezione storico: coppie LSB prima, decine nel nibble basso
+			uint8_t wire[6];
+			civBcdEncode<6, CIV_BCD_LSB_FIRST | CIV_BCD_NIBBLE_SWAP>(value, wire);
+			uint32_t decoded = 0;
+			if (!civBcdDecode<6, CIV_BCD_LSB_FIRST | CIV_BCD_NIBBLE_SWAP>(wire, decoded) || decoded != legacyDecode(wire)) fail("legacy decode", value);
+		}
+	}
+
+	void checkRange(uint64_t first, uint64_t last)
+	{
+		uint8_t wire[5];
+		for (uint64_t value = first; value < last; value++)
+		{
+			uint32_t back;
+			civBcdEncode<5, CIV_BCD_LSB_FIRST>((uint32_t)value, wire);
+			if (!civBcdDecode<5, CIV_BCD_LSB_FIRST>(wire, back) || back != value) fail("exhaustive", value);
+		}
+	}
+
+	void checkExhaustive()
+	{
+		unsigned workers = std::thread::hardware_concurrency();
+		if (workers == 0) workers = 1;
+
+		const uint64_t total = 0x100000000ULL;
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < workers; i++) threads.emplace_back(checkRange, total * i / workers, total * (i + 1) / workers);
+		for (std::thread& t : threads) t.join();
+	}
+}
+
+int main()
+{
+	checkLayout<5, CIV_BCD_LSB_FIRST>("5 lsb");
+	checkLayout<6, CIV_BCD_LSB_FIRST>("6 lsb");
+	checkLayout<5, CIV_BCD_MSB_FIRST>("5 msb");
+	checkLayout<6, CIV_BCD_MSB_FIRST>("6 msb");
+	checkLayout<5, CIV_BCD_LSB_FIRST | CIV_BCD_NIBBLE_SWAP>("5 lsb swap");
+	checkLayout<6, CIV_BCD_LSB_FIRST | CIV_BCD_NIBBLE_SWAP>("6 lsb swap");
+	checkLegacy();
+	checkExhaustive();
+
+	if (failures)
+	{
+		printf("round-trip: %d mismatches\n", failures.load());
+		return 1;
+	}
+	printf("round-trip: OK\n");
+	return 0;
+}
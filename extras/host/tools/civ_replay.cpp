@@ -0,0 +1,255 @@
+/*
+ * Project Name: Radio Firmware
+ * File: civ_replay.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Replays a CI-V capture (CivCapture.h) against IcomSim and diffs the frames it
+ * transmits with the recorded ones.
+ *
+ *   icomsim_civ_replay [-t] [-n loops] [-v] file
+ *
+ * NOTES:
+ * - The capture is memory-mapped and read in place.
+ * - IcomSim runs on a manual HostClock advanced by the recorded intervals, so timeouts
+ *   and periodic frames behave as in the recording. By default the replay runs as fast
+ *   as possible and reports frames/s (a throughput benchmark on real traffic); -t also
+ *   waits the recorded intervals in wall time.
+ * - Received frames are fed to the radio; every recorded TX frame must match the next
+ *   frame the radio produced. Unsolicited frames (transceive 00/01, RSSI 19 that does
+ *   not follow a 19 request) depend on the firmware, not on the link: when the replay
+ *   does not produce them they are counted as skipped, not as differences.
+ * - RX_ERROR records only say that the parser rejected something: the discarded bytes
+ *   are not in the capture, so they are counted and not replayed.
+ * - -n repeats the replay with a fresh IcomSim each time; -v prints every difference
+ *   (default: the first 10). Exit code 1 if any frame differs.
+ */
+
+#include "IcomSim.h"
+#include "LoopbackStream.h"
+#include "HostClock.h"
+#include "CivCaptureFile.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace
+{
+	struct Stats
+	{
+		uint32_t rx = 0, tx = 0, errors = 0, states = 0;
+		uint32_t matched = 0, differ = 0, missing = 0, extra = 0, skipped = 0;
+	};
+
+	std::string hex(const uint8_t* data, size_t length)
+	{
+		std::string out;
+		char byte[4];
+		for (size_t i = 0; i < length; i++)
+		{
+			snprintf(byte, sizeof(byte), i ? " %02X" : "%02X", data[i]);
+			out += byte;
+		}
+		return out;
+	}
+
+	class Replay
+	{
+	public:
+		Replay(bool timed, bool verbose)
+			: sim(link), vfo(), head(0), tail(0), timed(timed), verbose(verbose), lastRequest(0xFF), reported(0)
+		{
+			sim.Initialize(&vfo[0], &vfo[1]);
+		}
+
+		void run(CivCaptureMap& capture, Stats& stats)
+		{
+			auto wallStart = std::chrono::steady_clock::now();
+			uint64_t previous = 0;
+			CivCaptureRecord r;
+
+			for (uint32_t index = 0; capture.next(r); index++)
+			{
+				HostClock::advanceMicros(r.time - previous);
+				previous = r.time;
+				if (timed) std::this_thread::sleep_until(wallStart + std::chrono::microseconds(r.time));
+
+				pump();                                     // Frame periodici dovuti al tempo trascorso
+
+				switch (r.type)
+				{
+					case CIV_CAPTURE_STATE:
+					{
+						CivSnapshotRecord state;
+						uint16_t p = 0;
+						if (civSnapshotDecodeRecord(r.data, r.length, p, state) && state.vfo <= ICOMSIM_VFO_B) state.apply(vfo[state.vfo]);
+						stats.states++;
+						break;
+					}
+
+					case CIV_CAPTURE_RX:
+						stats.rx++;
+						lastRequest = r.length > 4 ? r.data[4] : 0xFF;
+						link.inject(r.data, r.length);
+						pump();
+						break;
+
+					case CIV_CAPTURE_TX:
+						stats.tx++;
+						expect(index, r, stats);
+						break;
+
+					case CIV_CAPTURE_RX_ERROR:
+						stats.errors++;
+						break;
+				}
+			}
+
+			pump();
+			for (; tail < head; tail = frameEnd(tail))
+			{
+				size_t end = frameEnd(tail);
+				if (unsolicited(&produced[tail], end - tail)) continue;
+				stats.extra++;
+				report("extra", 0, nullptr, 0, &produced[tail], end - tail);
+			}
+		}
+
+	private:
+		LoopbackStream link;
+		IcomSim sim;
+		VfoData_t vfo[2];
+		uint8_t produced[4096];                             // Frame trasmessi dalla radio e non ancora confrontati
+		size_t head;
+		size_t tail;
+		bool timed;
+		bool verbose;
+		uint8_t lastRequest;                                // Comando dell'ultimo frame ricevuto
+		uint32_t reported;
+
+		bool unsolicited(const uint8_t* frame, size_t length) const
+		{
+			if (length < 6) return false;
+			uint8_t command = frame[4];
+			return command == COMMAND_TRANSCEIVE_FREQUENCY || command == COMMAND_TRANSCEIVE_MODE ||
+			       (command == COMMAND_GET_RSSI && lastRequest != COMMAND_GET_RSSI);
+		}
+
+		void pump()
+		{
+			sim.process();
+			if (tail == head) tail = head = 0;
+			else if (head > sizeof(produced) / 2)
+			{
+				memmove(produced, &produced[tail], head - tail);
+				head -= tail;
+				tail = 0;
+			}
+			head += link.drain(&produced[head], sizeof(produced) - head);
+		}
+
+		size_t frameEnd(size_t from) const
+		{
+			while (from < head && produced[from] != 0xFD) from++;
+			return from < head ? from + 1 : head;
+		}
+
+		void expect(uint32_t index, const CivCaptureRecord& r, Stats& stats)
+		{
+			if (tail == head)
+			{
+				if (unsolicited(r.data, r.length)) stats.skipped++;
+				else
+				{
+					stats.missing++;
+					report("missing", index, r.data, r.length, nullptr, 0);
+				}
+				return;
+			}
+
+			size_t end = frameEnd(tail);
+			const uint8_t* got = &produced[tail];
+			size_t length = end - tail;
+
+			if (length == r.length && memcmp(got, r.data, length) == 0)
+			{
+				stats.matched++;
+				tail = end;
+			}
+			else if (unsolicited(r.data, r.length))
+			{
+				stats.skipped++;                            // Atteso ma non prodotto: il frame della radio resta per il prossimo TX
+			}
+			else
+			{
+				stats.differ++;
+				report("differs", index, r.data, r.length, got, length);
+				tail = end;
+			}
+		}
+
+		void report(const char* what, uint32_t index, const uint8_t* expected, size_t expectedLength, const uint8_t* got, size_t gotLength)
+		{
+			if (!verbose && reported >= 10) return;
+			reported++;
+			printf("record %6u %-7s expected [%s] got [%s]\n", index, what, hex(expected, expectedLength).c_str(), hex(got, gotLength).c_str());
+		}
+	};
+}
+
+int main(int argc, char** argv)
+{
+	bool timed = false;
+	bool verbose = false;
+	int loops = 1;
+	const char* path = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0) timed = true;
+		else if (strcmp(argv[i], "-v") == 0) verbose = true;
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) loops = atoi(argv[++i]);
+		else path = argv[i];
+	}
+	if (path == nullptr || loops < 1)
+	{
+		fprintf(stderr, "usage: icomsim_civ_replay [-t] [-n loops] [-v] file\n");
+		return 2;
+	}
+
+	CivCaptureMap capture;
+	if (!capture.open(path))
+	{
+		fprintf(stderr, "civ_replay: %s is not a CI-V capture (version %d)\n", path, CIV_CAPTURE_VERSION);
+		return 1;
+	}
+
+	HostClock::useManual(true);
+	Stats stats;
+	Stats repeated;
+	auto start = std::chrono::steady_clock::now();
+
+	for (int loop = 0; loop < loops; loop++)
+	{
+		capture.rewind();
+		Replay replay(timed, verbose && loop == 0);
+		replay.run(capture, loop == 0 ? stats : repeated);
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	uint64_t frames = (uint64_t)(stats.rx + stats.tx) * loops;
+
+	printf("%s: %zu bytes, %u rx, %u tx, %u rx errors, %u state records, line %u baud\n", path, capture.getSize(),
+	       stats.rx, stats.tx, stats.errors, stats.states, capture.getBaud());
+	printf("tx frames: %u match, %u differ, %u missing, %u extra, %u unsolicited skipped\n", stats.matched, stats.differ,
+	       stats.missing, stats.extra, stats.skipped);
+	printf("replay x%d: %.3f s, %.0f frames/s\n", loops, seconds, frames / seconds);
+
+	return stats.differ + stats.missing + stats.extra == 0 ? 0 : 1;
+}
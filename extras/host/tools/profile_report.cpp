@@ -0,0 +1,36 @@
+/*
+ * Project Name: Radio Firmware
+ * File: profile_report.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Prints the configuration an IcomSim build was compiled with and the RAM taken
+ * by one instance. Built once per profile by the size_report target.
+ *
+ * NOTES:
+ * - sizeof() values are for the host ABI: pointers are 8 bytes here and 2 on AVR,
+ *   so use extras/tools/size_report.sh for the exact target figures.
+ */
+
+#include "IcomSim.h"
+
+#include <stdio.h>
+
+int main()
+{
+	printf("profile %s\n", ICOMSIM_PROFILE == ICOMSIM_PROFILE_SMALL ? "SMALL" : "FULL");
+	printf("  debug %d  settings %d  meter %d  vfo_ab %d  transceive %d  rx_ring %d  change_api %d  trace %d  metrics %d  memory %d  bulk %d  line_rate %d  snapshot %d  capture %d  handler_index %d\n",
+	       ICOMSIM_DEBUG, ICOMSIM_FEATURE_SETTINGS, ICOMSIM_FEATURE_METER, ICOMSIM_FEATURE_VFO_AB,
+	       ICOMSIM_FEATURE_TRANSCEIVE, ICOMSIM_FEATURE_RX_RING, ICOMSIM_FEATURE_CHANGE_API, ICOMSIM_TRACE, ICOMSIM_METRICS,
+	       ICOMSIM_FEATURE_MEMORY, ICOMSIM_FEATURE_BULK, ICOMSIM_FEATURE_LINE_RATE, ICOMSIM_FEATURE_SNAPSHOT, ICOMSIM_FEATURE_CAPTURE,
+	       ICOMSIM_HANDLER_INDEX);
+	printf("  tx ring %d  rx ring %d  handlers %d  frame %d  trace %d\n",
+	       ICOMSIM_TX_RING_SIZE, ICOMSIM_RX_RING_SIZE, ICOMSIM_MAX_HANDLERS, CIV_MAX_FRAME_SIZE, ICOMSIM_TRACE_SIZE);
+	printf("  sizeof(IcomSim) %zu  sizeof(CivParser) %zu\n", sizeof(IcomSim), sizeof(CivParser));
+	return 0;
+}
@@ -0,0 +1,516 @@
+/*
+ * Project Name: Radio Firmware
+ * File: rig_emulator.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Many independent IcomSim radios in one process, for load-testing CAT and
+ * station-control software.
+ *
+ *   icomsim_rig_emulator [-n radios] [-m tcp|pty|self] [-p base-port] [-d depth]
+ *                        [-s seconds] [-r report-seconds] [-l list-file] [-v] [-h]
+ *
+ * NOTES:
+ * - Every radio has its own IcomSim, VFO pair and fixed I/O buffers, built once at
+ *   start; nothing is allocated per frame. One epoll loop serves every descriptor.
+ * - -m tcp (default): radio i listens on 127.0.0.1:(base-port + i); a new connection
+ *   replaces the previous one. -m pty: radio i is a pseudo-terminal; the slave paths are
+ *   written to the list file (-l) or to stdout, one per line, in radio order.
+ *   -m self: each radio is wired to a built-in controller through a socketpair that keeps
+ *   -d GET FREQUENCY requests in flight, to measure the emulator itself.
+ * - Hot per-radio data (descriptors, deadlines, counters) lives in parallel arrays;
+ *   the IcomSim objects sit in one contiguous block and are touched only when their
+ *   descriptor is ready or their process() deadline expires.
+ * - Every -r seconds: aggregate frames/s (received + transmitted) and the spread across
+ *   radios; at the end -v prints the rate of every radio. Ctrl-C stops the run.
+ * - Linked against icomsim_fleet (ICOMSIM_DEBUG=0): no shared debug serial, so the
+ *   radios share no mutable state.
+ */
+
+#include "IcomSim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace
+{
+	const uint16_t IO_SIZE = 512;
+	const uint16_t RX_QUANTUM = 32;                         // Byte consegnati per process(): le risposte stanno in txRing
+	const uint8_t MODE_TCP = 0, MODE_PTY = 1, MODE_SELF = 2;
+	const uint64_t NO_DEADLINE = UINT64_MAX;
+
+	// Tipo del descrittore nei dati di epoll: (tipo << 32) | radio
+	const uint64_t KIND_LISTEN = 0, KIND_RADIO = 1, KIND_DRIVER = 2;
+
+	volatile sig_atomic_t stopRequested = 0;
+
+	// Stream di una radio: buffer fissi riempiti e svuotati dal loop di eventi
+	class FdStream : public Stream
+	{
+	public:
+		FdStream() : rxHead(0), rxTail(0), txLength(0) {}
+
+		int available() override { return std::min<int>(rxTail - rxHead, RX_QUANTUM); }
+		int read() override { return rxHead < rxTail ? rx[rxHead++] : -1; }
+		int peek() override { return rxHead < rxTail ? rx[rxHead] : -1; }
+		int availableForWrite() override { return IO_SIZE - txLength; }
+		size_t write(uint8_t byte) override { return write(&byte, 1); }
+		size_t write(const uint8_t* data, size_t length) override
+		{
+			size_t n = std::min<size_t>(length, IO_SIZE - txLength);
+			memcpy(&tx[txLength], data, n);
+			txLength += (uint16_t)n;
+			return n;
+		}
+
+		bool hasInput() const { return rxHead < rxTail; }
+		uint16_t rxSpace()
+		{
+			if (rxHead == rxTail) rxHead = rxTail = 0;
+			return IO_SIZE - rxTail;
+		}
+
+		uint8_t rx[IO_SIZE];
+		uint16_t rxHead;
+		uint16_t rxTail;
+		uint8_t tx[IO_SIZE];
+		uint16_t txLength;
+	};
+
+	struct Radio
+	{
+		FdStream stream;
+		VfoData_t vfo[2];
+		IcomSim sim;
+
+		Radio() : vfo(), sim(stream) {}
+	};
+
+	uint64_t nowMs()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	bool setNonBlocking(int fd)
+	{
+		int flags = fcntl(fd, F_GETFL, 0);
+		return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+	}
+
+	class Fleet
+	{
+	public:
+		Fleet(uint32_t count, uint8_t mode, uint8_t depth)
+			: count(count), mode(mode), depth(depth), radios(new Radio[count]), listenFd(count, -1), fd(count, -1), peerFd(count, -1),
+			  deadline(count, NO_DEADLINE), rxFrames(count, 0), txFrames(count, 0), lastRx(count, 0), lastTx(count, 0),
+			  driverPending(count, 0), nextSweep(NO_DEADLINE)
+		{
+			epfd = epoll_create1(0);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				Radio& r = radios[i];
+				r.vfo[0].Frequency = 144000000 + 12500 * (i % 80000);
+				r.vfo[0].Step = 12500;
+				r.vfo[1].Frequency = 430000000;
+				r.vfo[1].Step = 25000;
+				r.sim.Initialize(&r.vfo[0], &r.vfo[1]);
+			}
+		}
+
+		~Fleet()
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (listenFd[i] >= 0) close(listenFd[i]);
+				if (fd[i] >= 0) close(fd[i]);
+				if (peerFd[i] >= 0) close(peerFd[i]);
+			}
+			close(epfd);
+		}
+
+		bool open(uint16_t basePort, FILE* list)
+		{
+			for (uint32_t i = 0; i < count; i++)
+			{
+				bool ok = mode == MODE_TCP ? openTcp(i, basePort) : mode == MODE_PTY ? openPty(i, list) : openSelf(i);
+				if (!ok)
+				{
+					fprintf(stderr, "rig_emulator: radio %u: %s\n", i, strerror(errno));
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void run(double seconds, double reportEvery, bool verbose)
+		{
+			std::vector<epoll_event> events(1024);
+			uint64_t start = nowMs();
+			uint64_t stop = seconds > 0 ? start + (uint64_t)(seconds * 1000) : NO_DEADLINE;
+			uint64_t nextReport = start + (uint64_t)(reportEvery * 1000);
+			uint64_t lastReport = start;
+
+			while (!stopRequested)
+			{
+				uint64_t now = nowMs();
+				if (now >= stop) break;
+
+				uint64_t wake = std::min(std::min(stop, nextReport), nextSweep);
+				int timeout = wake <= now ? 0 : (int)std::min<uint64_t>(wake - now, 1000);
+
+				int n = epoll_wait(epfd, events.data(), (int)events.size(), timeout);
+				if (n < 0 && errno != EINTR) break;
+
+				for (int e = 0; e < n; e++)
+				{
+					uint32_t i = (uint32_t)events[e].data.u64;
+					uint64_t kind = events[e].data.u64 >> 32;
+					if (kind == KIND_LISTEN) accept(i);
+					else if (kind == KIND_RADIO) serve(i, events[e].events);
+					else drive(i);
+				}
+
+				now = nowMs();
+				if (now >= nextSweep) sweep(now);
+				if (now >= nextReport)
+				{
+					report(now - lastReport, false);
+					lastReport = now;
+					nextReport = now + (uint64_t)(reportEvery * 1000);
+				}
+			}
+
+			uint64_t elapsed = nowMs() - start;
+			printf("total over %.1f s:\n", elapsed / 1000.0);
+			for (uint32_t i = 0; i < count; i++) lastRx[i] = lastTx[i] = 0;
+			report(elapsed, verbose);
+		}
+
+	private:
+		uint32_t count;
+		uint8_t mode;
+		uint8_t depth;
+		int epfd;
+		std::unique_ptr<Radio[]> radios;
+
+		// Dati caldi, uno per radio
+		std::vector<int> listenFd;
+		std::vector<int> fd;                                // Controller collegato (connessione, master pty, socketpair)
+		std::vector<int> peerFd;                            // pty: slave tenuto aperto; self: lato controller
+		std::vector<uint64_t> deadline;                     // Prossimo process() dovuto al tempo, ms
+		std::vector<uint64_t> rxFrames;
+		std::vector<uint64_t> txFrames;
+		std::vector<uint64_t> lastRx;                       // Contatori all'ultimo report
+		std::vector<uint64_t> lastTx;
+		std::vector<uint8_t> driverPending;                 // self: byte di risposta incompleta
+		uint64_t nextSweep;
+
+		void watch(int descriptor, uint64_t kind, uint32_t i, uint32_t events = EPOLLIN)
+		{
+			epoll_event ev = {};
+			ev.events = events;
+			ev.data.u64 = (kind << 32) | i;
+			epoll_ctl(epfd, EPOLL_CTL_ADD, descriptor, &ev);
+		}
+
+		bool openTcp(uint32_t i, uint16_t basePort)
+		{
+			int s = socket(AF_INET, SOCK_STREAM, 0);
+			int one = 1;
+			setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+			sockaddr_in addr = {};
+			addr.sin_family = AF_INET;
+			addr.sin_port = htons((uint16_t)(basePort + i));
+			addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (s < 0 || bind(s, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(s, 4) < 0 || !setNonBlocking(s))
+			{
+				if (s >= 0) close(s);
+				return false;
+			}
+			listenFd[i] = s;
+			watch(s, KIND_LISTEN, i);
+			return true;
+		}
+
+		bool openPty(uint32_t i, FILE* list)
+		{
+			int master = posix_openpt(O_RDWR | O_NOCTTY);
+			if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) return false;
+
+			// Lo slave resta aperto: la chiusura del controller non porta il master in EIO
+			const char* path = ptsname(master);
+			int slave = ::open(path, O_RDWR | O_NOCTTY);
+			if (slave < 0) return false;
+
+			termios tio;
+			tcgetattr(slave, &tio);
+			cfmakeraw(&tio);
+			tcsetattr(slave, TCSANOW, &tio);
+
+			setNonBlocking(master);
+			fd[i] = master;
+			peerFd[i] = slave;
+			watch(master, KIND_RADIO, i);
+			fprintf(list, "%s\n", path);
+			return true;
+		}
+
+		bool openSelf(uint32_t i)
+		{
+			int pair[2];
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) return false;
+			setNonBlocking(pair[0]);
+			setNonBlocking(pair[1]);
+			fd[i] = pair[0];
+			peerFd[i] = pair[1];
+			watch(pair[0], KIND_RADIO, i);
+			watch(pair[1], KIND_DRIVER, i);
+
+			for (uint8_t k = 0; k < depth; k++) request(i);
+			return true;
+		}
+
+		void accept(uint32_t i)
+		{
+			int c = ::accept(listenFd[i], nullptr, nullptr);
+			if (c < 0) return;
+
+			int one = 1;
+			setsockopt(c, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			setNonBlocking(c);
+			if (fd[i] >= 0) close(fd[i]);                   // L'ultimo controller collegato sostituisce il precedente
+			fd[i] = c;
+			radios[i].stream.rxHead = radios[i].stream.rxTail = radios[i].stream.txLength = 0;
+			watch(c, KIND_RADIO, i);
+		}
+
+		void serve(uint32_t i, uint32_t events)
+		{
+			FdStream& s = radios[i].stream;
+
+			if (events & EPOLLIN)
+			{
+				ssize_t n = ::read(fd[i], &s.rx[s.rxTail], s.rxSpace());
+				if (n > 0) s.rxTail += (uint16_t)n;
+				else if (n == 0 || (errno != EAGAIN && errno != EINTR && mode == MODE_TCP))
+				{
+					if (mode == MODE_TCP)
+					{
+						close(fd[i]);                       // Chiude anche la registrazione in epoll
+						fd[i] = -1;
+						return;
+					}
+				}
+			}
+
+			run(i);
+		}
+
+		// process() finche' l'ingresso e' consumato, poi l'uscita sul descrittore
+		void run(uint32_t i)
+		{
+			Radio& r = radios[i];
+			uint32_t wait;
+			do
+			{
+				wait = r.sim.process();
+				flush(i);
+			} while (r.stream.hasInput() && r.stream.txLength < IO_SIZE);
+
+			uint16_t rx = r.sim.getMetric(ICOMSIM_METRIC_RX_FRAMES);
+			uint16_t tx = r.sim.getMetric(ICOMSIM_METRIC_TX_FRAMES);
+			rxFrames[i] += (uint16_t)(rx - (uint16_t)rxFrames[i]);
+			txFrames[i] += (uint16_t)(tx - (uint16_t)txFrames[i]);
+
+			deadline[i] = wait == ICOMSIM_WAIT_FOREVER ? NO_DEADLINE : nowMs() + wait;
+			nextSweep = std::min(nextSweep, deadline[i]);
+		}
+
+		void flush(uint32_t i)
+		{
+			FdStream& s = radios[i].stream;
+			if (s.txLength == 0 || fd[i] < 0)
+			{
+				if (fd[i] < 0) s.txLength = 0;              // Nessun controller: come una UART senza cavo
+				return;
+			}
+
+			ssize_t n = ::write(fd[i], s.tx, s.txLength);
+			if (n <= 0) return;                             // Pieno: riprova alla prossima scadenza (process() restituisce 1 ms)
+			s.txLength -= (uint16_t)n;
+			memmove(s.tx, &s.tx[n], s.txLength);
+		}
+
+		void sweep(uint64_t now)
+		{
+			nextSweep = NO_DEADLINE;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				if (deadline[i] <= now) run(i);
+				else nextSweep = std::min(nextSweep, deadline[i]);
+			}
+		}
+
+		// Controller integrato (-m self): a ogni risposta completa una nuova richiesta
+		void request(uint32_t i)
+		{
+			static const uint8_t frame[] = { 0xFE, 0xFE, CIV_ADDRESS_RADIO, CIV_ADDRESS_COMPUTER, COMMAND_GET_FREQUENCY, 0xFD };
+			(void)::write(peerFd[i], frame, sizeof(frame));
+		}
+
+		void drive(uint32_t i)
+		{
+			uint8_t data[IO_SIZE];
+			ssize_t n = ::read(peerFd[i], data, sizeof(data));
+			for (ssize_t k = 0; k < n; k++)
+			{
+				if (data[k] == 0xFD) request(i);
+			}
+		}
+
+		void report(uint64_t elapsedMs, bool perRadio)
+		{
+			if (elapsedMs == 0) elapsedMs = 1;
+			std::vector<double> rates(count);
+			uint64_t total = 0;
+			uint32_t active = 0;
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint64_t frames = (rxFrames[i] - lastRx[i]) + (txFrames[i] - lastTx[i]);
+				lastRx[i] = rxFrames[i];
+				lastTx[i] = txFrames[i];
+				rates[i] = frames * 1000.0 / elapsedMs;
+				total += frames;
+				active += frames > 0 ? 1 : 0;
+				if (perRadio) printf("  radio %5u: %10.1f frames/s (%llu rx, %llu tx)\n", i, rates[i], (unsigned long long)rxFrames[i],
+				                     (unsigned long long)txFrames[i]);
+			}
+
+			std::vector<double> sorted(rates);
+			std::sort(sorted.begin(), sorted.end());
+			printf("%u radios, %u active: %.0f frames/s total, per radio min %.1f median %.1f max %.1f\n", count, active,
+			       total * 1000.0 / elapsedMs, sorted.front(), sorted[count / 2], sorted.back());
+			fflush(stdout);
+		}
+	};
+
+	void onSignal(int) { stopRequested = 1; }
+
+	// Ogni radio usa 2 descrittori: si alza il limite fino al massimo consentito
+	void raiseFileLimit(uint32_t radios)
+	{
+		rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+		rlim_t wanted = (rlim_t)radios * 2 + 64;
+		if (limit.rlim_cur >= wanted) return;
+		limit.rlim_cur = std::min(wanted, limit.rlim_max);
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	int usage(FILE* out, int status)
+	{
+		fprintf(out, "usage: icomsim_rig_emulator [-n radios] [-m tcp|pty|self] [-p base-port] [-d depth]\n"
+		             "                            [-s seconds] [-r report-seconds] [-l list-file] [-v] [-h]\n");
+		return status;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t radios = 100;
+	uint8_t mode = MODE_TCP;
+	uint16_t basePort = 50000;
+	uint8_t depth = 4;
+	double seconds = 0;
+	double reportEvery = 5;
+	const char* listPath = nullptr;
+	bool verbose = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* option = argv[i];
+		if (strcmp(option, "-h") == 0 || strcmp(option, "--help") == 0) return usage(stdout, 0);
+		if (strcmp(option, "-v") == 0)
+		{
+			verbose = true;
+			continue;
+		}
+
+		// Tutte le altre opzioni hanno un valore
+		if (strlen(option) != 2 || option[0] != '-' || strchr("npdsrlm", option[1]) == nullptr)
+		{
+			fprintf(stderr, "icomsim_rig_emulator: unknown option %s\n", option);
+			return usage(stderr, 2);
+		}
+		if (i + 1 >= argc)
+		{
+			fprintf(stderr, "icomsim_rig_emulator: %s needs a value\n", option);
+			return usage(stderr, 2);
+		}
+		const char* value = argv[++i];
+
+		if (strcmp(option, "-n") == 0) radios = (uint32_t)atol(value);
+		else if (strcmp(option, "-p") == 0) basePort = (uint16_t)atoi(value);
+		else if (strcmp(option, "-d") == 0) depth = (uint8_t)atoi(value);
+		else if (strcmp(option, "-s") == 0) seconds = atof(value);
+		else if (strcmp(option, "-r") == 0) reportEvery = atof(value);
+		else if (strcmp(option, "-l") == 0) listPath = value;
+		else if (strcmp(option, "-m") == 0)
+		{
+			if (strcmp(value, "tcp") == 0) mode = MODE_TCP;
+			else if (strcmp(value, "pty") == 0) mode = MODE_PTY;
+			else if (strcmp(value, "self") == 0) mode = MODE_SELF;
+			else
+			{
+				fprintf(stderr, "icomsim_rig_emulator: unknown mode %s\n", value);
+				return usage(stderr, 2);
+			}
+		}
+	}
+	if (radios == 0 || reportEvery <= 0 || (mode == MODE_TCP && basePort + radios > 65536)) return usage(stderr, 2);
+
+	raiseFileLimit(radios);
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	FILE* list = stdout;
+	if (listPath != nullptr && (list = fopen(listPath, "w")) == nullptr)
+	{
+		perror(listPath);
+		return 1;
+	}
+
+	Fleet fleet(radios, mode, depth);
+	if (!fleet.open(basePort, list)) return 1;
+	if (list != stdout) fclose(list);
+
+	if (mode == MODE_TCP) printf("%u radios on 127.0.0.1:%u-%u\n", radios, basePort, basePort + radios - 1);
+	else if (mode == MODE_SELF) printf("%u radios, built-in controllers with %u requests in flight\n", radios, depth);
+	fflush(stdout);
+
+	fleet.run(seconds, reportEvery, verbose);
+	return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Project Name: Radio Firmware
+ * File: trace_decode.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Decodes a CI-V trace dump captured from the serial line.
+ *
+ *   icomsim_trace_decode [-b] [file]
+ *
+ * NOTES:
+ * - Input is a hex dump ("FE FE E0 00 7F 01 ... FD", any separator, tokens that are not
+ *   two hex digits are skipped) or, with -b, the raw bytes. Without a file reads stdin.
+ * - Every 7F 01 reply in the capture is decoded; requests and other frames are ignored.
+ * - Read the trace while it is frozen (7F 00 01), otherwise the dump itself moves it.
+ */
+
+#include "CivTraceDecoder.h"
+
+#include <ctype.h>
+#include <string.h>
+
+static bool readHex(FILE* in, std::vector<uint8_t>& bytes)
+{
+	char token[64];
+
+	while (fscanf(in, "%63s", token) == 1)
+	{
+		if (strlen(token) != 2 || !isxdigit((unsigned char)token[0]) || !isxdigit((unsigned char)token[1])) continue;
+		bytes.push_back((uint8_t)strtoul(token, nullptr, 16));
+	}
+	return !ferror(in);
+}
+
+static bool readBinary(FILE* in, std::vector<uint8_t>& bytes)
+{
+	uint8_t chunk[512];
+	size_t n;
+
+	while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) bytes.insert(bytes.end(), chunk, chunk + n);
+	return !ferror(in);
+}
+
+int main(int argc, char** argv)
+{
+	bool binary = false;
+	const char* path = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-b") == 0) binary = true;
+		else path = argv[i];
+	}
+
+	FILE* in = path != nullptr ? fopen(path, binary ? "rb" : "r") : stdin;
+	if (in == nullptr)
+	{
+		perror(path);
+		return 1;
+	}
+
+	std::vector<uint8_t> bytes;
+	bool ok = binary ? readBinary(in, bytes) : readHex(in, bytes);
+	if (in != stdin) fclose(in);
+	if (!ok)
+	{
+		fprintf(stderr, "trace_decode: read error\n");
+		return 1;
+	}
+
+	// Frame: da FE FE a FD; i preamboli ripetuti si saltano
+	std::vector<CivTraceRecord_t> records;
+	CivTraceBlock block = {};
+	size_t blocks = 0;
+
+	for (size_t i = 0; i + 1 < bytes.size(); i++)
+	{
+		if (bytes[i] != 0xFE || bytes[i + 1] != 0xFE) continue;
+
+		size_t start = i;
+		while (start + 2 < bytes.size() && bytes[start + 2] == 0xFE) start++;
+
+		size_t end = start + 2;
+		while (end < bytes.size() && bytes[end] != 0xFD) end++;
+		if (end == bytes.size()) break;
+
+		if (civTraceDecodeFrame(&bytes[start], end - start + 1, block))
+		{
+			records.insert(records.end(), block.records.begin(), block.records.end());
+			blocks++;
+		}
+		i = end;
+	}
+
+	if (blocks == 0)
+	{
+		fprintf(stderr, "trace_decode: no trace read replies (7F 01) in the input\n");
+		return 1;
+	}
+
+	printf("%zu records from %zu replies, sequence %u, %u stored on the radio\n",
+	       records.size(), blocks, block.sequence, block.available);
+
+	uint32_t origin = records.empty() ? 0 : records[0].time;
+	for (const CivTraceRecord_t& r : records) printf("%s\n", civTraceFormat(r, origin).c_str());
+	return 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Flash/RAM usage of each IcomSim profile on a real target, measured with arduino-cli.
+#
+# Usage: extras/tools/size_report.sh [fqbn]        (default arduino:avr:uno)
+#
+# The sketch in size_sketch/ is compiled once per profile against this checkout of the
+# library. BK4819.h normally comes from the radio firmware: the host stand-in is used.
+
+set -e
+
+FQBN=${1:-arduino:avr:uno}
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+command -v arduino-cli >/dev/null || { echo "arduino-cli non trovato" >&2; exit 1; }
+
+mkdir -p "$WORK/include"
+cp "$ROOT/extras/host/include/BK4819.h" "$WORK/include/"
+
+for PROFILE in FULL SMALL; do
+	echo "== ICOMSIM_PROFILE_$PROFILE ($FQBN)"
+	arduino-cli compile --fqbn "$FQBN" --library "$ROOT" \
+		--build-property "compiler.cpp.extra_flags=-DICOMSIM_PROFILE=ICOMSIM_PROFILE_$PROFILE -I$WORK/include" \
+		--build-path "$WORK/build-$PROFILE" "$ROOT/extras/tools/size_sketch" \
+		| grep -E "Sketch uses|Global variables"
+done
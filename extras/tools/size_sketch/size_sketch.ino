@@ -0,0 +1,36 @@
+/*
+ * Project Name: Radio Firmware
+ * File: size_sketch.ino
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Minimal CAT responder compiled by size_report.sh to measure each IcomSim profile.
+ */
+
+#include <IcomSim.h>
+
+VfoData_t vfoA;
+VfoData_t vfoB;
+IcomSim radio(Serial);
+
+void setup()
+{
+	Serial.begin(9600);
+	radio.Initialize(&vfoA, &vfoB);
+}
+
+void loop()
+{
+	radio.processCIVCommand();
+	radio.processSerialQueue();
+
+	if (radio.isChanged() & FLAG_FREQUENCY_CHANGED)
+	{
+		// Qui il firmware riprogrammerebbe il BK4819
+	}
+}
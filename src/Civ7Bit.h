@@ -0,0 +1,72 @@
+/*
+ * Project Name: Radio Firmware
+ * File: Civ7Bit.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * 7-bit packing of binary payloads carried inside CI-V frames.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - Raw bytes 0xFC..0xFE would break CI-V framing, so binary data (trace records,
+ *   counters, snapshots) is sent 7 bits per byte, as in MIDI SysEx: each group of up
+ *   to 7 bytes is preceded by one byte holding their top bits.
+ * - n raw bytes take n + ceil(n / 7) bytes on the wire; every packed byte is < 0x80.
+ */
+
+#ifndef CIV7BIT_H
+#define CIV7BIT_H
+
+#include <stdint.h>
+
+#define CIV_7BIT_PACKED_SIZE(n) ((n) + ((n) + 6) / 7)          // Byte sulla linea per n byte binari
+#define CIV_7BIT_RAW_SIZE(n)    ((n) - ((n) + 7) / 8)          // Byte binari contenuti in n byte sulla linea
+
+// Impacchetta length byte in out; restituisce i byte scritti
+inline uint16_t civPack7(const uint8_t* in, uint16_t length, uint8_t* out)
+{
+	uint16_t written = 0;
+
+	for (uint16_t i = 0; i < length; i += 7)
+	{
+		uint8_t& msb = out[written++];
+		msb = 0;
+
+		for (uint8_t j = 0; j < 7 && i + j < length; j++)
+		{
+			uint8_t b = in[i + j];
+			msb |= (uint8_t)((b >> 7) << j);
+			out[written++] = b & 0x7F;
+		}
+	}
+	return written;
+}
+
+// Operazione inversa; restituisce i byte binari ricostruiti (0 se un byte ha il bit 7 alto)
+inline uint16_t civUnpack7(const uint8_t* in, uint16_t length, uint8_t* out)
+{
+	uint16_t written = 0;
+
+	for (uint16_t i = 0; i < length; )
+	{
+		uint8_t msb = in[i++];
+		if (msb & 0x80) return 0;
+
+		for (uint8_t j = 0; j < 7 && i < length; j++, i++)
+		{
+			if (in[i] & 0x80) return 0;
+			out[written++] = (uint8_t)(in[i] | (((msb >> j) & 1) << 7));
+		}
+	}
+	return written;
+}
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivBcd.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * BCD encode/decode kernels shared by every CI-V field carried as packed decimal
+ * (frequency, step, channel numbers, ...).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - WIDTH (bytes on the wire) and LAYOUT are template parameters, so every call site
+ *   gets a fully unrolled kernel for its own format.
+ * - Decoding is SWAR: all nibbles are validated and combined in a 64-bit word without
+ *   per-digit branches. Non-decimal nibbles make the decode fail instead of producing
+ *   a bogus value.
+ * - Encoding keeps the plain per-digit loop, on 32 bits whenever the source type fits:
+ *   double dabble and a divide-by-100 variant were no faster in bcd_bench, and on AVR
+ *   the 64-bit shifts of double dabble cost more than the 32-bit divisions they avoid.
+ */
+
+#ifndef CIVBCD_H
+#define CIVBCD_H
+
+#include <stdint.h>
+
+#define CIV_BCD_LSB_FIRST   0x00                            // Ordine Icom: prima la coppia di cifre meno significativa
+#define CIV_BCD_MSB_FIRST   0x01                            // Prima la coppia di cifre piu' significativa
+#define CIV_BCD_NIBBLE_SWAP 0x02                            // Decine nel nibble basso, unita' nel nibble alto
+
+namespace CivBcd
+{
+	// 10^(2*WIDTH): primo valore non rappresentabile su WIDTH byte
+	template <uint8_t WIDTH> struct Limit { static constexpr uint64_t value = Limit<WIDTH - 1>::value * 100; };
+	template <> struct Limit<0> { static constexpr uint64_t value = 1; };
+
+	// Tipo senza segno su cui lavora il codificatore: 32 bit quando bastano (divisioni costose su AVR)
+	template <bool WIDE> struct Word { typedef uint32_t type; };
+	template <> struct Word<true> { typedef uint64_t type; };
+
+	// Byte sulla linea che ospita la coppia di cifre i (0 = meno significativa)
+	template <uint8_t WIDTH, uint8_t LAYOUT>
+	inline uint8_t slot(uint8_t i) { return (LAYOUT & CIV_BCD_MSB_FIRST) ? (uint8_t)(WIDTH - 1 - i) : i; }
+
+	inline uint8_t swapNibbles(uint8_t b) { return (uint8_t)((b << 4) | (b >> 4)); }
+
+	// Stesso ciclo per cifra di send_frequency(), valido per ogni LAYOUT
+	template <uint8_t WIDTH, uint8_t LAYOUT, typename U>
+	inline void encode(U value, uint8_t* out)
+	{
+		for (uint8_t i = 0; i < WIDTH; i++)
+		{
+			uint8_t units = (uint8_t)(value % 10);
+			uint8_t tens = (uint8_t)(value / 10 % 10);
+			out[slot<WIDTH, LAYOUT>(i)] = (LAYOUT & CIV_BCD_NIBBLE_SWAP) ? (uint8_t)((units << 4) | tens) : (uint8_t)((tens << 4) | units);
+			value /= 100;
+		}
+	}
+
+	// Byte sulla linea -> valore binario. Restituisce false se un nibble non e' decimale.
+	template <uint8_t WIDTH, uint8_t LAYOUT>
+	inline bool fromPacked(const uint8_t* in, uint64_t& value)
+	{
+		uint64_t x = 0;
+		for (uint8_t i = WIDTH; i-- > 0; ) x = (x << 8) | in[slot<WIDTH, LAYOUT>(i)];
+
+		if (LAYOUT & CIV_BCD_NIBBLE_SWAP)
+		{
+			x = ((x & 0x0F0F0F0F0F0F0F0FULL) << 4) | ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL);
+		}
+
+		// Nibble > 9 <=> bit3 && (bit2 || bit1)
+		uint64_t invalid = (x >> 3) & ((x >> 2) | (x >> 1)) & 0x1111111111111111ULL;
+
+		x = (x & 0x0F0F0F0F0F0F0F0FULL) + ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) * 10;        // Coppie:   0..99
+		x = (x & 0x00FF00FF00FF00FFULL) + ((x >> 8) & 0x00FF00FF00FF00FFULL) * 100;       // Quartine: 0..9999
+		x = (x & 0x0000FFFF0000FFFFULL) + ((x >> 16) & 0x0000FFFF0000FFFFULL) * 10000;    // Ottetti:  0..99999999
+		value = (x & 0xFFFFFFFFULL) + (x >> 32) * 100000000ULL;
+
+		return invalid == 0;
+	}
+}
+
+// ******************************************************************************************************************************
+// Codifica value su WIDTH byte BCD. Restituisce false (e scrive zero) se value non e' rappresentabile.
+// ******************************************************************************************************************************
+template <uint8_t WIDTH, uint8_t LAYOUT = CIV_BCD_LSB_FIRST, typename T>
+inline bool civBcdEncode(T value, uint8_t* out)
+{
+	static_assert(WIDTH >= 1 && WIDTH <= 8, "civBcdEncode: WIDTH tra 1 e 8 byte");
+
+	typedef typename CivBcd::Word<(sizeof(T) > 4)>::type U;
+	bool fits = (uint64_t)value < CivBcd::Limit<WIDTH>::value;
+
+	CivBcd::encode<WIDTH, LAYOUT, U>(fits ? (U)value : 0, out);
+	return fits;
+}
+
+// ******************************************************************************************************************************
+// Decodifica WIDTH byte BCD. value non viene toccato se i dati non sono decimali o non entrano nel tipo T.
+// ******************************************************************************************************************************
+template <uint8_t WIDTH, uint8_t LAYOUT = CIV_BCD_LSB_FIRST, typename T>
+inline bool civBcdDecode(const uint8_t* in, T& value)
+{
+	static_assert(WIDTH >= 1 && WIDTH <= 8, "civBcdDecode: WIDTH tra 1 e 8 byte");
+
+	uint64_t raw;
+	if (!CivBcd::fromPacked<WIDTH, LAYOUT>(in, raw)) return false;
+	if ((uint64_t)(T)raw != raw) return false;                  // Es. > 4.29 GHz in un campo a 32 bit
+
+	value = (T)raw;
+	return true;
+}
+#endif
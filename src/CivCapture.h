@@ -0,0 +1,81 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivCapture.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Capture format of the CI-V traffic: whole frames with timestamps, as IcomSim
+ * received and transmitted them, for replay against the library.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - IcomSim hands every frame to the hook set with setCaptureHook(): received frames
+ *   before they are dispatched, transmitted frames once they are queued. The hook is
+ *   called in the context that runs IcomSim and must not block (buffer, then write).
+ * - File: a CIV_CAPTURE_HEADER_SIZE header ("CIVC", version, flags, 2 reserved bytes,
+ *   line rate 4 bytes LE, 4 reserved bytes), then records back to back:
+ *     type (1), length (1), time since the previous record in us (LEB128, 1..5 bytes), data.
+ *   A record is at most 7 + 255 bytes; a 6-byte poll costs 9 bytes.
+ * - CIV_CAPTURE_STATE records carry the VFO state in the snapshot record layout
+ *   (IcomSim.h, CIV_SNAPSHOT_VERSION), so a replay starts from the recorded state.
+ * - Writer and memory-mapped reader for the host: extras/host/include/CivCaptureFile.h;
+ *   replay tool: extras/host/tools/civ_replay.cpp.
+ */
+
+#ifndef CIVCAPTURE_H
+#define CIVCAPTURE_H
+
+#include <stdint.h>
+
+#define CIV_CAPTURE_VERSION      1
+#define CIV_CAPTURE_HEADER_SIZE  16
+#define CIV_CAPTURE_RECORD_MAX   (2 + 5 + 255)
+
+#define CIV_CAPTURE_RX       0x01       // Frame ricevuto (FE FE ... FD)
+#define CIV_CAPTURE_TX       0x02       // Frame accodato per la trasmissione
+#define CIV_CAPTURE_RX_ERROR 0x03       // Frame scartato dal parser: un byte, CivParseResult_t
+#define CIV_CAPTURE_STATE    0x04       // Stato di un VFO (record dell'istantanea 7F 09)
+
+// Riceve un record: type = CIV_CAPTURE_*, data = frame intero o dati del record
+typedef void (*IcomSimCaptureHook_t)(void* ctx, uint8_t type, const uint8_t* data, uint16_t length);
+
+// Intestazione del record in out (almeno 7 byte); restituisce i byte scritti
+inline uint8_t civCaptureRecordHeader(uint8_t type, uint8_t length, uint32_t deltaMicros, uint8_t* out)
+{
+	uint8_t n = 0;
+	out[n++] = type;
+	out[n++] = length;
+	do
+	{
+		uint8_t byte = deltaMicros & 0x7F;
+		deltaMicros >>= 7;
+		out[n++] = deltaMicros ? (uint8_t)(byte | 0x80) : byte;
+	} while (deltaMicros);
+	return n;
+}
+
+// Legge l'intestazione di un record da in (available byte); restituisce i byte letti, 0 se incompleta o non valida
+inline uint8_t civCaptureParseHeader(const uint8_t* in, uint32_t available, uint8_t& type, uint8_t& length, uint32_t& deltaMicros)
+{
+	if (available < 3) return 0;
+
+	type = in[0];
+	length = in[1];
+	deltaMicros = 0;
+	for (uint8_t i = 0; i < 5 && 2u + i < available; i++)
+	{
+		deltaMicros |= (uint32_t)(in[2 + i] & 0x7F) << (7 * i);
+		if (!(in[2 + i] & 0x80)) return (uint8_t)(3 + i);
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivParser.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Incremental, allocation-free parser for CI-V frames.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ */
+
+#include "CivParser.h"
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+CivParser::CivParser()
+{
+    current.data = buffer;
+    reset();
+}
+
+void CivParser::reset()
+{
+    state = WAIT_START1;
+    length = 0;
+    current.addressTo = 0;
+    current.addressFrom = 0;
+    current.command = 0;
+    current.dataLength = 0;
+}
+
+// ******************************************************************************************************************************
+// Elabora un byte ricevuto. Costo costante per byte: nessun ciclo, nessuna allocazione.
+// ******************************************************************************************************************************
+CivParseResult_t CivParser::feed(uint8_t byte)
+{
+    switch (state)
+    {
+        case WAIT_START1:
+            if (byte == CIV_START_BYTE) state = WAIT_START2;
+            return CIV_PARSE_PENDING;
+
+        case WAIT_START2:
+            state = (byte == CIV_START_BYTE) ? ADDRESS_TO : WAIT_START1;
+            return CIV_PARSE_PENDING;
+
+        case DISCARD:                                       // Scarta fino al terminatore o ad un nuovo preambolo
+            if (byte == CIV_END_BYTE)        state = WAIT_START1;
+            else if (byte == CIV_START_BYTE) state = WAIT_START2;
+            return CIV_PARSE_PENDING;
+
+        default:
+            break;
+    }
+
+    // Byte di controllo all'interno di un frame
+    if (byte == CIV_START_BYTE)
+    {
+        if (state == ADDRESS_TO) return CIV_PARSE_PENDING;  // Preambolo con piu' di due 0xFE
+
+        state = WAIT_START2;                                // Nuovo preambolo: il frame corrente e' perso
+        return CIV_PARSE_COLLISION;
+    }
+
+    if (byte == CIV_COLLISION_BYTE)
+    {
+        state = WAIT_START1;
+        return CIV_PARSE_COLLISION;
+    }
+
+    if (byte == CIV_END_BYTE)
+    {
+        if (state != PAYLOAD)
+        {
+            state = WAIT_START1;
+            return CIV_PARSE_TOO_SHORT;
+        }
+
+        current.dataLength = length;
+        state = WAIT_START1;
+        return CIV_PARSE_FRAME;
+    }
+
+    switch (state)
+    {
+        case ADDRESS_TO:
+            current.addressTo = byte;
+            state = ADDRESS_FROM;
+            break;
+
+        case ADDRESS_FROM:
+            current.addressFrom = byte;
+            state = COMMAND;
+            break;
+
+        case COMMAND:
+            current.command = byte;
+            length = 0;
+            state = PAYLOAD;
+            break;
+
+        default:                                            // PAYLOAD
+            if (length >= sizeof(buffer))
+            {
+                state = DISCARD;
+                return CIV_PARSE_OVERFLOW;
+            }
+            buffer[length++] = byte;
+            break;
+    }
+
+    return CIV_PARSE_PENDING;
+}
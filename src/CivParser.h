@@ -0,0 +1,89 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivParser.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Incremental, allocation-free parser for CI-V frames.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - The parser is fed one byte at a time and performs a constant amount of work per byte,
+ *   so it can be driven from a tight loop or from a ring buffer filled by an ISR.
+ * - A completed frame is exposed as a view into the parser's own buffer: the view is valid
+ *   only until the next call to feed().
+ * - Every well-formed frame is returned, whatever its addresses: the parser is shared by
+ *   IcomSim and IcomSimController, which filter on their own address (IcomSim::dispatch()
+ *   drops frames for other devices and its own echo).
+ */
+
+#ifndef CIVPARSER_H
+#define CIVPARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "IcomSimConfig.h"
+
+#define CIV_START_BYTE 0xFE
+#define CIV_END_BYTE 0xFD
+#define CIV_COLLISION_BYTE 0xFC
+
+#define CIV_FRAME_OVERHEAD 6                                // FE FE to from cmd ... FD
+#define CIV_MAX_PAYLOAD (CIV_MAX_FRAME_SIZE - CIV_FRAME_OVERHEAD)
+
+// Vista su un frame completo: data punta nel buffer del parser (nessuna copia)
+typedef struct
+{
+    uint8_t addressTo;
+    uint8_t addressFrom;
+    uint8_t command;
+    uint8_t dataLength;
+    const uint8_t* data;
+} CivFrame_t;
+
+// Esito dell'elaborazione di un singolo byte
+typedef enum : uint8_t
+{
+    CIV_PARSE_PENDING = 0,                                  // Frame in corso (o nessun frame)
+    CIV_PARSE_FRAME,                                        // Frame completo disponibile in frame()
+    CIV_PARSE_TOO_SHORT,                                    // Terminatore ricevuto prima del comando
+    CIV_PARSE_OVERFLOW,                                     // Payload oltre CIV_MAX_PAYLOAD, frame scartato
+    CIV_PARSE_COLLISION                                     // Jam (0xFC) o preambolo inatteso, frame scartato
+} CivParseResult_t;
+
+class CivParser
+{
+public:
+	CivParser();
+
+	CivParseResult_t feed(uint8_t byte);
+	const CivFrame_t& frame() const { return current; }
+	void reset();
+
+private:
+	typedef enum : uint8_t
+	{
+		WAIT_START1 = 0,
+		WAIT_START2,
+		ADDRESS_TO,
+		ADDRESS_FROM,
+		COMMAND,
+		PAYLOAD,
+		DISCARD
+	} State_t;
+
+	State_t state;
+	uint8_t length;                                         // Byte di payload accumulati
+	uint8_t buffer[CIV_MAX_PAYLOAD];
+	CivFrame_t current;
+};
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivRing.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Fixed-size byte ring used by the CI-V transmit and receive paths.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - SIZE must be a power of two; head and tail run freely and are masked on access,
+ *   so the whole buffer is usable and no byte is wasted to tell "full" from "empty".
+ * - Frames are written all-or-nothing: a frame never ends up half in the ring.
+ * - One producer and one consumer may run in different contexts (ISR, task, loop) without
+ *   locks: only the producer writes head, only the consumer writes tail, and each side
+ *   publishes its index with a release store after touching the data. INDEX must be a type the
+ *   target loads and stores atomically (uint8_t on AVR).
+ */
+
+#ifndef CIVRING_H
+#define CIVRING_H
+
+#include <stdint.h>
+#include <string.h>
+#include "IcomSimPort.h"
+
+template <uint16_t SIZE, typename INDEX = uint16_t>
+class CivByteRing
+{
+	static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "CivByteRing: SIZE deve essere una potenza di 2");
+	static_assert(SIZE <= ((uint32_t)(INDEX)~(INDEX)0 + 1) / 2, "CivByteRing: INDEX troppo piccolo per SIZE");
+
+public:
+	CivByteRing() : head(0), tail(0) {}
+
+	uint16_t capacity() const { return SIZE; }
+	uint16_t used() const { return (INDEX)(ICOMSIM_LOAD_ACQUIRE(head) - ICOMSIM_LOAD_ACQUIRE(tail)); }
+	uint16_t space() const { return SIZE - used(); }
+	bool isEmpty() const { return used() == 0; }
+	void clear() { ICOMSIM_STORE_RELEASE(tail, ICOMSIM_LOAD_ACQUIRE(head)); }
+
+	// Lato produttore: accoda length byte solo se c'e' spazio per tutti
+	bool write(const uint8_t* data, uint16_t length)
+	{
+		if (length > space()) return false;
+
+		uint16_t offset = head & (SIZE - 1);
+		uint16_t first = SIZE - offset;
+		if (first > length) first = length;
+
+		memcpy(&buffer[offset], data, first);
+		memcpy(&buffer[0], data + first, length - first);
+		ICOMSIM_STORE_RELEASE(head, (INDEX)(head + length));
+		return true;
+	}
+
+	// Lato produttore, un byte alla volta (es. dall'ISR della UART)
+	bool push(uint8_t byte)
+	{
+		if (used() >= SIZE) return false;
+
+		buffer[head & (SIZE - 1)] = byte;
+		ICOMSIM_STORE_RELEASE(head, (INDEX)(head + 1));
+		return true;
+	}
+
+	// Lato consumatore
+	bool pop(uint8_t& byte)
+	{
+		if (isEmpty()) return false;
+
+		byte = buffer[tail & (SIZE - 1)];
+		ICOMSIM_STORE_RELEASE(tail, (INDEX)(tail + 1));
+		return true;
+	}
+
+	// Porzione contigua leggibile a partire dalla coda (length = 0 se vuoto)
+	const uint8_t* peek(uint16_t& length) const
+	{
+		uint16_t offset = tail & (SIZE - 1);
+		uint16_t contiguous = SIZE - offset;
+		length = used();
+		if (length > contiguous) length = contiguous;
+		return &buffer[offset];
+	}
+
+	void consume(uint16_t length)
+	{
+		ICOMSIM_STORE_RELEASE(tail, (INDEX)(tail + length));
+	}
+
+private:
+	volatile INDEX head;                                    // Scritto solo dal produttore
+	volatile INDEX tail;                                    // Scritto solo dal consumatore
+	uint8_t buffer[SIZE];
+};
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Project Name: Radio Firmware
+ * File: CivTrace.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Binary event trace of the CI-V traffic, kept in a fixed RAM ring.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - One event is one 8-byte record (micros() timestamp, event, command, length, code)
+ *   stored with a few plain writes: no formatting, no I/O, nothing that blocks. The
+ *   oldest records are overwritten, so tracing can stay on in production.
+ * - The trace is read over CI-V with the vendor command (COMMAND_VENDOR, see IcomSim.h)
+ *   and decoded on the PC by extras/host/tools/trace_decode.
+ * - Records are written only by the context that runs IcomSim.
+ */
+
+#ifndef CIVTRACE_H
+#define CIVTRACE_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define CIV_TRACE_RX_FRAME   0x01       // Frame ricevuto e valido (code = 0)
+#define CIV_TRACE_RX_ERROR   0x02       // Frame scartato dal parser (code = CivParseResult_t)
+#define CIV_TRACE_TX_FRAME   0x03       // Frame accodato per la trasmissione
+#define CIV_TRACE_TX_DROP    0x04       // Frame perso: coda di trasmissione piena
+#define CIV_TRACE_NG         0x05       // Risposta NG (code: 0 = comando sconosciuto, 1 = rifiutato dal gestore)
+
+#define CIV_TRACE_RECORD_SIZE 8         // Byte di un record serializzato
+
+typedef struct
+{
+	uint32_t time;                      // micros()
+	uint8_t event;                      // CIV_TRACE_*
+	uint8_t command;
+	uint8_t length;                     // Byte di dati del frame
+	uint8_t code;
+} CivTraceRecord_t;
+
+template <uint16_t SIZE>
+class CivTrace
+{
+	static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "CivTrace: SIZE deve essere una potenza di 2");
+
+public:
+	CivTrace() : sequence(0), stored(0), frozen(false) {}
+
+	inline void record(uint8_t event, uint8_t command, uint8_t length, uint8_t code)
+	{
+		if (frozen) return;
+
+		CivTraceRecord_t& r = records[sequence & (SIZE - 1)];
+		r.time = micros();
+		r.event = event;
+		r.command = command;
+		r.length = length;
+		r.code = code;
+		sequence++;
+		if (stored < SIZE) stored++;
+	}
+
+	// Congelata durante la lettura, cosi' il traffico del dump non sovrascrive gli eventi da leggere
+	void freeze(bool enable) { frozen = enable; }
+	bool isFrozen() const { return frozen; }
+
+	uint16_t getSequence() const { return sequence; }                   // Eventi registrati dall'avvio (modulo 2^16)
+	uint16_t available() const { return stored; }
+
+	// index 0 = record piu' vecchio ancora presente
+	const CivTraceRecord_t& at(uint16_t index) const
+	{
+		return records[(uint16_t)(sequence - available() + index) & (SIZE - 1)];
+	}
+
+	// Formato sulla linea: tempo little endian, poi event, command, length, code
+	static void serialize(const CivTraceRecord_t& r, uint8_t* out)
+	{
+		out[0] = (uint8_t)r.time;
+		out[1] = (uint8_t)(r.time >> 8);
+		out[2] = (uint8_t)(r.time >> 16);
+		out[3] = (uint8_t)(r.time >> 24);
+		out[4] = r.event;
+		out[5] = r.command;
+		out[6] = r.length;
+		out[7] = r.code;
+	}
+
+private:
+	CivTraceRecord_t records[SIZE];
+	uint16_t sequence;                  // Indice del prossimo record, mai azzerato
+	uint16_t stored;                    // Record validi nel ring (al massimo SIZE)
+	bool frozen;
+};
+#endif
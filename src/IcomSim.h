@@ -23,26 +23,45 @@
 #ifndef ICOMSIM_H
 #define ICOMSIM_H
 
+#include "IcomSimConfig.h"
+
 #ifdef ESP32
     #include <HardwareSerial.h>
 
 #else
 	#include <Arduino.h>
+	#if ICOMSIM_DEBUG
     #include <SoftwareSerial.h>
+	#endif
 
 #endif
 
 #include "BK4819.h"
-
-#define CIV_START_BYTE 0xFE
-#define CIV_END_BYTE 0xFD
+#include "CivParser.h"
+#include "CivRing.h"
+#include "CivBcd.h"
+#include "Civ7Bit.h"
+#include "CivTrace.h"
+#include "CivCapture.h"
+#include "IcomSimLatency.h"
+#include "IcomSimLineRate.h"
 
 #define CIV_ADDRESS_RADIO 0xE0
 #define CIV_ADDRESS_COMPUTER 0x00
+#define CIV_ADDRESS_BROADCAST 0x00
+
+#define COMMAND_TRANSCEIVE_FREQUENCY 0x00	// Frame non richiesti (transceive)
+#define COMMAND_TRANSCEIVE_MODE      0x01
 
 #define COMMAND_GET_FREQUENCY 0x03
 #define COMMAND_SET_FREQUENCY 0x05
 #define COMMAND_SET_MODE      0x06
+#define COMMAND_SELECT_VFO    0x07
+#define COMMAND_SELECT_MEMORY 0x08	// Senza dati: modo memoria; con 2 byte BCD: seleziona il canale
+#define COMMAND_MEMORY_WRITE  0x09	// VFO selezionato -> canale selezionato
+#define COMMAND_MEMORY_TO_VFO 0x0A	// Canale selezionato -> VFO selezionato
+#define COMMAND_MEMORY_CLEAR  0x0B	// Cancella il canale selezionato
+#define COMMAND_SPLIT         0x0F
 #define COMMAND_SET_SQUELCH   0x14
 #define COMMAND_GET_SQUELCH   0x15
 #define COMMAND_SET_AGC  	  0x16
@@ -61,6 +80,31 @@
 #define COMMAND_SET_STEP 	  0x23
 #define COMMAND_GET_STEP 	  0x24
 
+#define COMMAND_VENDOR        0x7F	// Comandi di servizio di IcomSim, dati binari impacchettati a 7 bit (Civ7Bit.h)
+#define CIV_VENDOR_TRACE_CONTROL 0x00	// 7F 00 [01 = congela, 00 = riprendi]; senza dati restituisce lo stato
+#define CIV_VENDOR_TRACE_READ    0x01	// 7F 01 [indice, 1 o 2 byte a 7 bit]: record della traccia a partire da indice
+#define CIV_VENDOR_METRICS_READ  0x02	// 7F 02 [indice]: contatori ICOMSIM_METRIC_* a partire da indice
+#define CIV_VENDOR_HITS_READ     0x03	// 7F 03 [indice]: frame ricevuti per gestore, a partire dallo slot indice
+#define CIV_VENDOR_METRICS_RESET 0x04	// 7F 04: azzera contatori e conteggi dei gestori
+#define CIV_VENDOR_BULK_BEGIN    0x05	// 7F 05: apre o riprende un trasferimento a blocchi (IcomSimBulk.h)
+#define CIV_VENDOR_BULK_DATA     0x06	// 7F 06: blocco con CRC, riscontro solo a fine finestra
+#define CIV_VENDOR_BULK_END      0x07	// 7F 07 [01 = annulla]: chiude il trasferimento
+#define CIV_VENDOR_LINE_RATE     0x08	// 7F 08 [baud]: stato della linea o cambio di velocita' (IcomSimLineRate.h)
+#define CIV_VENDOR_SNAPSHOT      0x09	// 7F 09 [vfo, opzioni]: istantanea dei VFO, al posto di un GET per campo
+
+// Formato BCD di frequenza e passo sulla linea, invariato rispetto alle versioni precedenti:
+// in ricezione coppie LSB prima con decine nel nibble basso, in risposta coppie MSB prima.
+#define CIV_BCD_RX_LAYOUT (CIV_BCD_LSB_FIRST | CIV_BCD_NIBBLE_SWAP)
+#define CIV_BCD_TX_LAYOUT CIV_BCD_MSB_FIRST
+
+#define CIV_ACK_OK            0xFB
+#define CIV_ACK_NG            0xFA
+
+#define CIV_VFO_A             0x00	// Sottocomandi di COMMAND_SELECT_VFO
+#define CIV_VFO_B             0x01
+#define CIV_VFO_EQUALIZE      0xA0
+#define CIV_VFO_EXCHANGE      0xB0
+
 #define AGC_AUTO 0
 #define AGC_MAN  1
 #define AGC_SLOW 2
@@ -77,6 +121,17 @@
 #define FLAG_BW_CHANGED          0x0020  // 0000000000100000 
 #define FLAG_TXP_CHANGED         0x0040  // 0000000001000000 
 #define FLAG_STEP_CHANGED        0x0080  // 0000000010000000
+#define FLAG_AGC_CHANGED         0x0100  // 0000000100000000
+#define FLAG_VFO_CHANGED         0x0200  // 0000001000000000
+#define FLAG_SPLIT_CHANGED       0x0400  // 0000010000000000
+
+#define FLAG_VFO_FIELDS          0x00EF  // Campi propri di un VFO (tutti tranne monitor)
+
+#define ICOMSIM_CHANGE_FIELDS    11      // Bit di Flags_t in uso, ognuno con il proprio contatore di generazione
+
+#define ICOMSIM_VFO_A        0
+#define ICOMSIM_VFO_B        1
+#define ICOMSIM_RADIO_FLAGS  2			// Indice dei flag non legati ad un VFO
 
 typedef struct
 {
@@ -91,9 +146,9 @@ typedef struct
             bool txpChanged:1;
             bool stepChanged:1;
 
-            bool vuoto1:1;
-            bool vuoto2:1;
-            bool vuoto3:1;
+            bool agcChanged:1;
+            bool vfoChanged:1;
+            bool splitChanged:1;
             bool vuoto4:1;
             bool vuoto5:1;
             bool vuoto6:1;
@@ -104,6 +159,115 @@ typedef struct
     };
 } Flags_t;
 
+#define ICOMSIM_TRANSCEIVE_WINDOW_MS 50	// Finestra di accorpamento delle modifiche locali
+#define ICOMSIM_RSSI_MIN_INTERVAL_MS 20	// Intervallo minimo dell'invio periodico RSSI
+#define CIV_SUBCMD_ANY 0xFFFF		// Il gestore riceve tutti i frame del comando
+#define CIV_NO_HANDLER 0xFF
+#define ICOMSIM_WAIT_FOREVER 0xFFFFFFFFUL	// process(): nessuna scadenza, si attende il prossimo evento
+
+// Contatori (uint16_t, ricominciano da 0 dopo 65535: chi li legge periodicamente usa le differenze)
+#define ICOMSIM_METRIC_RX_FRAMES       0	// Frame validi ricevuti
+#define ICOMSIM_METRIC_RX_TOO_SHORT    1	// Terminatore prima del comando
+#define ICOMSIM_METRIC_RX_OVERFLOW     2	// Frame oltre CIV_MAX_FRAME_SIZE
+#define ICOMSIM_METRIC_RX_COLLISION    3	// Jam o preambolo inatteso
+#define ICOMSIM_METRIC_RX_RING_LOST    4	// Byte persi a ring di ricezione pieno (getRxOverflows)
+#define ICOMSIM_METRIC_NG_UNKNOWN      5	// NG per comando sconosciuto
+#define ICOMSIM_METRIC_NG_REJECTED     6	// NG restituito da un gestore
+#define ICOMSIM_METRIC_TX_FRAMES       7	// Frame accodati per la trasmissione
+#define ICOMSIM_METRIC_TX_DROPPED      8	// Frame scartati a coda di trasmissione piena
+#define ICOMSIM_METRIC_TX_STALLS       9	// processSerialQueue() con byte in coda e UART senza spazio
+#define ICOMSIM_METRIC_TX_HIGH_WATER  10	// Massimo di byte in coda di trasmissione
+#define ICOMSIM_METRIC_RX_HIGH_WATER  11	// Massimo di byte nel ring di ricezione
+#define ICOMSIM_METRIC_MAX_FRAME_US   12	// Tempo massimo di gestione di un frame in microsecondi (satura a 65535)
+#define ICOMSIM_METRIC_COUNT          13
+
+#if ICOMSIM_METRICS
+	#define ICOMSIM_COUNT(id) (metrics[id]++)
+	#define ICOMSIM_PEAK(id, value) do { if ((value) > metrics[id]) metrics[id] = (value); } while (0)
+
+	// Valori per frame di risposta: intestazione di 3 byte (totale, indice, quanti) + valori, impacchettati a 7 bit
+	#define CIV_METRICS_PER_FRAME ((CIV_7BIT_RAW_SIZE(CIV_MAX_PAYLOAD - 1) - 3) / 2)
+	#define CIV_HITS_PER_FRAME    ((CIV_7BIT_RAW_SIZE(CIV_MAX_PAYLOAD - 1) - 3) / 5)
+	#if CIV_HITS_PER_FRAME < 1
+		#error "ICOMSIM_METRICS richiede CIV_MAX_FRAME_SIZE >= 17"
+	#endif
+#else
+	#define ICOMSIM_COUNT(id) do {} while (0)
+	#define ICOMSIM_PEAK(id, value) do {} while (0)
+#endif
+
+#if ICOMSIM_TRACE
+	typedef CivTrace<ICOMSIM_TRACE_SIZE> IcomSimTrace_t;
+	#define ICOMSIM_TRACE_EVENT(event, command, length, code) trace.record(event, command, length, code)
+
+	// Record per frame di risposta: intestazione di 5 byte (sequenza, disponibili, quanti) + record, impacchettati a 7 bit
+	#define CIV_TRACE_PER_FRAME ((CIV_7BIT_RAW_SIZE(CIV_MAX_PAYLOAD - 1) - 5) / CIV_TRACE_RECORD_SIZE)
+	#if CIV_TRACE_PER_FRAME < 1
+		#error "ICOMSIM_TRACE richiede CIV_MAX_FRAME_SIZE >= 24"
+	#endif
+#else
+	#define ICOMSIM_TRACE_EVENT(event, command, length, code) do {} while (0)
+#endif
+
+#if ICOMSIM_FEATURE_SNAPSHOT
+	// Istantanea 7F 09, versione 1. Richiesta (byte semplici): [vfo] [opzioni].
+	// Risposta impacchettata a 7 bit: versione, stato, AGC (0xFF se assente), record; poi i record:
+	// vfo, maschera FLAG_* (2 byte), campi presenti nell'ordine dei bit: frequenza (4), modo, squelch,
+	// guadagno, banda, potenza (1 ciascuno), passo (4). Valori multi-byte little endian.
+	// Se i record non stanno in un frame la risposta continua in un secondo frame con la stessa intestazione.
+	// Con CIV_SNAPSHOT_CHANGED_ONLY la prima istantanea dall'avvio e' completa; un controller che si ricollega
+	// chiede prima un'istantanea senza opzioni.
+	#define CIV_SNAPSHOT_VERSION      1
+	#define CIV_SNAPSHOT_SELECTED     0x00	// vfo: quello selezionato
+	#define CIV_SNAPSHOT_VFO_A        0x01
+	#define CIV_SNAPSHOT_VFO_B        0x02
+	#define CIV_SNAPSHOT_BOTH         0x03
+	#define CIV_SNAPSHOT_CHANGED_ONLY 0x01	// opzioni: solo i campi cambiati dall'ultima istantanea (richiede ICOMSIM_FEATURE_CHANGE_API)
+
+	#define CIV_SNAPSHOT_STATE_VFO_B   0x01	// Bit dello stato: VFO B selezionato
+	#define CIV_SNAPSHOT_STATE_SPLIT   0x02
+	#define CIV_SNAPSHOT_STATE_MEMORY  0x04	// Modo memoria
+	#define CIV_SNAPSHOT_STATE_CHANGED 0x08	// I record contengono solo i campi cambiati
+
+	#define CIV_SNAPSHOT_FIELDS     FLAG_VFO_FIELDS
+	#define CIV_SNAPSHOT_HEADER     4
+	#define CIV_SNAPSHOT_RECORD_MAX 16
+	#if CIV_7BIT_RAW_SIZE(CIV_MAX_PAYLOAD - 1) < CIV_SNAPSHOT_HEADER + CIV_SNAPSHOT_RECORD_MAX
+		#error "ICOMSIM_FEATURE_SNAPSHOT richiede CIV_MAX_FRAME_SIZE >= 30"
+	#endif
+#endif
+
+class IcomSim;
+class IcomSimMemory;
+class IcomSimBulkTarget;
+
+// Gestore di un comando CI-V: restituisce false per rispondere NG al controller
+typedef bool (*CivHandler_t)(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+
+// Destinazione alternativa dei frame trasmessi (es. IcomSimRouter): restituisce false se il frame e' stato scartato
+typedef bool (*CivFrameSink_t)(void* ctx, const uint8_t* data, uint16_t length);
+
+// Chiamata nel contesto che ha applicato la modifica (es. ricezione CI-V): deve essere breve
+typedef void (*IcomSimChangeCallback_t)(IcomSim& sim, uint8_t vfo, uint16_t flags, void* ctx);
+
+// Stato di un consumatore delle modifiche: ognuno vede ogni modifica una sola volta, indipendentemente dagli altri
+typedef struct
+{
+	IcomSimGen_t seen[ICOMSIM_RADIO_FLAGS + 1][ICOMSIM_CHANGE_FIELDS];
+} IcomSimSubscriber_t;
+
+typedef struct
+{
+	CivHandler_t fn;
+	void* ctx;
+	uint16_t subcommand;			// CIV_SUBCMD_ANY oppure 0x00..0xFF
+	uint8_t next;					// Slot successivo per lo stesso comando (CIV_NO_HANDLER = fine)
+#if ICOMSIM_METRICS
+	uint8_t command;
+	uint16_t hits;					// Frame consegnati al gestore
+#endif
+} CivHandlerSlot_t;
+
 class IcomSim 
 {
 public:
@@ -111,26 +275,299 @@ public:
 	bool Initialize(VfoData_t* initData1, VfoData_t* initData2);
 
 	void processCIVCommand();
+	bool registerHandler(uint8_t command, uint16_t subcommand, CivHandler_t fn, void* ctx);
+	void handleFrame(const CivFrame_t& frame) { dispatch(frame); }
+	void setFrameSink(CivFrameSink_t fn, void* ctx);
+#if ICOMSIM_FEATURE_CAPTURE
+	void setCaptureHook(IcomSimCaptureHook_t fn, void* ctx) { captureHook = fn; captureCtx = ctx; }
+#endif
 	
-	void send_frequency(uint8_t comand, uint32_t frequency, uint8_t addressFrom, uint8_t addressTo);
+	// Template sul tipo del campo: un uint32_t resta sul codificatore a 32 bit (divisioni a 64 bit costose su AVR)
+	template <typename T>
+	void send_frequency(uint8_t command, T frequency, uint8_t addressFrom, uint8_t addressTo)
+	{
+		uint8_t bcd[6];
+		civBcdEncode<6, CIV_BCD_TX_LAYOUT>(frequency, bcd);
+		send_frequency_bcd(command, bcd, addressFrom, addressTo);
+	}
 	void send_rssi(uint16_t rssi, uint8_t addressFrom, uint8_t addressTo);
 	void send_status(uint8_t vfo, uint8_t addressFrom, uint8_t addressTo);
 	void send_command(uint8_t command, uint8_t value, uint8_t addressFrom, uint8_t addressTo);
+	void send_ack(bool ok, uint8_t addressFrom, uint8_t addressTo);
+	bool send_packed(uint8_t command, uint8_t subcommand, const uint8_t* data, uint8_t length, uint8_t addressFrom, uint8_t addressTo);
 	
 	void sendToSerial(const uint8_t* data, size_t length);
 	
 	void processSerialQueue();
+	uint32_t process();
+
+#if ICOMSIM_FEATURE_RX_RING
+	void enableRxRing(bool enable);
+	bool pushRxByte(uint8_t byte);
+	void pumpRx();
+	uint16_t getRxOverflows() const;
+#endif
+
+	void setCivAddress(uint8_t address) { civAddress = address; }
+#if ICOMSIM_FEATURE_TRANSCEIVE
+	void setTransceive(bool enable, uint16_t windowMs = ICOMSIM_TRANSCEIVE_WINDOW_MS);
+	void notifyLocalChange(uint16_t flags);
+#endif
+
+#if ICOMSIM_FEATURE_METER
+	void setRssi(uint16_t value);
+	void setRssiStreaming(uint16_t intervalMs, uint8_t address = CIV_ADDRESS_BROADCAST);
+	uint8_t getAgc() const { return agc; }
+#endif
 	
+#if ICOMSIM_DEBUG
 	void Debug_Print(const char *format, ...);
+#else
+	void Debug_Print(const char*, ...) {}
+#endif
 	
 	uint16_t isChanged();
+	uint16_t isChanged(uint8_t vfo);
+
+#if ICOMSIM_TRACE
+	IcomSimTrace_t& getTrace() { return trace; }
+#endif
+
+#if ICOMSIM_LATENCY
+	IcomSimLatency& getLatency() { return latency; }
+#endif
+
+#if ICOMSIM_METRICS
+	uint16_t getMetric(uint8_t id) const;
+	uint16_t getHandlerHits(uint8_t command, uint16_t subcommand = CIV_SUBCMD_ANY) const;
+	void resetMetrics();
+#endif
+
+#if ICOMSIM_FEATURE_CHANGE_API
+	void subscribe(IcomSimSubscriber_t& subscriber) const;
+	uint16_t pollChanges(IcomSimSubscriber_t& subscriber, uint8_t vfo, uint8_t* counts = nullptr) const;
+	IcomSimGen_t getGeneration(uint8_t vfo, uint8_t field) const;
+	bool addChangeCallback(uint16_t mask, IcomSimChangeCallback_t fn, void* ctx);
+	void removeChangeCallback(IcomSimChangeCallback_t fn, void* ctx);
+#endif
+
+#if ICOMSIM_FEATURE_MEMORY
+	void attachMemory(IcomSimMemory* bank) { memory = bank; }
+	bool selectMemory(uint16_t channel);
+	bool recallMemory();
+	uint16_t getMemoryChannel() const { return memoryChannel; }
+	bool isMemoryMode() const { return memoryMode; }
+#endif
+
+#if ICOMSIM_FEATURE_LINE_RATE
+	IcomSimLineRate& getLineRate() { return lineRate; }
+#endif
+
+#if ICOMSIM_FEATURE_BULK
+	bool attachBulkTarget(uint8_t id, IcomSimBulkTarget* target);
+	bool isBulkActive() const { return bulk.active; }
+#endif
+
+	void selectVfo(uint8_t vfo);
+	void equalizeVfo();
+	void exchangeVfo();
+	void setSplit(bool enable);
+	uint8_t getSelectedVfo() const { return vfoSelected; }
+	uint8_t getTxVfo() const { return split ? (vfoSelected ^ 1) : vfoSelected; }
+	bool isSplit() const { return split; }
 
 private:
 	Stream* serialPort; 
+
+	void send_frequency_bcd(uint8_t command, const uint8_t* bcd, uint8_t addressFrom, uint8_t addressTo);
 	VfoData_t* VfoData[2];  	// Variabile membro per i dati della radio
-	Flags_t Flags;  				// Variabile membro per i flag di stato
-	
-	void sendResponse(const String& response);
+	Flags_t Flags[ICOMSIM_RADIO_FLAGS + 1];	// Flag di stato: VFO A, VFO B, radio
+#if ICOMSIM_FEATURE_CHANGE_API
+	IcomSimGen_t generation[ICOMSIM_RADIO_FLAGS + 1][ICOMSIM_CHANGE_FIELDS];	// Modifiche per campo, mai azzerate
+
+	typedef struct
+	{
+		uint16_t mask;
+		IcomSimChangeCallback_t fn;
+		void* ctx;
+	} ChangeCallback_t;
+	ChangeCallback_t changeCallbacks[ICOMSIM_MAX_CHANGE_CALLBACKS];
+#endif
+	uint8_t vfoSelected;			// VFO a cui si applicano i comandi CI-V
+	bool split;						// In split la trasmissione usa l'altro VFO
+	CivParser parser;				// Stato di ricezione CI-V, uno per istanza
+	CivByteRing<ICOMSIM_TX_RING_SIZE> txRing;	// Frame in attesa di trasmissione
+#if ICOMSIM_TRACE
+	IcomSimTrace_t trace;			// Ultimi eventi CI-V, per la diagnosi sul campo
+#endif
+#if ICOMSIM_METRICS
+	uint16_t metrics[ICOMSIM_METRIC_COUNT];	// ICOMSIM_METRIC_*, aggiornati solo dal contesto di IcomSim
+#endif
+#if ICOMSIM_LATENCY
+	IcomSimLatency latency;
+	uint8_t latencySlot;			// Comando del frame in gestione (ICOMSIM_LATENCY_NO_SLOT fuori da receiveByte)
+	uint32_t latencyFrameStart;		// Arrivo del terminatore del frame in gestione
+	uint8_t latencyDrainSlot;		// Risposta di cui si attende l'uscita sulla UART
+	uint16_t latencyDrainLeft;		// Byte in coda fino alla fine di quella risposta
+	uint32_t latencyDrainStart;
+	uint32_t latencyDrainFrame;
+#endif
+#if ICOMSIM_FEATURE_RX_RING
+	CivByteRing<ICOMSIM_RX_RING_SIZE, CivRxIndex_t> rxRing;	// Byte catturati da ISR/task di ricezione
+	bool rxRingEnabled;
+	volatile uint16_t rxOverflows;	// Byte persi a ring pieno (scritto solo dal produttore)
+#endif
+	uint8_t civAddress;				// Indirizzo CI-V di questa radio
+	CivFrameSink_t frameSink;		// Se impostato sostituisce txRing
+	void* frameSinkCtx;
+	bool replyMuted;				// Frame in broadcast in corso: sendToSerial() scarta le risposte
+#if ICOMSIM_FEATURE_CAPTURE
+	IcomSimCaptureHook_t captureHook;	// Riceve ogni frame ricevuto e trasmesso (CivCapture.h)
+	void* captureCtx;
+#endif
+
+#if ICOMSIM_FEATURE_MEMORY
+	IcomSimMemory* memory;			// Banca dei canali (nullptr: comandi di memoria rispondono NG)
+	uint16_t memoryChannel;			// Canale selezionato con 0x08
+	bool memoryMode;
+#endif
+
+#if ICOMSIM_FEATURE_SNAPSHOT && ICOMSIM_FEATURE_CHANGE_API
+	IcomSimSubscriber_t snapshotSeen;	// Generazioni dell'ultima istantanea, per CIV_SNAPSHOT_CHANGED_ONLY
+	bool snapshotSynced;				// Almeno un'istantanea inviata: prima di allora "solo cambiati" e' completa
+#endif
+
+#if ICOMSIM_FEATURE_LINE_RATE
+	IcomSimLineRate lineRate;		// Velocita' della seriale (auto-baud, 7F 08)
+#endif
+
+#if ICOMSIM_FEATURE_BULK
+	IcomSimBulkTarget* bulkTargets[ICOMSIM_BULK_TARGETS];
+	typedef struct
+	{
+		uint16_t first;				// Prima unita' nel target
+		uint16_t count;				// Unita' da ricevere
+		uint16_t next;				// Prossima unita' attesa, relativa a first
+		uint8_t target;
+		uint8_t window;				// Blocchi per riscontro
+		uint8_t unacked;			// Blocchi accettati dall'ultimo riscontro
+		bool nakSent;				// Errore gia' segnalato, si attende la ritrasmissione da next
+		bool active;
+	} BulkSession_t;
+	BulkSession_t bulk;
+#endif
+
+#if ICOMSIM_FEATURE_TRANSCEIVE
+	bool transceive;				// Invio non richiesto delle modifiche locali
+	uint16_t transceiveWindow;
+	uint32_t transceiveSince;		// millis() della prima modifica non ancora inviata
+	Flags_t transceivePending;
+#endif
+
+#if ICOMSIM_FEATURE_METER
+	uint16_t rssi;					// Ultimo RSSI fornito dal firmware
+	uint16_t rssiInterval;			// Invio periodico RSSI (0 = disattivo)
+	uint8_t rssiAddress;
+	uint16_t rssiLastSent;
+	uint32_t rssiLastTime;
+	uint8_t agc;					// AGC_AUTO .. AGC_FAST
+#endif
+
+#if ICOMSIM_HANDLER_INDEX
+	uint8_t handlerIndex[256];		// Comando -> primo slot in handlers[] (CIV_NO_HANDLER se assente)
+#else
+	typedef struct
+	{
+		uint8_t command;
+		uint8_t first;
+	} HandlerHead_t;
+	HandlerHead_t heads[ICOMSIM_MAX_HANDLERS];	// Solo i comandi registrati, ricerca lineare
+	uint8_t headCount;
+#endif
+	CivHandlerSlot_t handlers[ICOMSIM_MAX_HANDLERS];
+	uint8_t handlerCount;
+
+	typedef struct
+	{
+		uint8_t command;
+		CivHandler_t fn;
+	} Builtin_t;
+	static const Builtin_t builtinHandlers[];
+
+	void receiveByte(uint8_t byte);
+	void markChanged(uint8_t vfo, uint16_t flags);
+	void dispatch(const CivFrame_t& frame);
+	void route(const CivFrame_t& frame);
+	void reject(const CivFrame_t& frame, uint8_t reason);
+	uint8_t firstHandler(uint8_t command) const;
+	uint8_t* firstHandlerLink(uint8_t command);
+#if ICOMSIM_FEATURE_TRANSCEIVE
+	void processTransceive();
+#endif
+#if ICOMSIM_FEATURE_METER
+	void processRssiStream();
+#endif
+#if ICOMSIM_LATENCY
+	inline void latencyRecord(uint8_t stage, uint32_t ticks)
+	{
+		if (latencySlot != ICOMSIM_LATENCY_NO_SLOT) latency.record(latencySlot, stage, ticks);
+	}
+	void latencyDrained(size_t written);
+#endif
+	bool canSend(uint16_t length) const { return frameSink != nullptr || txRing.space() >= length; }
+
+	static bool onGetFrequency(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetFrequency(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onGetStep(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetStep(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetMode(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#if ICOMSIM_FEATURE_SETTINGS
+	static bool onGetSquelch(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetSquelch(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onGetRfGain(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetRfGain(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetMonitor(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onGetBandwidth(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetBandwidth(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onGetTxPower(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetTxPower(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
+#if ICOMSIM_FEATURE_METER
+	static bool onGetRssi(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onGetStatus(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSetAgc(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
+#if ICOMSIM_FEATURE_VFO_AB
+	static bool onSelectVfo(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onSplit(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
+#if ICOMSIM_FEATURE_MEMORY
+	static bool onSelectMemory(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onMemoryWrite(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onMemoryToVfo(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onMemoryClear(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
+#if ICOMSIM_FEATURE_SNAPSHOT
+	static bool onSnapshot(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
+#if ICOMSIM_FEATURE_LINE_RATE
+	static bool onLineRate(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
+#if ICOMSIM_FEATURE_BULK
+	static bool onBulkBegin(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onBulkData(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onBulkEnd(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	bool sendBulkStatus(const CivFrame_t& frame, uint8_t subcommand, uint8_t status);
+#endif
+#if ICOMSIM_TRACE
+	static bool onTraceControl(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onTraceRead(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
+#if ICOMSIM_METRICS
+	static bool onMetricsRead(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onHitsRead(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+	static bool onMetricsReset(IcomSim& sim, const CivFrame_t& frame, void* ctx);
+#endif
 };
 #endif
 
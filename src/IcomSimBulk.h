@@ -0,0 +1,121 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimBulk.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Bulk transfer over CI-V: channel lists and configuration blobs uploaded in
+ * CRC-protected blocks, acknowledged once per window instead of once per frame.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - A transfer writes count fixed-size units, starting at unit first, into an
+ *   IcomSimBulkTarget attached with IcomSim::attachBulkTarget(). IcomSimChannelBulk
+ *   is the target for the memory channels (units = IcomSimMemoryRecord_t).
+ * - Protocol (COMMAND_VENDOR, payloads 7-bit packed, multi-byte values low byte first):
+ *     7F 05 target first(2) count(2) window -> 7F 05 status next(2) window units-per-block
+ *     7F 06 offset(2) units... crc(2)       -> no reply, except:
+ *                                              7F 06 status next(2) every window blocks,
+ *                                              at the end, or once on a CRC/sequence error
+ *     7F 07 [01 = abort]                    -> 7F 07 status next(2)
+ *   offset is the first unit of the block relative to first, crc is CRC-16/CCITT-FALSE
+ *   of offset and units.
+ * - The controller streams a whole window without waiting. After an error it resends
+ *   from next (go-back-N); blocks already written are ignored. If an acknowledgement
+ *   does not arrive, or the link was interrupted, sending 7F 05 again with the same
+ *   target, first and count resumes the session at next.
+ * - Units are written as soon as their block is accepted; 7F 07 calls finish() once
+ *   all count units have arrived. For channels finish() only schedules the flush: the
+ *   cache is written back and committed by process() after the reply, and the records
+ *   are already readable from the cache. A block the
+ *   target cannot take yet (channels: write cache full) is refused with CIV_BULK_BUSY
+ *   and resent from next like a lost block.
+ * - Units per block follow CIV_MAX_FRAME_SIZE, capped by the target's burst(): one
+ *   channel record with the default 32 byte frames, four with 96. extras/host/include/CivBulkClient.h is the PC side.
+ */
+
+#ifndef ICOMSIMBULK_H
+#define ICOMSIMBULK_H
+
+#include "IcomSim.h"
+
+#if ICOMSIM_FEATURE_BULK
+
+#define CIV_BULK_OK         0x00
+#define CIV_BULK_CRC        0x01	// Blocco corrotto: ritrasmettere da next
+#define CIV_BULK_SEQUENCE   0x02	// Blocco mancante: ritrasmettere da next
+#define CIV_BULK_FAILED     0x03	// Scrittura nel target fallita: sessione chiusa
+#define CIV_BULK_NO_SESSION 0x04	// Nessun trasferimento aperto
+#define CIV_BULK_INCOMPLETE 0x05	// 7F 07 prima dell'ultimo blocco: sessione ancora aperta
+#define CIV_BULK_BUSY       0x06	// Target occupato (scritture in corso): ritrasmettere da next
+
+#define CIV_BULK_TARGET_CHANNELS 0	// Identificativo consigliato per IcomSimChannelBulk
+
+#define CIV_BULK_BLOCK_OVERHEAD 4	// offset + crc
+#define CIV_BULK_RAW_MAX CIV_7BIT_RAW_SIZE(CIV_MAX_PAYLOAD - 1)	// Byte binari in un frame 7F 06
+
+// CRC-16/CCITT-FALSE, senza tabella: 256 byte di flash risparmiati su AVR
+inline uint16_t civCrc16(const uint8_t* data, uint16_t length, uint16_t crc = 0xFFFF)
+{
+	for (uint16_t i = 0; i < length; i++)
+	{
+		crc ^= (uint16_t)data[i] << 8;
+		for (uint8_t bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+// Destinazione di un trasferimento: unita' di dimensione fissa indirizzate da 0 a capacity() - 1
+class IcomSimBulkTarget
+{
+public:
+	virtual ~IcomSimBulkTarget() {}
+
+	virtual uint8_t unitSize() const = 0;
+	virtual uint16_t capacity() const = 0;
+	virtual bool write(uint16_t unit, const uint8_t* data) = 0;
+	virtual bool finish() { return true; }	// Tutte le unita' ricevute
+	virtual uint16_t room() const { return 0xFFFF; }	// Unita' scrivibili ora senza attendere il supporto
+	virtual uint16_t burst() const { return 0xFFFF; }	// Massimo di unita' per blocco
+};
+
+#if ICOMSIM_FEATURE_MEMORY
+#include "IcomSimMemory.h"
+#include <string.h>
+
+// Canali di memoria: un'unita' = un IcomSimMemoryRecord_t; marker assente = canale da cancellare
+class IcomSimChannelBulk : public IcomSimBulkTarget
+{
+public:
+	explicit IcomSimChannelBulk(IcomSimMemory& bank) : memory(bank) {}
+
+	uint8_t unitSize() const override { return ICOMSIM_MEMORY_RECORD_SIZE; }
+	uint16_t capacity() const override { return memory.getChannelCount(); }
+
+	bool write(uint16_t unit, const uint8_t* data) override
+	{
+		IcomSimMemoryRecord_t record;
+		memcpy(&record, data, sizeof(record));
+		return memory.write(unit, record);
+	}
+
+	bool finish() override { memory.scheduleFlush(); return true; }	// Scritture completate da process()
+	uint16_t room() const override { return memory.getRoom(); }
+	uint16_t burst() const override { return ICOMSIM_MEMORY_CACHE; }
+
+private:
+	IcomSimMemory& memory;
+};
+#endif
+
+#endif
+#endif
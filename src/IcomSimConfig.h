@@ -0,0 +1,156 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimConfig.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Build-time configuration of IcomSim: feature set, buffer sizes and debug output.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - ICOMSIM_PROFILE selects a set of defaults: ICOMSIM_PROFILE_FULL (everything, as in
+ *   previous releases) or ICOMSIM_PROFILE_SMALL (CAT responder for ATmega328-class
+ *   boards: frequency, step and mode only, small buffers, no debug serial).
+ * - Every value can be overridden one by one with a compiler flag (-DNAME=value, e.g.
+ *   build.extra_flags or PlatformIO build_flags) or by editing this file.
+ * - A feature set to 0 is compiled out: its code, buffers and API disappear.
+ * - extras/tools/size_report.sh and the host size_report target print the flash/RAM
+ *   cost of each profile.
+ */
+
+#ifndef ICOMSIMCONFIG_H
+#define ICOMSIMCONFIG_H
+
+#define ICOMSIM_PROFILE_FULL  0
+#define ICOMSIM_PROFILE_SMALL 1
+
+#ifndef ICOMSIM_PROFILE
+	#define ICOMSIM_PROFILE ICOMSIM_PROFILE_FULL
+#endif
+
+#if ICOMSIM_PROFILE == ICOMSIM_PROFILE_SMALL
+	#define ICOMSIM_DEFAULT_ON        0
+	#define ICOMSIM_DEFAULT_RING      32
+	#define ICOMSIM_DEFAULT_HANDLERS  8
+	#define ICOMSIM_DEFAULT_FRAME     16
+#else
+	#define ICOMSIM_DEFAULT_ON        1
+	#define ICOMSIM_DEFAULT_RING      128
+	#define ICOMSIM_DEFAULT_HANDLERS  40
+	#define ICOMSIM_DEFAULT_FRAME     32
+#endif
+
+// ---------------------------------------------------- Funzioni
+#ifndef ICOMSIM_DEBUG
+	#define ICOMSIM_DEBUG ICOMSIM_DEFAULT_ON                // SoftwareSerial di debug su A2/A3 e Debug_Print()
+#endif
+#ifndef ICOMSIM_FEATURE_SETTINGS
+	#define ICOMSIM_FEATURE_SETTINGS ICOMSIM_DEFAULT_ON     // Squelch, RF gain, monitor, banda, potenza
+#endif
+#ifndef ICOMSIM_FEATURE_METER
+	#define ICOMSIM_FEATURE_METER ICOMSIM_DEFAULT_ON        // RSSI (anche periodico), stato, AGC
+#endif
+#ifndef ICOMSIM_FEATURE_VFO_AB
+	#define ICOMSIM_FEATURE_VFO_AB ICOMSIM_DEFAULT_ON       // Comandi CI-V 0x07 e 0x0F (l'API selectVfo() resta)
+#endif
+#ifndef ICOMSIM_FEATURE_TRANSCEIVE
+	#define ICOMSIM_FEATURE_TRANSCEIVE ICOMSIM_DEFAULT_ON   // Invio non richiesto delle modifiche locali
+#endif
+#ifndef ICOMSIM_FEATURE_RX_RING
+	#define ICOMSIM_FEATURE_RX_RING ICOMSIM_DEFAULT_ON      // Ricezione da ISR/task (enableRxRing, executor)
+#endif
+#ifndef ICOMSIM_FEATURE_CHANGE_API
+	#define ICOMSIM_FEATURE_CHANGE_API ICOMSIM_DEFAULT_ON   // Generazioni, subscriber e callback di modifica
+#endif
+#ifndef ICOMSIM_FEATURE_MEMORY
+	#define ICOMSIM_FEATURE_MEMORY ICOMSIM_DEFAULT_ON       // Canali di memoria (0x08-0x0B) con IcomSimMemory
+#endif
+#ifndef ICOMSIM_FEATURE_BULK
+	#define ICOMSIM_FEATURE_BULK ICOMSIM_DEFAULT_ON         // Trasferimento a blocchi (COMMAND_VENDOR 05-07) con IcomSimBulk
+#endif
+#ifndef ICOMSIM_FEATURE_LINE_RATE
+	#define ICOMSIM_FEATURE_LINE_RATE ICOMSIM_DEFAULT_ON    // Auto-baud e cambio di velocita' concordato (COMMAND_VENDOR 08)
+#endif
+#ifndef ICOMSIM_FEATURE_SNAPSHOT
+	#define ICOMSIM_FEATURE_SNAPSHOT ICOMSIM_DEFAULT_ON     // Istantanea dei VFO in un solo scambio (COMMAND_VENDOR 09)
+#endif
+#ifndef ICOMSIM_FEATURE_CAPTURE
+	#define ICOMSIM_FEATURE_CAPTURE ICOMSIM_DEFAULT_ON      // Hook di cattura dei frame per la riproduzione (CivCapture.h)
+#endif
+#ifndef ICOMSIM_TRACE
+	#define ICOMSIM_TRACE ICOMSIM_DEFAULT_ON                // Traccia binaria del traffico CI-V, letta con COMMAND_VENDOR
+#endif
+#ifndef ICOMSIM_METRICS
+	#define ICOMSIM_METRICS ICOMSIM_DEFAULT_ON              // Contatori di funzionamento, letti con COMMAND_VENDOR
+#endif
+#ifndef ICOMSIM_LATENCY
+	#define ICOMSIM_LATENCY 0                               // Istogrammi di latenza per comando (strumento di misura, spento)
+#endif
+#ifndef ICOMSIM_HANDLER_INDEX
+	#define ICOMSIM_HANDLER_INDEX ICOMSIM_DEFAULT_ON        // Tabella comando -> gestore da 256 byte (0 = ricerca lineare)
+#endif
+
+// ---------------------------------------------------- Dimensioni
+#ifndef ICOMSIM_TX_RING_SIZE
+	#define ICOMSIM_TX_RING_SIZE ICOMSIM_DEFAULT_RING       // Byte in coda di trasmissione (potenza di 2)
+#endif
+#ifndef ICOMSIM_RX_RING_SIZE
+	#define ICOMSIM_RX_RING_SIZE ICOMSIM_DEFAULT_RING       // Byte ricevuti dall'ISR in attesa del parser (potenza di 2)
+#endif
+#ifndef ICOMSIM_MAX_HANDLERS
+	#define ICOMSIM_MAX_HANDLERS ICOMSIM_DEFAULT_HANDLERS   // Gestori registrabili (predefiniti inclusi)
+#endif
+#ifndef ICOMSIM_MAX_CHANGE_CALLBACKS
+	#define ICOMSIM_MAX_CHANGE_CALLBACKS 4                  // Callback di modifica registrabili
+#endif
+#ifndef ICOMSIM_MEMORY_CHANNELS
+	#define ICOMSIM_MEMORY_CHANNELS 100                     // Canali indirizzabili (un bit di RAM ciascuno)
+#endif
+#ifndef ICOMSIM_MEMORY_CACHE
+	#define ICOMSIM_MEMORY_CACHE 4                          // Record scritti tenuti in RAM prima del supporto
+#endif
+#ifndef ICOMSIM_MEMORY_FLUSH_MS
+	#define ICOMSIM_MEMORY_FLUSH_MS 250                     // Pausa delle scritture dopo cui la cache va nel supporto
+#endif
+#ifndef ICOMSIM_BULK_TARGETS
+	#define ICOMSIM_BULK_TARGETS 2                          // Destinazioni dei trasferimenti a blocchi
+#endif
+#ifndef ICOMSIM_RATE_CONFIRM_MS
+	#define ICOMSIM_RATE_CONFIRM_MS 2000                    // Attesa del primo frame valido dopo un cambio di velocita'
+#endif
+#ifndef ICOMSIM_AUTOBAUD_IDLE_MS
+	#define ICOMSIM_AUTOBAUD_IDLE_MS 20                     // Silenzio che chiude una raffica di byte ricevuti
+#endif
+#ifndef ICOMSIM_RATE_ERROR_LIMIT
+	#define ICOMSIM_RATE_ERROR_LIMIT 3                      // Raffiche errate consecutive che smentiscono la velocita'
+#endif
+#ifndef ICOMSIM_TRACE_SIZE
+	#define ICOMSIM_TRACE_SIZE 32                           // Eventi conservati (potenza di 2, 8 byte ciascuno)
+#endif
+#ifndef ICOMSIM_LATENCY_COMMANDS
+	#define ICOMSIM_LATENCY_COMMANDS 8                      // Comandi con istogrammi propri (gli altri sono accorpati)
+#endif
+#ifndef ICOMSIM_LATENCY_BUCKETS
+	#define ICOMSIM_LATENCY_BUCKETS 16                      // Bucket logaritmici per istogramma
+#endif
+#ifndef CIV_MAX_FRAME_SIZE
+	#define CIV_MAX_FRAME_SIZE ICOMSIM_DEFAULT_FRAME        // Dimensione massima di un frame (preambolo e terminatore inclusi)
+#endif
+
+#ifndef ICOMSIM_AUTOBAUD_BYTES
+	#define ICOMSIM_AUTOBAUD_BYTES CIV_MAX_FRAME_SIZE       // Byte senza preambolo FE FE che smentiscono la velocita'
+#endif
+
+#if CIV_MAX_FRAME_SIZE < 12
+	#error "CIV_MAX_FRAME_SIZE: servono almeno 12 byte per impostare la frequenza"
+#endif
+#endif
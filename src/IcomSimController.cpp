@@ -0,0 +1,235 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimController.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * CI-V controller (master) side with pipelined asynchronous requests.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ */
+
+#include "IcomSimController.h"
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+IcomSimController::IcomSimController(Stream& port, uint8_t address) : port(&port), address(address)
+{
+    for (uint8_t i = 0; i < ICOMSIM_CONTROLLER_MAX_PENDING; i++) requests[i].id = -1;
+    pending = 0;
+    nextId = 0;
+    timeouts = 0;
+    unsolicited = nullptr;
+    unsolicitedCtx = nullptr;
+}
+
+void IcomSimController::setUnsolicitedHandler(IcomSimReplyCallback_t callback, void* ctx)
+{
+    unsolicited = callback;
+    unsolicitedCtx = ctx;
+}
+
+// ******************************************************************************************************************************
+// Accoda il frame FE FE device address command data FD; occupa uno slot fino alla risposta o al timeout
+// ******************************************************************************************************************************
+int16_t IcomSimController::request(uint8_t device, uint8_t command, const uint8_t* data, uint8_t length, IcomSimReplyCallback_t callback,
+                                   void* ctx, uint16_t timeoutMs)
+{
+    return submit(device, command, data, length, callback, ctx, timeoutMs, false);
+}
+
+int16_t IcomSimController::requestSet(uint8_t device, uint8_t command, const uint8_t* data, uint8_t length, IcomSimReplyCallback_t callback,
+                                      void* ctx, uint16_t timeoutMs)
+{
+    return submit(device, command, data, length, callback, ctx, timeoutMs, true);
+}
+
+int16_t IcomSimController::submit(uint8_t device, uint8_t command, const uint8_t* data, uint8_t length, IcomSimReplyCallback_t callback,
+                                  void* ctx, uint16_t timeoutMs, bool expectsAck)
+{
+    if (length > CIV_MAX_PAYLOAD || txRing.space() < length + CIV_FRAME_OVERHEAD) return -1;
+    if (pending >= ICOMSIM_CONTROLLER_MAX_PENDING) return -1;
+
+    uint8_t frame[CIV_MAX_FRAME_SIZE];
+    frame[0] = CIV_START_BYTE;
+    frame[1] = CIV_START_BYTE;
+    frame[2] = device;
+    frame[3] = address;
+    frame[4] = command;
+    if (length > 0) memcpy(&frame[5], data, length);
+    frame[5 + length] = CIV_END_BYTE;
+    txRing.write(frame, (uint16_t)(length + CIV_FRAME_OVERHEAD));
+
+    int16_t id = nextId;
+    nextId = (int16_t)((nextId + 1) & 0x7FFF);
+
+    uint8_t slot = 0;
+    while (requests[slot].id >= 0) slot++;
+
+    Request_t& r = requests[slot];
+    r.callback = callback;
+    r.ctx = ctx;
+    r.sentAt = millis();
+    r.timeoutMs = timeoutMs;
+    r.id = id;
+    r.device = device;
+    r.command = command;
+    r.expectsAck = expectsAck;
+
+    pending++;
+    return id;
+}
+
+int16_t IcomSimController::getFrequency(uint8_t device, IcomSimReplyCallback_t callback, void* ctx, uint16_t timeoutMs)
+{
+    return request(device, COMMAND_GET_FREQUENCY, nullptr, 0, callback, ctx, timeoutMs);
+}
+
+int16_t IcomSimController::setFrequency(uint8_t device, uint32_t frequency, IcomSimReplyCallback_t callback, void* ctx, uint16_t timeoutMs)
+{
+    uint8_t bcd[5];
+    if (!civBcdEncode<5, ICOMSIM_CONTROLLER_SET_LAYOUT>(frequency, bcd)) return -1;
+    return requestSet(device, COMMAND_SET_FREQUENCY, bcd, sizeof(bcd), callback, ctx, timeoutMs);
+}
+
+int16_t IcomSimController::setMode(uint8_t device, uint8_t mode, IcomSimReplyCallback_t callback, void* ctx, uint16_t timeoutMs)
+{
+    return requestSet(device, COMMAND_SET_MODE, &mode, 1, callback, ctx, timeoutMs);
+}
+
+bool IcomSimController::cancel(int16_t id)
+{
+    for (uint8_t slot = 0; slot < ICOMSIM_CONTROLLER_MAX_PENDING; slot++)
+    {
+        if (id >= 0 && requests[slot].id == id)
+        {
+            complete(slot, CIV_REPLY_CANCELLED, nullptr, 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IcomSimController::decodeFrequency(const CivReply_t& reply, uint32_t& frequency)
+{
+    if (reply.status != CIV_REPLY_DATA) return false;
+    if (reply.dataLength >= 6) return civBcdDecode<6, ICOMSIM_CONTROLLER_REPLY_LAYOUT>(reply.data, frequency);
+    if (reply.dataLength == 5) return civBcdDecode<5, ICOMSIM_CONTROLLER_REPLY_LAYOUT>(reply.data, frequency);
+    return false;
+}
+
+// ******************************************************************************************************************************
+// Ricezione, scadenze e trasmissione: da chiamare ad ogni giro del loop principale
+// ******************************************************************************************************************************
+uint32_t IcomSimController::process()
+{
+    while (port->available())
+    {
+        if (parser.feed(port->read()) == CIV_PARSE_FRAME) receive(parser.frame());
+    }
+
+    uint32_t now = millis();
+    expire(now);
+    transmit();
+
+    uint32_t wait = ICOMSIM_WAIT_FOREVER;
+    if (!txRing.isEmpty()) wait = 1;                        // Seriale piena: si riprova appena si libera la FIFO
+
+    for (uint8_t slot = 0; slot < ICOMSIM_CONTROLLER_MAX_PENDING; slot++)
+    {
+        if (requests[slot].id < 0) continue;
+
+        uint32_t elapsed = now - requests[slot].sentAt;
+        uint32_t left = elapsed >= requests[slot].timeoutMs ? 1 : requests[slot].timeoutMs - elapsed;
+        if (left < wait) wait = left;
+    }
+    return wait;
+}
+
+void IcomSimController::receive(const CivFrame_t& frame)
+{
+    if (frame.addressFrom == address) return;               // Eco dei nostri frame sul bus a un filo
+
+    bool ack = frame.command == CIV_ACK_OK || frame.command == CIV_ACK_NG;
+    uint8_t match = ICOMSIM_CONTROLLER_MAX_PENDING;
+    uint16_t oldest = 0;
+
+    if (frame.addressTo == address)
+    {
+        for (uint8_t slot = 0; slot < ICOMSIM_CONTROLLER_MAX_PENDING; slot++)
+        {
+            const Request_t& r = requests[slot];
+            if (r.id < 0 || r.device != frame.addressFrom || r.expectsAck != ack) continue;
+            if (!ack && r.command != frame.command) continue;
+
+            uint16_t age = (uint16_t)((nextId - r.id) & 0x7FFF); // Le risposte arrivano nell'ordine delle richieste
+            if (age > oldest)
+            {
+                oldest = age;
+                match = slot;
+            }
+        }
+    }
+
+    if (match < ICOMSIM_CONTROLLER_MAX_PENDING)
+    {
+        CivReplyStatus_t status = frame.command == CIV_ACK_OK ? CIV_REPLY_OK : frame.command == CIV_ACK_NG ? CIV_REPLY_NG : CIV_REPLY_DATA;
+        complete(match, status, frame.data, frame.dataLength);
+    }
+    else if (unsolicited != nullptr)
+    {
+        CivReply_t reply = { CIV_REPLY_UNSOLICITED, frame.addressFrom, frame.command, frame.dataLength, frame.data, -1 };
+        unsolicited(unsolicitedCtx, reply);
+    }
+}
+
+void IcomSimController::expire(uint32_t now)
+{
+    for (uint8_t slot = 0; slot < ICOMSIM_CONTROLLER_MAX_PENDING; slot++)
+    {
+        if (requests[slot].id < 0 || now - requests[slot].sentAt < requests[slot].timeoutMs) continue;
+
+        timeouts++;
+        complete(slot, CIV_REPLY_TIMEOUT, nullptr, 0);
+    }
+}
+
+void IcomSimController::transmit()
+{
+    while (!txRing.isEmpty())
+    {
+        uint16_t length;
+        const uint8_t* chunk = txRing.peek(length);
+
+        int space = port->availableForWrite();
+        if (space <= 0) break;
+        if ((int)length > space) length = (uint16_t)space;
+
+        size_t written = port->write(chunk, length);
+        txRing.consume(written);
+
+        if (written < length) break;
+    }
+}
+
+// Lo slot si libera prima del callback, che puo' cosi' accodare subito la richiesta successiva
+void IcomSimController::complete(uint8_t slot, CivReplyStatus_t status, const uint8_t* data, uint8_t length)
+{
+    Request_t& r = requests[slot];
+    IcomSimReplyCallback_t callback = r.callback;
+    void* ctx = r.ctx;
+    CivReply_t reply = { status, r.device, r.command, length, data, r.id };
+
+    r.id = -1;
+    pending--;
+    if (callback != nullptr) callback(ctx, reply);
+}
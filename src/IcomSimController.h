@@ -0,0 +1,147 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimController.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * CI-V controller (master) side: asynchronous GET/SET requests to other Icom-protocol
+ * devices on the bus (amplifiers, tuners, other radios), with several requests in flight.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - request() queues the frame and returns at once; the callback runs from process() with
+ *   the reply, FB/FA, or a timeout. Up to ICOMSIM_CONTROLLER_MAX_PENDING requests can be
+ *   in flight: queue them all, then keep calling process() from the main loop.
+ * - A reply matches the oldest pending request with the same device address and command;
+ *   FB/FA match only the oldest pending SET (requestSet(), setFrequency(), setMode()) to
+ *   that device. Devices answer in order, so this is also correct for several requests
+ *   with the same command. A GET refused with FA ends with a timeout.
+ * - Frames that match nothing (transceive, replies after a timeout) go to the
+ *   unsolicited handler. Frames sent by our own address (echo on a single-wire bus) are
+ *   ignored.
+ * - The reply data points into the parser buffer: valid only during the callback. The
+ *   callback may issue new requests.
+ * - The timeout runs from request(), so it also covers the time spent in the queue.
+ * - Every request holds a slot until its reply or timeout, also without a callback: the
+ *   FB of a SET sent "fire and forget" cannot complete a later request.
+ * - Frequencies use the IcomSim wire layouts (CIV_BCD_RX_LAYOUT out, CIV_BCD_TX_LAYOUT
+ *   back); override ICOMSIM_CONTROLLER_SET_LAYOUT / ICOMSIM_CONTROLLER_REPLY_LAYOUT for
+ *   devices with the standard Icom layout.
+ * - Futures and C++20 coroutines on top of the callbacks: IcomSimControllerAsync.h.
+ */
+
+#ifndef ICOMSIMCONTROLLER_H
+#define ICOMSIMCONTROLLER_H
+
+#include "IcomSim.h"
+
+#ifndef ICOMSIM_CONTROLLER_MAX_PENDING
+	#define ICOMSIM_CONTROLLER_MAX_PENDING 8            // Richieste in volo
+#endif
+#ifndef ICOMSIM_CONTROLLER_TX_RING_SIZE
+	#define ICOMSIM_CONTROLLER_TX_RING_SIZE 128         // Byte in coda verso il bus (potenza di 2)
+#endif
+#ifndef ICOMSIM_CONTROLLER_TIMEOUT_MS
+	#define ICOMSIM_CONTROLLER_TIMEOUT_MS 200
+#endif
+#ifndef ICOMSIM_CONTROLLER_SET_LAYOUT
+	#define ICOMSIM_CONTROLLER_SET_LAYOUT CIV_BCD_RX_LAYOUT
+#endif
+#ifndef ICOMSIM_CONTROLLER_REPLY_LAYOUT
+	#define ICOMSIM_CONTROLLER_REPLY_LAYOUT CIV_BCD_TX_LAYOUT
+#endif
+
+typedef enum : uint8_t
+{
+	CIV_REPLY_DATA = 0,                         // Risposta con il comando ripetuto e i dati
+	CIV_REPLY_OK,                               // FB
+	CIV_REPLY_NG,                               // FA
+	CIV_REPLY_TIMEOUT,
+	CIV_REPLY_CANCELLED,
+	CIV_REPLY_UNSOLICITED,                      // Frame senza richiesta (solo per il gestore dei non richiesti)
+	CIV_REPLY_REJECTED                          // Richiesta non accodata (IcomSimControllerAsync.h)
+} CivReplyStatus_t;
+
+typedef struct
+{
+	CivReplyStatus_t status;
+	uint8_t address;                            // Dispositivo
+	uint8_t command;                            // Della richiesta (del frame per i non richiesti)
+	uint8_t dataLength;
+	const uint8_t* data;                        // Nel buffer del parser, valido solo durante il callback
+	int16_t id;                                 // Restituito da request(), -1 per i non richiesti
+} CivReply_t;
+
+typedef void (*IcomSimReplyCallback_t)(void* ctx, const CivReply_t& reply);
+
+class IcomSimController
+{
+public:
+	IcomSimController(Stream& port, uint8_t address = CIV_ADDRESS_COMPUTER);
+
+	// Identificativo della richiesta (>= 0), -1 se le richieste in volo o la coda sono piene. Il callback puo' essere nullptr.
+	// request(): la risposta ripete il comando. requestSet(): la risposta e' FB/FA.
+	int16_t request(uint8_t device, uint8_t command, const uint8_t* data, uint8_t length, IcomSimReplyCallback_t callback, void* ctx,
+	                uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS);
+	int16_t requestSet(uint8_t device, uint8_t command, const uint8_t* data, uint8_t length, IcomSimReplyCallback_t callback = nullptr,
+	                   void* ctx = nullptr, uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS);
+	int16_t getFrequency(uint8_t device, IcomSimReplyCallback_t callback, void* ctx, uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS);
+	int16_t setFrequency(uint8_t device, uint32_t frequency, IcomSimReplyCallback_t callback = nullptr, void* ctx = nullptr,
+	                     uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS);
+	int16_t setMode(uint8_t device, uint8_t mode, IcomSimReplyCallback_t callback = nullptr, void* ctx = nullptr,
+	                uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS);
+
+	bool cancel(int16_t id);                    // Il callback riceve CIV_REPLY_CANCELLED
+	void setUnsolicitedHandler(IcomSimReplyCallback_t callback, void* ctx);
+
+	// Come IcomSim::process(): ms da attendere prima della prossima chiamata, ICOMSIM_WAIT_FOREVER senza richieste
+	uint32_t process();
+
+	uint8_t getPending() const { return pending; }
+	bool canRequest(uint8_t length = 0) const { return pending < ICOMSIM_CONTROLLER_MAX_PENDING && txRing.space() >= length + CIV_FRAME_OVERHEAD; }
+	uint16_t getTimeouts() const { return timeouts; }
+
+	static bool decodeFrequency(const CivReply_t& reply, uint32_t& frequency);
+
+private:
+	typedef struct
+	{
+		IcomSimReplyCallback_t callback;        // Puo' essere nullptr
+		void* ctx;
+		uint32_t sentAt;
+		uint16_t timeoutMs;
+		int16_t id;                             // -1: slot libero
+		uint8_t device;
+		uint8_t command;
+		bool expectsAck;                        // SET: completata solo da FB/FA
+	} Request_t;
+
+	Stream* port;
+	uint8_t address;
+	CivParser parser;
+	CivByteRing<ICOMSIM_CONTROLLER_TX_RING_SIZE> txRing;
+	Request_t requests[ICOMSIM_CONTROLLER_MAX_PENDING];
+	uint8_t pending;
+	int16_t nextId;
+	uint16_t timeouts;
+
+	IcomSimReplyCallback_t unsolicited;
+	void* unsolicitedCtx;
+
+	int16_t submit(uint8_t device, uint8_t command, const uint8_t* data, uint8_t length, IcomSimReplyCallback_t callback, void* ctx,
+	               uint16_t timeoutMs, bool expectsAck);
+	void receive(const CivFrame_t& frame);
+	void expire(uint32_t now);
+	void transmit();
+	void complete(uint8_t slot, CivReplyStatus_t status, const uint8_t* data, uint8_t length);
+};
+#endif
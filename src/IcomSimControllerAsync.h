@@ -0,0 +1,190 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimControllerAsync.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Futures and C++20 coroutine awaitables on top of IcomSimController (ESP32 and host).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - civRequestFuture(): the reply (or FB/FA, timeout) is copied into the future's value.
+ *   civRequestSetFuture() / civRequestSetAwait() go through requestSet(): use them for
+ *   commands answered with FB/FA, the plain versions only match replies that repeat the
+ *   command.
+ *   The future becomes ready inside controller.process(): another task can block on it,
+ *   the loop driving process() must only poll it (wait_for(0)). A request that cannot
+ *   be queued gives a future that is ready at once with CIV_REPLY_REJECTED.
+ * - co_await civRequestAwait(...) inside an IcomSimTask coroutine: the coroutine resumes
+ *   from controller.process() when the reply arrives, and can issue the next request
+ *   right away. Available when the compiler supports coroutines (C++20: host, ESP32
+ *   Arduino core 3.x).
+ * - Requests are issued from the thread/task that calls process(): the controller has
+ *   no locking.
+ */
+
+#ifndef ICOMSIMCONTROLLERASYNC_H
+#define ICOMSIMCONTROLLERASYNC_H
+
+#include "IcomSimController.h"
+
+#if defined(ESP32) || defined(ICOMSIM_HOST)
+
+#include <future>
+#include <stdlib.h>
+#include <string.h>
+
+// Copia della risposta, valida anche dopo il callback
+struct CivAsyncReply
+{
+	CivReplyStatus_t status;
+	uint8_t address;
+	uint8_t command;
+	uint8_t dataLength;
+	uint8_t data[CIV_MAX_PAYLOAD];
+	int16_t id;
+
+	void assign(const CivReply_t& reply)
+	{
+		status = reply.status;
+		address = reply.address;
+		command = reply.command;
+		dataLength = reply.dataLength;
+		if (reply.dataLength > 0) memcpy(data, reply.data, reply.dataLength);
+		id = reply.id;
+	}
+
+	bool frequency(uint32_t& value) const
+	{
+		CivReply_t view = { status, address, command, dataLength, data, id };
+		return IcomSimController::decodeFrequency(view, value);
+	}
+};
+
+inline std::future<CivAsyncReply> civSubmitFuture(IcomSimController& controller, uint8_t device, uint8_t command, const uint8_t* data,
+                                                  uint8_t length, uint16_t timeoutMs, bool set)
+{
+	struct Holder
+	{
+		static void complete(void* ctx, const CivReply_t& reply)
+		{
+			std::promise<CivAsyncReply>* promise = static_cast<std::promise<CivAsyncReply>*>(ctx);
+			CivAsyncReply value;
+			value.assign(reply);
+			promise->set_value(value);
+			delete promise;
+		}
+	};
+
+	std::promise<CivAsyncReply>* promise = new std::promise<CivAsyncReply>();
+	std::future<CivAsyncReply> future = promise->get_future();
+
+	int16_t id = set ? controller.requestSet(device, command, data, length, &Holder::complete, promise, timeoutMs)
+	                 : controller.request(device, command, data, length, &Holder::complete, promise, timeoutMs);
+	if (id < 0)
+	{
+		CivReply_t rejected = { CIV_REPLY_REJECTED, device, command, 0, nullptr, -1 };
+		Holder::complete(promise, rejected);
+	}
+	return future;
+}
+
+inline std::future<CivAsyncReply> civRequestFuture(IcomSimController& controller, uint8_t device, uint8_t command, const uint8_t* data = nullptr,
+                                                   uint8_t length = 0, uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS)
+{
+	return civSubmitFuture(controller, device, command, data, length, timeoutMs, false);
+}
+
+inline std::future<CivAsyncReply> civRequestSetFuture(IcomSimController& controller, uint8_t device, uint8_t command, const uint8_t* data,
+                                                      uint8_t length, uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS)
+{
+	return civSubmitFuture(controller, device, command, data, length, timeoutMs, true);
+}
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+
+// Coroutine senza valore di ritorno, avviata subito e distrutta alla fine
+struct IcomSimTask
+{
+	struct promise_type
+	{
+		IcomSimTask get_return_object() { return IcomSimTask(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { abort(); }
+	};
+};
+
+class CivReplyAwaitable
+{
+public:
+	CivReplyAwaitable(IcomSimController& controller, uint8_t device, uint8_t command, const uint8_t* data, uint8_t length, uint16_t timeoutMs,
+	                  bool set = false)
+		: controller(controller), device(device), command(command), length(length), timeoutMs(timeoutMs), set(set)
+	{
+		if (length > 0 && length <= CIV_MAX_PAYLOAD) memcpy(payload, data, length);   // Oltre: rifiutata da request()
+	}
+
+	bool await_ready() const { return false; }
+
+	// false: richiesta rifiutata, la coroutine prosegue subito con CIV_REPLY_REJECTED
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		waiting = handle;
+		int16_t id = set ? controller.requestSet(device, command, payload, length, &CivReplyAwaitable::complete, this, timeoutMs)
+		                 : controller.request(device, command, payload, length, &CivReplyAwaitable::complete, this, timeoutMs);
+		if (id >= 0) return true;
+
+		CivReply_t rejected = { CIV_REPLY_REJECTED, device, command, 0, nullptr, -1 };
+		reply.assign(rejected);
+		return false;
+	}
+
+	CivAsyncReply await_resume() const { return reply; }
+
+private:
+	IcomSimController& controller;
+	uint8_t device;
+	uint8_t command;
+	uint8_t length;
+	uint16_t timeoutMs;
+	bool set;                                   // requestSet(): risposta FB/FA
+	uint8_t payload[CIV_MAX_PAYLOAD];
+	CivAsyncReply reply;
+	std::coroutine_handle<> waiting;
+
+	static void complete(void* ctx, const CivReply_t& r)
+	{
+		CivReplyAwaitable* self = static_cast<CivReplyAwaitable*>(ctx);
+		self->reply.assign(r);
+		self->waiting.resume();
+	}
+};
+
+inline CivReplyAwaitable civRequestAwait(IcomSimController& controller, uint8_t device, uint8_t command, const uint8_t* data = nullptr,
+                                         uint8_t length = 0, uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS)
+{
+	return CivReplyAwaitable(controller, device, command, data, length, timeoutMs);
+}
+
+inline CivReplyAwaitable civRequestSetAwait(IcomSimController& controller, uint8_t device, uint8_t command, const uint8_t* data, uint8_t length,
+                                            uint16_t timeoutMs = ICOMSIM_CONTROLLER_TIMEOUT_MS)
+{
+	return CivReplyAwaitable(controller, device, command, data, length, timeoutMs, true);
+}
+
+#endif
+#endif
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimEepromStore.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * IcomSimMemoryStore on the Arduino EEPROM library (AVR EEPROM, ESP32 flash emulation).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - Include it only in the sketch that uses it, so EEPROM is linked only when needed:
+ *     IcomSimEepromStore eeprom(0, 60);       // 60 channels from address 0 (960 bytes)
+ *     IcomSimMemory memory(eeprom);
+ *     eeprom.begin(); memory.begin(); radio.attachMemory(&memory);
+ * - Each channel takes ICOMSIM_MEMORY_RECORD_SIZE (16) bytes: the ATmega328 (1 KB
+ *   EEPROM) holds at most 64 channels, the ATmega2560 (4 KB) 256. begin() returns
+ *   false when base + channels * 16 exceeds EEPROM.length().
+ * - EEPROM.put() rewrites only the bytes that changed, so storing an unchanged
+ *   channel costs no erase cycle on AVR.
+ * - On ESP32 writes go to the RAM copy of the emulated EEPROM; commit(), called by
+ *   IcomSimMemory once its cache is empty, writes the flash sector once per burst.
+ */
+
+#ifndef ICOMSIMEEPROMSTORE_H
+#define ICOMSIMEEPROMSTORE_H
+
+#include "IcomSimMemory.h"
+
+#if ICOMSIM_FEATURE_MEMORY
+
+#include <EEPROM.h>
+
+class IcomSimEepromStore : public IcomSimMemoryStore
+{
+public:
+	IcomSimEepromStore(uint16_t baseAddress, uint16_t channels) : base(baseAddress), channels(channels) {}
+
+	bool begin()
+	{
+#ifdef ESP32
+		return EEPROM.begin(base + channels * ICOMSIM_MEMORY_RECORD_SIZE);
+#else
+		return (uint32_t)base + channels * ICOMSIM_MEMORY_RECORD_SIZE <= EEPROM.length();
+#endif
+	}
+
+	uint16_t capacity() const override { return channels; }
+
+	bool read(uint16_t slot, IcomSimMemoryRecord_t& record) override
+	{
+		if (slot >= channels) return false;
+		EEPROM.get(base + slot * ICOMSIM_MEMORY_RECORD_SIZE, record);
+		return true;
+	}
+
+	bool write(uint16_t slot, const IcomSimMemoryRecord_t& record) override
+	{
+		if (slot >= channels) return false;
+		EEPROM.put(base + slot * ICOMSIM_MEMORY_RECORD_SIZE, record);
+		return true;
+	}
+
+	bool commit() override
+	{
+#ifdef ESP32
+		return EEPROM.commit();
+#else
+		return true;
+#endif
+	}
+
+private:
+	uint16_t base;
+	uint16_t channels;
+};
+
+#endif
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimExecutor.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Event-driven mode: IcomSim runs in its own task/thread instead of being polled from loop().
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - The executor sleeps until notify() reports received bytes (or a local change), runs
+ *   IcomSim::process() at once and goes back to sleep until the next event or deadline.
+ * - Changes made by CI-V commands are posted to a queue read with waitChange(), so the
+ *   application does not need to poll isChanged().
+ * - While the executor runs, VfoData_t and the IcomSim setters belong to it: the
+ *   application must hold an IcomSimLock while it reads or writes them.
+ * - Backends: IcomSimRtosExecutor (FreeRTOS, ESP32) in src, IcomSimThreadExecutor
+ *   (std::thread) in extras/host for Linux.
+ */
+
+#ifndef ICOMSIMEXECUTOR_H
+#define ICOMSIMEXECUTOR_H
+
+#include "IcomSim.h"
+
+#define ICOMSIM_EVENT_RX     0x01       // Byte nel ring di ricezione
+#define ICOMSIM_EVENT_TX     0x02       // Spazio libero nella FIFO di trasmissione
+#define ICOMSIM_EVENT_LOCAL  0x04       // Il firmware ha modificato lo stato (transceive, RSSI, ...)
+#define ICOMSIM_EVENT_STOP   0x80       // Uso interno: termina l'executor
+
+#define ICOMSIM_CHANGE_QUEUE_SIZE 8     // Notifiche di modifica in attesa dell'applicazione
+
+// Modifiche di un gruppo di flag: vfo = ICOMSIM_VFO_A, ICOMSIM_VFO_B o ICOMSIM_RADIO_FLAGS
+typedef struct
+{
+	uint8_t vfo;
+	uint16_t flags;
+} IcomSimChange_t;
+
+class IcomSimExecutor
+{
+public:
+	explicit IcomSimExecutor(IcomSim& sim) : sim(sim) { memset(pending, 0, sizeof(pending)); }
+	virtual ~IcomSimExecutor() {}
+
+	virtual bool start() = 0;
+	virtual void stop() = 0;
+	virtual void notify(uint8_t events) = 0;
+
+	// Accesso esclusivo a VfoData_t e allo stato di IcomSim
+	virtual void lock() = 0;
+	virtual void unlock() = 0;
+
+	// Prossima modifica fatta dal controller CI-V; false allo scadere di timeoutMs
+	virtual bool waitChange(IcomSimChange_t& change, uint32_t timeoutMs) = 0;
+
+protected:
+	virtual bool postChange(const IcomSimChange_t& change) = 0;
+
+	// Un giro dell'executor, comune a tutti i backend: restituisce l'attesa prima del giro successivo
+	uint32_t runOnce()
+	{
+		lock();
+		uint32_t wait = sim.process();
+
+		for (uint8_t i = 0; i <= ICOMSIM_RADIO_FLAGS; i++)
+		{
+			// Con la coda piena le modifiche si accumulano qui e partono al giro successivo: nessuna va persa
+			pending[i] |= sim.isChanged(i);
+			if (pending[i] == 0) continue;
+
+			IcomSimChange_t change = { i, pending[i] };
+			if (postChange(change)) pending[i] = 0;
+			else if (wait > 1) wait = 1;
+		}
+		unlock();
+		return wait;
+	}
+
+	IcomSim& sim;
+
+private:
+	uint16_t pending[ICOMSIM_RADIO_FLAGS + 1];
+};
+
+// ******************************************************************************************************************************
+// Sezione critica sui dati condivisi. Al rilascio l'executor viene svegliato, cosi' le modifiche locali
+// (notifyLocalChange, setRssi, ...) vengono servite subito.
+// ******************************************************************************************************************************
+class IcomSimLock
+{
+public:
+	explicit IcomSimLock(IcomSimExecutor& executor) : executor(executor) { executor.lock(); }
+	~IcomSimLock()
+	{
+		executor.unlock();
+		executor.notify(ICOMSIM_EVENT_LOCAL);
+	}
+
+private:
+	IcomSimLock(const IcomSimLock&);
+	IcomSimLock& operator=(const IcomSimLock&);
+
+	IcomSimExecutor& executor;
+};
+#endif
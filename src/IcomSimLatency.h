@@ -0,0 +1,158 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimLatency.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Per-command latency histograms of the CI-V request/response path (ICOMSIM_LATENCY).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - Stages, timed from the byte that completes the frame (0xFD):
+ *     PARSE     parser.feed() of the terminator
+ *     DISPATCH  handler lookup
+ *     HANDLER   handler call, reply formatting and enqueue included
+ *     ENQUEUE   sendToSerial() of the reply
+ *     DRAIN     from enqueue until the last reply byte is handed to the UART
+ *     TOTAL     from the terminator until the last reply byte is handed to the UART
+ * - Time source (ICOMSIM_CYCLES): CPU cycle counter on ESP32 (CCOUNT), rdtsc on x86
+ *   hosts, steady_clock nanoseconds on other hosts, micros() everywhere else.
+ * - Bucket b counts samples in [2^(b-1), 2^b) units of 2^ICOMSIM_LATENCY_SHIFT ticks,
+ *   bucket 0 counts the samples below one unit, the last bucket is open ended.
+ * - With ICOMSIM_LATENCY 0 (the default) the hooks expand to nothing.
+ */
+
+#ifndef ICOMSIMLATENCY_H
+#define ICOMSIMLATENCY_H
+
+#include "IcomSimConfig.h"
+
+#if ICOMSIM_LATENCY
+
+#include <Arduino.h>
+#include <string.h>
+
+#if defined(ESP32)
+	#define ICOMSIM_CYCLES()      ((uint32_t)ESP.getCycleCount())
+	#define ICOMSIM_CYCLES_UNIT   "cycles"
+	#define ICOMSIM_CYCLES_SHIFT  6
+#elif defined(ICOMSIM_HOST) && (defined(__x86_64__) || defined(__i386__))
+	#include <x86intrin.h>
+	#define ICOMSIM_CYCLES()      ((uint32_t)__rdtsc())
+	#define ICOMSIM_CYCLES_UNIT   "cycles"
+	#define ICOMSIM_CYCLES_SHIFT  6
+#elif defined(ICOMSIM_HOST)
+	#include <chrono>
+	#define ICOMSIM_CYCLES()      ((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>( \
+	                                  std::chrono::steady_clock::now().time_since_epoch()).count())
+	#define ICOMSIM_CYCLES_UNIT   "ns"
+	#define ICOMSIM_CYCLES_SHIFT  5
+#else
+	#define ICOMSIM_CYCLES()      ((uint32_t)micros())
+	#define ICOMSIM_CYCLES_UNIT   "us"
+	#define ICOMSIM_CYCLES_SHIFT  0
+#endif
+
+#ifndef ICOMSIM_LATENCY_SHIFT
+	#define ICOMSIM_LATENCY_SHIFT ICOMSIM_CYCLES_SHIFT
+#endif
+
+#define ICOMSIM_LATENCY_PARSE    0
+#define ICOMSIM_LATENCY_DISPATCH 1
+#define ICOMSIM_LATENCY_HANDLER  2
+#define ICOMSIM_LATENCY_ENQUEUE  3
+#define ICOMSIM_LATENCY_DRAIN    4
+#define ICOMSIM_LATENCY_TOTAL    5
+#define ICOMSIM_LATENCY_STAGES   6
+
+#define ICOMSIM_LATENCY_NO_SLOT  0xFF
+
+typedef struct
+{
+	uint16_t bucket[ICOMSIM_LATENCY_BUCKETS];
+	uint32_t max;                       // Campione piu' lungo, in tick di ICOMSIM_CYCLES()
+} IcomSimHistogram_t;
+
+class IcomSimLatency
+{
+public:
+	IcomSimLatency() { reset(); }
+
+	void reset()
+	{
+		memset(commands, 0, sizeof(commands));
+		memset(histograms, 0, sizeof(histograms));
+		used = 0;
+	}
+
+	// Slot del comando; i comandi oltre ICOMSIM_LATENCY_COMMANDS finiscono nell'ultimo slot ("altri")
+	uint8_t slotFor(uint8_t command)
+	{
+		for (uint8_t i = 0; i < used; i++)
+		{
+			if (commands[i] == command) return i;
+		}
+		if (used < ICOMSIM_LATENCY_COMMANDS)
+		{
+			commands[used] = command;
+			return used++;
+		}
+		return ICOMSIM_LATENCY_COMMANDS;
+	}
+
+	inline void record(uint8_t slot, uint8_t stage, uint32_t ticks)
+	{
+		IcomSimHistogram_t& h = histograms[slot][stage];
+		uint16_t& count = h.bucket[bucketOf(ticks)];
+
+		if (count != 0xFFFF) count++;
+		if (ticks > h.max) h.max = ticks;
+	}
+
+	uint8_t getCommandCount() const { return used; }
+	uint8_t getCommand(uint8_t slot) const { return commands[slot]; }
+
+	// slot == getCommandCount() .. ICOMSIM_LATENCY_COMMANDS: comandi non tracciati singolarmente
+	const IcomSimHistogram_t& getHistogram(uint8_t slot, uint8_t stage) const { return histograms[slot][stage]; }
+
+	// Limite superiore (escluso) del bucket, in tick
+	static uint32_t bucketLimit(uint8_t bucket) { return (uint32_t)1 << (bucket + ICOMSIM_LATENCY_SHIFT); }
+
+	static inline uint8_t bucketOf(uint32_t ticks)
+	{
+		ticks >>= ICOMSIM_LATENCY_SHIFT;
+
+		uint8_t b = 0;
+		if (ticks >= 0x10000UL) { ticks >>= 16; b += 16; }
+		if (ticks >= 0x100)     { ticks >>= 8;  b += 8; }
+		if (ticks >= 0x10)      { ticks >>= 4;  b += 4; }
+		if (ticks >= 0x4)       { ticks >>= 2;  b += 2; }
+		if (ticks >= 0x2)       { ticks >>= 1;  b += 1; }
+		b += (uint8_t)ticks;    // 0 -> bucket 0, 1 -> bucket 1, 2..3 -> bucket 2, ...
+
+		return b < ICOMSIM_LATENCY_BUCKETS ? b : ICOMSIM_LATENCY_BUCKETS - 1;
+	}
+
+private:
+	uint8_t commands[ICOMSIM_LATENCY_COMMANDS];
+	uint8_t used;
+	IcomSimHistogram_t histograms[ICOMSIM_LATENCY_COMMANDS + 1][ICOMSIM_LATENCY_STAGES];
+};
+
+// Dentro IcomSim: il campione va al comando del frame in gestione (latencySlot)
+#define ICOMSIM_LATENCY_MARK(var)            uint32_t var = ICOMSIM_CYCLES()
+#define ICOMSIM_LATENCY_RECORD(stage, start) latencyRecord(stage, ICOMSIM_CYCLES() - (start))
+#else
+#define ICOMSIM_LATENCY_MARK(var)            do {} while (0)
+#define ICOMSIM_LATENCY_RECORD(stage, start) do {} while (0)
+#endif
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimLineRate.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Auto-baud detection and negotiated rate changes of the CI-V port.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ */
+
+#include "IcomSim.h"
+#include "IcomSimLineRate.h"
+
+#if ICOMSIM_FEATURE_LINE_RATE
+
+// Velocita' provate dall'auto-baud, nell'ordine; le stesse accettate da 7F 08
+static const uint32_t candidateRates[] = { 4800, 9600, 19200, 38400, 57600, 115200 };
+#define CANDIDATE_COUNT (sizeof(candidateRates) / sizeof(candidateRates[0]))
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+IcomSimLineRate::IcomSimLineRate()
+{
+    hook = nullptr;
+    hookCtx = nullptr;
+    rate = base = previous = pending = 0;
+    since = 0;
+    lastTime = 0;
+    garbage = 0;
+    changes = 0;
+    errors = 0;
+    state = ICOMSIM_RATE_LOCKED;
+    lastByte = 0;
+    autoBaud = false;
+    dirty = false;
+    negotiated = false;
+}
+
+void IcomSimLineRate::begin(IcomSimLineRateHook_t fn, void* ctx, uint32_t baud)
+{
+    hook = fn;
+    hookCtx = ctx;
+    rate = base = previous = baud;
+    negotiated = false;
+    garbage = 0;
+    errors = 0;
+    state = autoBaud ? ICOMSIM_RATE_HUNTING : ICOMSIM_RATE_LOCKED;
+}
+
+// L'auto-baud parte in ricerca: la velocita' attuale resta finche' non arrivano byte che la smentiscono
+void IcomSimLineRate::setAutoBaud(bool enable)
+{
+    autoBaud = enable && hook != nullptr;
+    if (state == ICOMSIM_RATE_LOCKED || state == ICOMSIM_RATE_HUNTING)
+    {
+        state = autoBaud ? ICOMSIM_RATE_HUNTING : ICOMSIM_RATE_LOCKED;
+    }
+}
+
+bool IcomSimLineRate::isSupported(uint32_t baud)
+{
+    for (uint8_t i = 0; i < CANDIDATE_COUNT; i++)
+    {
+        if (candidateRates[i] == baud) return true;
+    }
+    return false;
+}
+
+// ******************************************************************************************************************************
+// Cambio concordato: applicato da process() quando l'ACK ha lasciato la coda di trasmissione
+// ******************************************************************************************************************************
+bool IcomSimLineRate::request(uint32_t baud)
+{
+    if (hook == nullptr || !isSupported(baud)) return false;
+
+    pending = baud;
+    state = ICOMSIM_RATE_SWITCHING;
+    return true;
+}
+
+bool IcomSimLineRate::apply(uint32_t baud)
+{
+    garbage = 0;
+    errors = 0;
+    if (baud == rate) return true;
+    if (!hook(hookCtx, baud)) return false;
+
+    rate = baud;
+    changes++;
+    return true;
+}
+
+// ******************************************************************************************************************************
+// Ricezione: il preambolo FE FE azzera il conteggio dei byte inutili, il frame valido conferma la velocita'
+// ******************************************************************************************************************************
+void IcomSimLineRate::onByte(uint8_t byte)
+{
+    if (byte == 0xFE && lastByte == 0xFE) garbage = 0;
+    else if (garbage < 0xFFFF) garbage++;
+    lastByte = byte;
+    lastTime = millis();
+    dirty = true;
+
+    if (garbage >= ICOMSIM_AUTOBAUD_BYTES) degrade();
+}
+
+void IcomSimLineRate::onFrame()
+{
+    dirty = false;
+    garbage = 0;
+    errors = 0;
+
+    if (state == ICOMSIM_RATE_HUNTING)
+    {
+        base = rate;                                        // Trovata: diventa la velocita' di ripiego
+        negotiated = false;
+        state = ICOMSIM_RATE_LOCKED;
+    }
+    else if (state == ICOMSIM_RATE_PROBATION)
+    {
+        negotiated = true;
+        state = ICOMSIM_RATE_LOCKED;
+    }
+}
+
+void IcomSimLineRate::onError()
+{
+    dirty = false;
+    if (++errors >= ICOMSIM_RATE_ERROR_LIMIT) degrade();
+}
+
+// Ricezione inaffidabile alla velocita' attuale
+void IcomSimLineRate::degrade()
+{
+    switch (state)
+    {
+        case ICOMSIM_RATE_PROBATION:                        // Il controller non ha seguito il cambio
+            state = ICOMSIM_RATE_LOCKED;
+            apply(previous);
+            break;
+
+        case ICOMSIM_RATE_LOCKED:
+            if (negotiated)                                 // Velocita' concordata che non regge piu'
+            {
+                negotiated = false;
+                apply(base);
+                break;
+            }
+            if (!autoBaud)
+            {
+                garbage = 0;
+                errors = 0;
+                break;
+            }
+            state = ICOMSIM_RATE_HUNTING;
+            // fallthrough
+
+        case ICOMSIM_RATE_HUNTING:
+        {
+            uint8_t i = 0;
+            while (i < CANDIDATE_COUNT && candidateRates[i] != rate) i++;
+            apply(candidateRates[i >= CANDIDATE_COUNT - 1 ? 0 : i + 1]);
+            break;
+        }
+
+        default:                                            // ICOMSIM_RATE_SWITCHING: si decide dopo il cambio
+            garbage = 0;
+            errors = 0;
+            break;
+    }
+}
+
+// ******************************************************************************************************************************
+// Dal loop: applica il cambio concordato e chiude la prova scaduta
+// ******************************************************************************************************************************
+uint32_t IcomSimLineRate::process(bool txIdle)
+{
+    if (dirty && millis() - lastTime >= ICOMSIM_AUTOBAUD_IDLE_MS) onError();  // Raffica finita senza un frame valido
+
+    if (state == ICOMSIM_RATE_SWITCHING && txIdle)
+    {
+        previous = rate;
+        state = ICOMSIM_RATE_PROBATION;
+        since = millis();
+        if (!apply(pending)) state = ICOMSIM_RATE_LOCKED;
+    }
+    else if (state == ICOMSIM_RATE_PROBATION && millis() - since >= ICOMSIM_RATE_CONFIRM_MS)
+    {
+        degrade();
+    }
+    return getDelay();
+}
+
+uint32_t IcomSimLineRate::getDelay() const
+{
+    if (state == ICOMSIM_RATE_SWITCHING) return 1;          // Si attende lo svuotamento della coda
+
+    uint32_t wait = ICOMSIM_WAIT_FOREVER;
+    uint32_t now = millis();
+
+    if (dirty)
+    {
+        uint32_t elapsed = now - lastTime;
+        wait = elapsed >= ICOMSIM_AUTOBAUD_IDLE_MS ? 0 : ICOMSIM_AUTOBAUD_IDLE_MS - elapsed;
+    }
+    if (state == ICOMSIM_RATE_PROBATION)
+    {
+        uint32_t elapsed = now - since;
+        uint32_t left = elapsed >= ICOMSIM_RATE_CONFIRM_MS ? 0 : ICOMSIM_RATE_CONFIRM_MS - elapsed;
+        if (left < wait) wait = left;
+    }
+    return wait;
+}
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimLineRate.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Line rate of the CI-V port: auto-baud detection on the FE FE preamble and rate
+ * changes negotiated by the controller (7F 08), with fallback when reception degrades.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - IcomSim never touches the UART settings itself: the sketch passes a hook that
+ *   changes the baud rate of its Stream, e.g. on ESP32
+ *     bool setRate(void*, uint32_t baud) { Serial2.flush(); Serial2.updateBaudRate(baud); return true; }
+ *     radio.getLineRate().begin(setRate, nullptr, 9600);
+ *   The hook must let the bytes already in the UART FIFO out first (flush()).
+ * - Reception is judged on what the parser sees: a valid frame confirms the rate;
+ *   ICOMSIM_AUTOBAUD_BYTES bytes without a FE FE preamble, or ICOMSIM_RATE_ERROR_LIMIT
+ *   bursts in a row that end in a parse error or in ICOMSIM_AUTOBAUD_IDLE_MS of silence
+ *   without a valid frame, mean the rate is wrong.
+ * - Auto-baud (setAutoBaud(true)) then tries the next of 4800..115200; the first
+ *   valid frame locks the rate, which becomes the base rate.
+ * - 7F 08 <baud, 4 bytes 7-bit packed> asks for a new rate: the ACK goes out at the
+ *   current rate, then the rate changes and the controller must send a valid frame
+ *   within ICOMSIM_RATE_CONFIRM_MS, otherwise the radio returns to the previous rate.
+ *   A negotiated rate that later degrades falls back to the base rate. A controller
+ *   that gets no replies should do the same and negotiate again.
+ * - 7F 08 without data returns rate (4), base rate (4), state, auto-baud flag.
+ */
+
+#ifndef ICOMSIMLINERATE_H
+#define ICOMSIMLINERATE_H
+
+#include <stdint.h>
+#include "IcomSimConfig.h"
+
+#if ICOMSIM_FEATURE_LINE_RATE
+
+#define ICOMSIM_RATE_LOCKED    0	// Velocita' confermata da frame validi
+#define ICOMSIM_RATE_HUNTING   1	// Auto-baud: si provano le velocita' candidate
+#define ICOMSIM_RATE_SWITCHING 2	// Cambio concordato, si attende che l'ACK sia uscito
+#define ICOMSIM_RATE_PROBATION 3	// Nuova velocita' applicata, si attende il primo frame valido
+
+// Cambia la velocita' della seriale di IcomSim; false se la velocita' non e' applicabile
+typedef bool (*IcomSimLineRateHook_t)(void* ctx, uint32_t baud);
+
+class IcomSimLineRate
+{
+public:
+	IcomSimLineRate();
+
+	void begin(IcomSimLineRateHook_t fn, void* ctx, uint32_t baud);	// baud = velocita' gia' impostata dallo sketch
+	void setAutoBaud(bool enable);
+	bool isAutoBaud() const { return autoBaud; }
+
+	uint32_t getRate() const { return rate; }
+	uint32_t getBaseRate() const { return base; }
+	uint8_t getState() const { return state; }
+	uint16_t getChanges() const { return changes; }		// Cambi di velocita' applicati dall'avvio
+
+	bool request(uint32_t baud);							// Cambio chiesto dal controller
+	static bool isSupported(uint32_t baud);
+
+	// Eventi di ricezione, dal contesto di IcomSim
+	void onByte(uint8_t byte);
+	void onFrame();
+	void onError();
+
+	uint32_t process(bool txIdle);							// ms al prossimo controllo, ICOMSIM_WAIT_FOREVER se nessuno
+	uint32_t getDelay() const;
+
+private:
+	IcomSimLineRateHook_t hook;
+	void* hookCtx;
+	uint32_t rate;					// Velocita' attuale
+	uint32_t base;					// Impostata dallo sketch o trovata dall'auto-baud
+	uint32_t previous;				// Velocita' prima del cambio in prova
+	uint32_t pending;				// Velocita' concordata, applicata a trasmissione vuota
+	uint32_t since;					// millis() dell'inizio della prova
+	uint32_t lastTime;				// millis() dell'ultimo byte ricevuto
+	uint16_t garbage;				// Byte dall'ultimo preambolo o frame valido
+	uint16_t changes;
+	uint8_t errors;					// Raffiche finite in errore dall'ultimo frame valido
+	uint8_t state;
+	uint8_t lastByte;
+	bool autoBaud;
+	bool dirty;						// Byte ricevuti che non hanno ancora formato un frame valido
+	bool negotiated;				// La velocita' attuale viene da 7F 08
+
+	bool apply(uint32_t baud);
+	void degrade();
+};
+
+#endif
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimMemory.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Memory channel bank behind the CI-V memory commands.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ */
+
+#include "IcomSimMemory.h"
+
+#if ICOMSIM_FEATURE_MEMORY
+
+#include <string.h>
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+IcomSimMemory::IcomSimMemory(IcomSimMemoryStore& store) : backing(store)
+{
+    channelCount = 0;
+    memset(used, 0, sizeof(used));
+    cacheCount = 0;
+    lastWrite = 0;
+    commitPending = false;
+    flushScheduled = false;
+}
+
+// Costruisce l'indice leggendo una volta tutto il supporto
+bool IcomSimMemory::begin()
+{
+    channelCount = backing.capacity() < ICOMSIM_MEMORY_CHANNELS ? backing.capacity() : ICOMSIM_MEMORY_CHANNELS;
+    memset(used, 0, sizeof(used));
+    cacheCount = 0;
+
+    for (uint16_t channel = 0; channel < channelCount; channel++)
+    {
+        IcomSimMemoryRecord_t record;
+        if (!backing.read(channel, record)) return false;
+        markUsed(channel, isValid(record));
+    }
+    return true;
+}
+
+// ******************************************************************************************************************************
+// Formato del record
+// ******************************************************************************************************************************
+static uint8_t recordCheck(const IcomSimMemoryRecord_t& record)
+{
+    const uint8_t* p = (const uint8_t*)&record;
+    uint8_t sum = 0;
+
+    for (uint8_t i = 0; i < ICOMSIM_MEMORY_RECORD_SIZE - 1; i++) sum += p[i];
+    return (uint8_t)~sum;
+}
+
+void IcomSimMemory::encode(const VfoData_t& vfo, IcomSimMemoryRecord_t& record)
+{
+    record.frequency = vfo.Frequency;
+    record.step = vfo.Step;
+    record.mode = (uint8_t)vfo.Mode;
+    record.bw = (uint8_t)vfo.bw;
+    record.sql = vfo.Sql;
+    record.gain = vfo.Gain;
+    record.txp = vfo.txp;
+    record.reserved = 0;
+    record.marker = ICOMSIM_MEMORY_MARKER;
+    record.check = recordCheck(record);
+}
+
+void IcomSimMemory::decode(const IcomSimMemoryRecord_t& record, VfoData_t& vfo)
+{
+    vfo.Frequency = record.frequency;
+    vfo.Step = record.step;
+    vfo.Mode = static_cast<BK4819_Mode_t>(record.mode);
+    vfo.bw = static_cast<BK4819_Filter_Bandwidth_t>(record.bw);
+    vfo.Sql = record.sql;
+    vfo.Gain = record.gain;
+    vfo.txp = record.txp;
+}
+
+bool IcomSimMemory::isValid(const IcomSimMemoryRecord_t& record)
+{
+    return record.marker == ICOMSIM_MEMORY_MARKER && record.check == recordCheck(record);
+}
+
+// ******************************************************************************************************************************
+// Accesso ai canali: prima la cache delle scritture, poi il supporto
+// ******************************************************************************************************************************
+bool IcomSimMemory::isUsed(uint16_t channel) const
+{
+    return channel < channelCount && (used[channel >> 3] & (1 << (channel & 7)));
+}
+
+bool IcomSimMemory::load(uint16_t channel, VfoData_t& vfo)
+{
+    if (!isUsed(channel)) return false;
+
+    for (uint8_t i = cacheCount; i > 0; i--)
+    {
+        if (cache[i - 1].channel == channel)
+        {
+            decode(cache[i - 1].record, vfo);
+            return true;
+        }
+    }
+
+    IcomSimMemoryRecord_t record;
+    if (!backing.read(channel, record) || !isValid(record)) return false;
+
+    decode(record, vfo);
+    return true;
+}
+
+bool IcomSimMemory::store(uint16_t channel, const VfoData_t& vfo)
+{
+    if (channel >= channelCount) return false;
+
+    IcomSimMemoryRecord_t record;
+    encode(vfo, record);
+    if (!put(channel, record)) return false;
+
+    markUsed(channel, true);
+    return true;
+}
+
+bool IcomSimMemory::clear(uint16_t channel)
+{
+    if (channel >= channelCount) return false;
+    if (!isUsed(channel)) return true;                      // Gia' vuoto: nessuna scrittura
+
+    IcomSimMemoryRecord_t record;
+    memset(&record, 0, sizeof(record));                     // marker 0: canale vuoto
+    if (!put(channel, record)) return false;
+
+    markUsed(channel, false);
+    return true;
+}
+
+// Record ricevuto gia' nel formato del supporto: valido = scrittura, marker assente = cancellazione
+bool IcomSimMemory::write(uint16_t channel, const IcomSimMemoryRecord_t& record)
+{
+    if (channel >= channelCount) return false;
+    if (record.marker != ICOMSIM_MEMORY_MARKER) return clear(channel);
+    if (!isValid(record) || !put(channel, record)) return false;
+
+    markUsed(channel, true);
+    return true;
+}
+
+bool IcomSimMemory::put(uint16_t channel, const IcomSimMemoryRecord_t& record)
+{
+    lastWrite = millis();
+
+    for (uint8_t i = 0; i < cacheCount; i++)
+    {
+        if (cache[i].channel == channel)                    // Stesso canale: si accorpa nella copia in cache
+        {
+            cache[i].record = record;
+            return true;
+        }
+    }
+
+    if (cacheCount == ICOMSIM_MEMORY_CACHE) return false;   // Niente scrittura sincrona: la libera process()
+
+    cache[cacheCount].channel = channel;
+    cache[cacheCount].record = record;
+    cacheCount++;
+    return true;
+}
+
+// ******************************************************************************************************************************
+// Scrittura differita: al massimo un record per chiamata, quando il controller ha smesso di scrivere o la cache e' piena
+// ******************************************************************************************************************************
+uint32_t IcomSimMemory::process()
+{
+    if (cacheCount == 0 && commitPending)
+    {
+        commitPending = false;
+        flushScheduled = false;
+        backing.commit();                                   // Cache vuota: un solo commit per raffica di scritture
+    }
+    else if (cacheCount > 0 && getFlushDelay() == 0)
+    {
+        writeBack();
+    }
+    return getFlushDelay();
+}
+
+uint32_t IcomSimMemory::getFlushDelay() const
+{
+    if (cacheCount == 0) return commitPending ? 0 : ICOMSIM_WAIT_FOREVER;
+    if (cacheCount == ICOMSIM_MEMORY_CACHE || flushScheduled) return 0;
+
+    uint32_t elapsed = millis() - lastWrite;
+    return elapsed >= ICOMSIM_MEMORY_FLUSH_MS ? 0 : ICOMSIM_MEMORY_FLUSH_MS - elapsed;
+}
+
+bool IcomSimMemory::flush()
+{
+    while (cacheCount > 0)
+    {
+        if (!writeBack()) return false;
+    }
+
+    commitPending = false;
+    flushScheduled = false;
+    return backing.commit();
+}
+
+// Come flush(), ma un record per chiamata di process(): nessuna attesa di ICOMSIM_MEMORY_FLUSH_MS
+void IcomSimMemory::scheduleFlush()
+{
+    if (cacheCount > 0 || commitPending) flushScheduled = true;
+}
+
+bool IcomSimMemory::writeBack()
+{
+    if (cacheCount == 0) return true;
+    if (!backing.write(cache[0].channel, cache[0].record)) return false;
+
+    cacheCount--;
+    memmove(&cache[0], &cache[1], cacheCount * sizeof(CacheEntry_t));
+    commitPending = true;
+    return true;
+}
+
+void IcomSimMemory::markUsed(uint16_t channel, bool inUse)
+{
+    if (inUse) used[channel >> 3] |= (uint8_t)(1 << (channel & 7));
+    else used[channel >> 3] &= (uint8_t)~(1 << (channel & 7));
+}
+
+#endif
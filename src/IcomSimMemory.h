@@ -0,0 +1,125 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimMemory.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Memory channel bank behind the CI-V memory commands (0x08 select, 0x09 write,
+ * 0x0A memory to VFO, 0x0B clear).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - Channels are fixed 16-byte records (IcomSimMemoryRecord_t) at slot = channel in an
+ *   IcomSimMemoryStore: EEPROM on the target (IcomSimEepromStore.h), a file on the host
+ *   (extras/host IcomSimFileStore). The layout is the in-memory one of a little-endian
+ *   CPU (AVR, ESP32, x86/ARM hosts).
+ * - begin() scans the store once and keeps a bitmap of the used channels, so empty
+ *   channels are answered without touching the store and a recall is one record read.
+ * - Writes land in a small RAM cache (ICOMSIM_MEMORY_CACHE records); writing the same
+ *   channel again only replaces the cached copy. process() writes back at most one
+ *   record per call: after ICOMSIM_MEMORY_FLUSH_MS without new writes, or at once while
+ *   the cache is full. A write that finds the cache full fails instead of waiting for
+ *   the store (the CI-V command gets NG, a bulk block CIV_BULK_BUSY): on AVR a record
+ *   takes about 50 ms of EEPROM writes, too long inside a CI-V handler.
+ * - IcomSim calls process() from processSerialQueue() once the bank is attached with
+ *   IcomSim::attachMemory(); call flush() before a power down that you can detect. flush()
+ *   is the only call that writes several records in a row; scheduleFlush() drains the
+ *   cache the same way, one record per process() call, and commits when it is empty.
+ */
+
+#ifndef ICOMSIMMEMORY_H
+#define ICOMSIMMEMORY_H
+
+#include "IcomSim.h"
+
+#if ICOMSIM_FEATURE_MEMORY
+
+#define ICOMSIM_MEMORY_RECORD_SIZE 16
+#define ICOMSIM_MEMORY_MARKER      0xA5	// Record valido; EEPROM cancellata (0xFF) o azzerata = canale vuoto
+#define ICOMSIM_MEMORY_NO_CHANNEL  0xFFFF
+
+typedef struct
+{
+	uint32_t frequency;
+	uint32_t step;
+	uint8_t mode;
+	uint8_t bw;
+	uint8_t sql;
+	uint8_t gain;
+	uint8_t txp;
+	uint8_t reserved;
+	uint8_t marker;					// ICOMSIM_MEMORY_MARKER
+	uint8_t check;					// Complemento della somma dei 15 byte precedenti
+} IcomSimMemoryRecord_t;
+
+static_assert(sizeof(IcomSimMemoryRecord_t) == ICOMSIM_MEMORY_RECORD_SIZE, "IcomSimMemoryRecord_t: 16 byte");
+
+// Supporto dei record: la banca lo usa solo attraverso questa interfaccia
+class IcomSimMemoryStore
+{
+public:
+	virtual ~IcomSimMemoryStore() {}
+
+	virtual uint16_t capacity() const = 0;	// Record disponibili
+	virtual bool read(uint16_t slot, IcomSimMemoryRecord_t& record) = 0;
+	virtual bool write(uint16_t slot, const IcomSimMemoryRecord_t& record) = 0;
+	virtual bool commit() { return true; }	// Scrittura definitiva dopo una serie di write() (flash emulata, file)
+};
+
+class IcomSimMemory
+{
+public:
+	explicit IcomSimMemory(IcomSimMemoryStore& store);
+
+	bool begin();
+	uint16_t getChannelCount() const { return channelCount; }
+
+	bool isUsed(uint16_t channel) const;
+	bool load(uint16_t channel, VfoData_t& vfo);
+	bool store(uint16_t channel, const VfoData_t& vfo);
+	bool clear(uint16_t channel);
+	bool write(uint16_t channel, const IcomSimMemoryRecord_t& record);	// Record gia' codificato (trasferimento a blocchi)
+
+	uint32_t process();				// Come getFlushDelay(), dopo aver scritto un record se era il momento
+	uint32_t getFlushDelay() const;	// ms alla prossima scrittura differita, ICOMSIM_WAIT_FOREVER se nessuna
+	bool flush();
+	void scheduleFlush();			// Svuota la cache e fa il commit da process(), senza attendere
+	uint8_t getPending() const { return cacheCount; }
+	uint8_t getRoom() const { return ICOMSIM_MEMORY_CACHE - cacheCount; }	// Scritture accettate ora
+
+	static void encode(const VfoData_t& vfo, IcomSimMemoryRecord_t& record);
+	static void decode(const IcomSimMemoryRecord_t& record, VfoData_t& vfo);
+	static bool isValid(const IcomSimMemoryRecord_t& record);
+
+private:
+	typedef struct
+	{
+		uint16_t channel;
+		IcomSimMemoryRecord_t record;
+	} CacheEntry_t;
+
+	IcomSimMemoryStore& backing;
+	uint16_t channelCount;
+	uint8_t used[(ICOMSIM_MEMORY_CHANNELS + 7) / 8];	// Indice in RAM: un bit per canale
+	CacheEntry_t cache[ICOMSIM_MEMORY_CACHE];		// Scritture non ancora nel supporto, la piu' vecchia prima
+	uint8_t cacheCount;
+	uint32_t lastWrite;							// millis() dell'ultima store()/clear()
+	bool commitPending;
+	bool flushScheduled;						// scheduleFlush(): scrittura senza attesa fino al commit
+
+	bool put(uint16_t channel, const IcomSimMemoryRecord_t& record);
+	bool writeBack();
+	void markUsed(uint16_t channel, bool inUse);
+};
+
+#endif
+#endif
@@ -0,0 +1,307 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimNet.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * CI-V over TCP or UDP with non-blocking BSD sockets (lwIP on ESP32, POSIX on host).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ */
+
+#include "IcomSimNet.h"
+
+#if defined(ESP32) || defined(ICOMSIM_HOST)
+
+#if defined(ESP32)
+	#include <errno.h>
+	#include <lwip/sockets.h>
+#else
+	#include <arpa/inet.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+	#define MSG_NOSIGNAL 0
+#endif
+
+static bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+}
+
+// ******************************************************************************************************************************
+// Slot di un client
+// ******************************************************************************************************************************
+IcomSimNetPort::IcomSimNetPort()
+{
+    fd = -1;
+    peerAddress = 0;
+    peerPort = 0;
+    lastSeen = 0;
+    txLength = 0;
+    dropped = 0;
+    connected = false;
+}
+
+// Nuovo client nello slot: niente di quanto restava del precedente
+void IcomSimNetPort::open()
+{
+    rxRing.clear();
+    txLength = 0;
+    connected = true;
+}
+
+int IcomSimNetPort::read()
+{
+    uint8_t byte;
+    return rxRing.pop(byte) ? byte : -1;
+}
+
+int IcomSimNetPort::peek()
+{
+    uint16_t length;
+    const uint8_t* data = rxRing.peek(length);
+    return length > 0 ? data[0] : -1;
+}
+
+size_t IcomSimNetPort::write(const uint8_t* data, size_t length)
+{
+    if (!connected) return length;                          // Nessuno in ascolto: come una UART senza cavo
+
+    size_t n = ICOMSIM_NET_TX_SIZE - txLength;
+    if (n > length) n = length;
+    memcpy(&tx[txLength], data, n);
+    txLength += (uint16_t)n;
+    if (n < length) dropped++;
+    return n;
+}
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+IcomSimNet::IcomSimNet()
+{
+    listener = -1;
+    localPort = 0;
+    protocol = ICOMSIM_NET_TCP;
+}
+
+bool IcomSimNet::begin(uint8_t proto, uint16_t port, bool loopbackOnly)
+{
+    end();
+    protocol = proto;
+
+    listener = socket(AF_INET, protocol == ICOMSIM_NET_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+    if (listener < 0) return false;
+
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+
+    socklen_t length = sizeof(local);
+    if (bind(listener, (struct sockaddr*)&local, sizeof(local)) < 0 ||
+        (protocol == ICOMSIM_NET_TCP && listen(listener, ICOMSIM_NET_MAX_CLIENTS) < 0) ||
+        !setNonBlocking(listener) ||
+        getsockname(listener, (struct sockaddr*)&local, &length) < 0)
+    {
+        end();
+        return false;
+    }
+
+    localPort = ntohs(local.sin_port);
+    return true;
+}
+
+void IcomSimNet::end()
+{
+    for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++) close(ports[i]);
+    if (listener >= 0) ::close(listener);
+    listener = -1;
+    localPort = 0;
+}
+
+uint8_t IcomSimNet::getClientCount() const
+{
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++) n += ports[i].connected ? 1 : 0;
+    return n;
+}
+
+void IcomSimNet::close(IcomSimNetPort& p)
+{
+    if (p.fd >= 0) ::close(p.fd);
+    p.fd = -1;
+    p.connected = false;
+}
+
+// ******************************************************************************************************************************
+// Un turno: prima le risposte accumulate dall'ultima chiamata (una send() o un datagramma per client), poi la ricezione
+// ******************************************************************************************************************************
+void IcomSimNet::process()
+{
+    if (listener < 0) return;
+
+    for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++)
+    {
+        if (ports[i].connected && ports[i].txLength > 0) transmit(ports[i]);
+    }
+
+    if (protocol == ICOMSIM_NET_UDP)
+    {
+        receiveUdp();
+        return;
+    }
+
+    acceptTcp();
+    for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++)
+    {
+        if (ports[i].connected) receiveTcp(ports[i]);
+    }
+}
+
+void IcomSimNet::transmit(IcomSimNetPort& p)
+{
+    uint16_t length = p.txLength;
+
+    if (protocol == ICOMSIM_NET_UDP)
+    {
+        // Il datagramma finisce con un frame completo; il resto parte con il prossimo
+        while (length > 0 && p.tx[length - 1] != 0xFD) length--;
+        if (length == 0) length = p.txLength;               // Nessun terminatore: byte non CI-V, partono cosi'
+
+        struct sockaddr_in peer;
+        memset(&peer, 0, sizeof(peer));
+        peer.sin_family = AF_INET;
+        peer.sin_port = p.peerPort;
+        peer.sin_addr.s_addr = p.peerAddress;
+
+        if (sendto(listener, p.tx, length, 0, (struct sockaddr*)&peer, sizeof(peer)) != (int)length) p.dropped++;
+    }
+    else
+    {
+        int sent = send(p.fd, p.tx, length, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) close(p);
+            return;                                         // Socket pieno: si riprova al prossimo turno
+        }
+        length = (uint16_t)sent;
+    }
+
+    p.txLength -= length;
+    memmove(p.tx, &p.tx[length], p.txLength);
+}
+
+// ******************************************************************************************************************************
+// TCP: un client per slot, con TCP_NODELAY; oltre gli slot la connessione viene chiusa subito
+// ******************************************************************************************************************************
+void IcomSimNet::acceptTcp()
+{
+    for (;;)
+    {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) return;
+
+        uint8_t slot = 0;
+        while (slot < ICOMSIM_NET_MAX_CLIENTS && ports[slot].connected) slot++;
+
+        int one = 1;
+        if (slot >= ICOMSIM_NET_MAX_CLIENTS || !setNonBlocking(fd) || setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0)
+        {
+            ::close(fd);
+            continue;
+        }
+
+        ports[slot].fd = fd;
+        ports[slot].open();
+    }
+}
+
+void IcomSimNet::receiveTcp(IcomSimNetPort& p)
+{
+    uint8_t data[ICOMSIM_NET_RX_SIZE];
+
+    while (p.rxRing.space() > 0)
+    {
+        int n = recv(p.fd, data, p.rxRing.space(), 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            close(p);                                       // Chiusa dal client o errore
+            return;
+        }
+        if (n < 0) return;
+
+        p.rxRing.write(data, (uint16_t)n);
+    }
+}
+
+// ******************************************************************************************************************************
+// UDP: il mittente identifica il client; un datagramma che non sta nel buffer dello slot viene scartato intero
+// ******************************************************************************************************************************
+void IcomSimNet::receiveUdp()
+{
+    uint8_t data[ICOMSIM_NET_RX_SIZE];
+    uint32_t now = millis();
+
+    for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++)
+    {
+        if (ports[i].connected && now - ports[i].lastSeen >= ICOMSIM_NET_UDP_TIMEOUT_MS) close(ports[i]);
+    }
+
+    for (;;)
+    {
+        struct sockaddr_in peer;
+        socklen_t peerLength = sizeof(peer);
+        int n = recvfrom(listener, data, sizeof(data), 0, (struct sockaddr*)&peer, &peerLength);
+        if (n < 0) return;
+
+        IcomSimNetPort* p = nullptr;
+        IcomSimNetPort* idle = nullptr;
+        for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS && p == nullptr; i++)
+        {
+            IcomSimNetPort& slot = ports[i];
+            if (!slot.connected)
+            {
+                if (idle == nullptr) idle = &slot;
+            }
+            else if (slot.peerAddress == peer.sin_addr.s_addr && slot.peerPort == peer.sin_port)
+            {
+                p = &slot;
+            }
+        }
+
+        if (p == nullptr)
+        {
+            if (idle == nullptr) continue;                  // Slot tutti occupati: il mittente viene ignorato
+            p = idle;
+            p->peerAddress = peer.sin_addr.s_addr;
+            p->peerPort = peer.sin_port;
+            p->open();
+        }
+
+        p->lastSeen = now;
+        if (!p->rxRing.write(data, (uint16_t)n)) p->dropped++;
+    }
+}
+
+#endif
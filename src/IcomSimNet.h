@@ -0,0 +1,127 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimNet.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * CI-V over TCP or UDP: a non-blocking socket server whose client slots are Streams,
+ * so IcomSim reaches network controllers without a serial-to-IP bridge.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - Built on ESP32 (lwIP sockets, WiFi brought up by the sketch) and in the host build
+ *   (POSIX sockets); on other targets the file compiles to nothing.
+ * - Each client slot is an IcomSimNetPort (a Stream): one controller can be served with
+ *   IcomSim radio(net.port(0)), several together with a serial port through IcomSimRouter:
+ *     router.addPort(Serial2);
+ *     for (uint8_t i = 0; i < ICOMSIM_NET_MAX_CLIENTS; i++) router.addPort(net.port(i));
+ *     loop(): router.process(); net.process();
+ * - process() never blocks: it sends what the radio wrote since the previous call, then
+ *   accepts new clients and reads what has arrived.
+ * - Output is batched: everything written to a port between two process() calls leaves
+ *   in one send() (TCP, with TCP_NODELAY so small replies are not held back by Nagle) or in
+ *   one datagram (UDP, cut at the last complete frame). A datagram may carry several
+ *   frames in both directions.
+ * - IcomSimRouter reads ICOMSIM_ROUTER_RX_BUDGET bytes per port and turn: to answer a
+ *   long datagram with one datagram, repeat router.process() while a port has input.
+ * - UDP has no connections: a new source address takes a free slot, a slot idle for
+ *   ICOMSIM_NET_UDP_TIMEOUT_MS is freed. TCP clients beyond the slots are refused.
+ * - Buffers are fixed per slot; nothing is allocated after begin().
+ */
+
+#ifndef ICOMSIMNET_H
+#define ICOMSIMNET_H
+
+#include "IcomSim.h"
+
+#if defined(ESP32) || defined(ICOMSIM_HOST)
+
+#ifndef ICOMSIM_NET_MAX_CLIENTS
+	#define ICOMSIM_NET_MAX_CLIENTS 3               // Con la seriale riempie le 4 porte di IcomSimRouter
+#endif
+#ifndef ICOMSIM_NET_RX_SIZE
+	#define ICOMSIM_NET_RX_SIZE 256                 // Byte ricevuti in attesa per client (potenza di 2)
+#endif
+#ifndef ICOMSIM_NET_TX_SIZE
+	#define ICOMSIM_NET_TX_SIZE 256                 // Byte in uscita per client = datagramma piu' lungo
+#endif
+#ifndef ICOMSIM_NET_UDP_TIMEOUT_MS
+	#define ICOMSIM_NET_UDP_TIMEOUT_MS 30000        // Silenzio dopo cui un client UDP libera lo slot
+#endif
+
+#define ICOMSIM_NET_TCP 0
+#define ICOMSIM_NET_UDP 1
+
+class IcomSimNet;
+
+// Slot di un client visto come Stream: finche' nessuno e' collegato le scritture vengono scartate
+class IcomSimNetPort : public Stream
+{
+public:
+	IcomSimNetPort();
+
+	bool isConnected() const { return connected; }
+	uint16_t getDropped() const { return dropped; }
+
+	int available() override { return rxRing.used(); }
+	int read() override;
+	int peek() override;
+	int availableForWrite() override { return connected ? ICOMSIM_NET_TX_SIZE - txLength : ICOMSIM_NET_TX_SIZE; }
+	size_t write(uint8_t byte) override { return write(&byte, 1); }
+	size_t write(const uint8_t* data, size_t length) override;
+
+private:
+	friend class IcomSimNet;
+
+	CivByteRing<ICOMSIM_NET_RX_SIZE> rxRing;
+	uint8_t tx[ICOMSIM_NET_TX_SIZE];
+	uint16_t txLength;
+	uint16_t dropped;				// Byte o datagrammi persi (buffer pieno)
+	int fd;							// Connessione TCP, -1 se assente o UDP
+	uint32_t peerAddress;			// UDP: indirizzo e porta del client, ordine di rete
+	uint16_t peerPort;
+	uint32_t lastSeen;				// UDP: millis() dell'ultimo datagramma
+	bool connected;
+
+	void open();
+};
+
+class IcomSimNet
+{
+public:
+	IcomSimNet();
+	~IcomSimNet() { end(); }
+
+	// port = 0: scelta dal sistema, letta con getPort(). loopbackOnly: solo 127.0.0.1
+	bool begin(uint8_t protocol, uint16_t port, bool loopbackOnly = false);
+	void end();
+	void process();
+
+	uint16_t getPort() const { return localPort; }
+	uint8_t getClientCount() const;
+	IcomSimNetPort& port(uint8_t client) { return ports[client < ICOMSIM_NET_MAX_CLIENTS ? client : 0]; }
+
+private:
+	IcomSimNetPort ports[ICOMSIM_NET_MAX_CLIENTS];
+	int listener;					// Socket in ascolto (TCP) o unico socket (UDP)
+	uint16_t localPort;
+	uint8_t protocol;
+
+	void transmit(IcomSimNetPort& p);
+	void close(IcomSimNetPort& p);
+	void acceptTcp();
+	void receiveTcp(IcomSimNetPort& p);
+	void receiveUdp();
+};
+
+#endif
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimPort.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * Platform primitives used where IcomSim state is shared with an ISR or another task.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - ICOMSIM_LOAD_ACQUIRE()/ICOMSIM_STORE_RELEASE() access the indices of the
+ *   single-producer/single-consumer rings, ordering the data accesses around them.
+ * - ICOMSIM_CRITICAL_BEGIN()/END() protect the few multi-byte reads that are not atomic
+ *   on 8-bit targets.
+ * - ICOMSIM_FETCH_OR/FETCH_ADD/EXCHANGE are atomic read-modify-write operations that
+ *   return the previous value; on AVR they briefly disable interrupts.
+ */
+
+#ifndef ICOMSIMPORT_H
+#define ICOMSIMPORT_H
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+	#include <avr/io.h>
+	#include <avr/interrupt.h>
+
+	// Core singolo: basta impedire al compilatore di riordinare
+	#define ICOMSIM_BARRIER()        __asm__ __volatile__("" ::: "memory")
+	#define ICOMSIM_LOAD_ACQUIRE(var)       __extension__({ __typeof__(var) icomsimV = (var); ICOMSIM_BARRIER(); icomsimV; })
+	#define ICOMSIM_STORE_RELEASE(var, val) do { ICOMSIM_BARRIER(); (var) = (val); } while (0)
+	#define ICOMSIM_CRITICAL_BEGIN() uint8_t icomsimSreg = SREG; cli()
+	#define ICOMSIM_CRITICAL_END()   SREG = icomsimSreg
+
+	#define ICOMSIM_RMW(var, expr) __extension__({ uint8_t icomsimS = SREG; cli(); __typeof__(var) icomsimO = (var); \
+	                                               (var) = (expr); SREG = icomsimS; icomsimO; })
+	#define ICOMSIM_FETCH_OR(var, val)  ICOMSIM_RMW(var, icomsimO | (val))
+	#define ICOMSIM_FETCH_ADD(var, val) ICOMSIM_RMW(var, icomsimO + (val))
+	#define ICOMSIM_EXCHANGE(var, val)  ICOMSIM_RMW(var, (val))
+
+	typedef uint8_t CivRxIndex_t;                           // Letto dal loop mentre l'ISR lo scrive: deve essere atomico
+	typedef uint8_t IcomSimGen_t;                           // Contatori di generazione: un byte si legge in un colpo solo
+#else
+	#define ICOMSIM_LOAD_ACQUIRE(var)       __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+	#define ICOMSIM_STORE_RELEASE(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+	#define ICOMSIM_CRITICAL_BEGIN() do {} while (0)
+	#define ICOMSIM_CRITICAL_END()   do {} while (0)
+
+	#define ICOMSIM_FETCH_OR(var, val)  __atomic_fetch_or(&(var), (val), __ATOMIC_ACQ_REL)
+	#define ICOMSIM_FETCH_ADD(var, val) __atomic_fetch_add(&(var), (val), __ATOMIC_ACQ_REL)
+	#define ICOMSIM_EXCHANGE(var, val)  __atomic_exchange_n(&(var), (val), __ATOMIC_ACQ_REL)
+
+	typedef uint16_t CivRxIndex_t;
+	typedef uint16_t IcomSimGen_t;
+#endif
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimRouter.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * CI-V router: one IcomSim radio served to several controllers on separate ports.
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ */
+
+#include "IcomSimRouter.h"
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+IcomSimRouter::IcomSimRouter(IcomSim& radio) : sim(radio)
+{
+    portCount = 0;
+    nextPort = 0;
+    routeCount = 0;
+    routeVictim = 0;
+    currentPort = ICOMSIM_ROUTER_NO_PORT;
+    currentAddress = 0;
+
+    sim.setFrameSink(&IcomSimRouter::onFrameOut, this);    // Tutto cio' che la radio trasmette passa dal router
+}
+
+int8_t IcomSimRouter::addPort(Stream& port)
+{
+    if (portCount >= ICOMSIM_ROUTER_MAX_PORTS) return -1;
+
+    ports[portCount].stream = &port;
+    ports[portCount].parser.reset();
+    ports[portCount].txRing.clear();
+    ports[portCount].dropped = 0;
+    return (int8_t)portCount++;
+}
+
+// ******************************************************************************************************************************
+// Un turno: ogni porta riceve al massimo ICOMSIM_ROUTER_RX_BUDGET byte, partendo ogni volta da una porta diversa.
+// ******************************************************************************************************************************
+void IcomSimRouter::process()
+{
+    if (portCount == 0) return;
+
+    for (uint8_t i = 0; i < portCount; i++)
+    {
+        uint8_t port = nextPort + i;
+        if (port >= portCount) port -= portCount;
+        receive(port);
+    }
+    nextPort = (nextPort + 1 < portCount) ? nextPort + 1 : 0;
+
+    sim.processSerialQueue();                               // Transceive e RSSI periodico (passano da onFrameOut)
+
+    for (uint8_t port = 0; port < portCount; port++) transmit(port);
+}
+
+void IcomSimRouter::receive(uint8_t port)
+{
+    Port_t& p = ports[port];
+
+    for (uint8_t budget = ICOMSIM_ROUTER_RX_BUDGET; budget > 0 && p.stream->available(); budget--)
+    {
+        if (p.parser.feed(p.stream->read()) != CIV_PARSE_FRAME) continue;
+
+        const CivFrame_t& frame = p.parser.frame();
+        learn(frame.addressFrom, port);
+
+        currentPort = port;
+        currentAddress = frame.addressFrom;
+        sim.handleFrame(frame);
+        currentPort = ICOMSIM_ROUTER_NO_PORT;
+    }
+}
+
+void IcomSimRouter::transmit(uint8_t port)
+{
+    Port_t& p = ports[port];
+
+    while (!p.txRing.isEmpty())
+    {
+        uint16_t length;
+        const uint8_t* chunk = p.txRing.peek(length);
+
+        int space = p.stream->availableForWrite();
+        if (space <= 0) break;
+        if ((int)length > space) length = (uint16_t)space;
+
+        size_t written = p.stream->write(chunk, length);
+        p.txRing.consume(written);
+
+        if (written < length) break;
+    }
+}
+
+// ******************************************************************************************************************************
+// Tabella indirizzo controller -> porta, aggiornata ad ogni frame ricevuto
+// ******************************************************************************************************************************
+void IcomSimRouter::learn(uint8_t address, uint8_t port)
+{
+    if (address == CIV_ADDRESS_BROADCAST) return;
+
+    for (uint8_t i = 0; i < routeCount; i++)
+    {
+        if (routes[i].address == address)
+        {
+            routes[i].port = port;
+            return;
+        }
+    }
+
+    uint8_t slot = routeCount;
+    if (routeCount < ICOMSIM_ROUTER_MAX_ROUTES)
+    {
+        routeCount++;
+    }
+    else
+    {
+        slot = routeVictim;
+        routeVictim = (routeVictim + 1) % ICOMSIM_ROUTER_MAX_ROUTES;
+    }
+
+    routes[slot].address = address;
+    routes[slot].port = port;
+}
+
+uint8_t IcomSimRouter::lookup(uint8_t address) const
+{
+    for (uint8_t i = 0; i < routeCount; i++)
+    {
+        if (routes[i].address == address) return routes[i].port;
+    }
+    return ICOMSIM_ROUTER_NO_PORT;
+}
+
+bool IcomSimRouter::enqueue(uint8_t port, const uint8_t* data, uint16_t length)
+{
+    if (ports[port].txRing.write(data, length)) return true;
+
+    ports[port].dropped++;
+    return false;
+}
+
+// ******************************************************************************************************************************
+// Instradamento dei frame trasmessi dalla radio (byte 2 = destinatario). false se almeno una porta lo ha scartato:
+// IcomSim lo conta in ICOMSIM_METRIC_TX_DROPPED
+// ******************************************************************************************************************************
+bool IcomSimRouter::onFrameOut(void* ctx, const uint8_t* data, uint16_t length)
+{
+    IcomSimRouter& router = *static_cast<IcomSimRouter*>(ctx);
+    uint8_t destination = data[2];
+
+    // Risposta alla richiesta in corso: torna sulla porta da cui e' arrivata
+    uint8_t port = ICOMSIM_ROUTER_NO_PORT;
+    if (router.currentPort != ICOMSIM_ROUTER_NO_PORT && destination == router.currentAddress) port = router.currentPort;
+    else if (destination != CIV_ADDRESS_BROADCAST) port = router.lookup(destination);
+
+    if (port != ICOMSIM_ROUTER_NO_PORT) return router.enqueue(port, data, length);
+
+    bool queued = true;
+    for (uint8_t i = 0; i < router.portCount; i++)
+    {
+        if (!router.enqueue(i, data, length)) queued = false;
+    }
+    return queued;
+}
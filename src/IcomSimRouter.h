@@ -0,0 +1,98 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimRouter.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * CI-V router: one IcomSim radio served to several controllers on separate ports
+ * (logger, digital-mode software, amplifier/rotator controller, ...).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - Every port has its own parser and transmit ring; nothing is allocated per frame.
+ * - Frames are executed one at a time against the shared VfoData, so commands from
+ *   different ports never interleave.
+ * - Ports are scanned round-robin with a byte budget per turn: a chatty port cannot
+ *   starve the others.
+ * - Replies go back to the port the request came from; frames for a known controller
+ *   address go to the port where that address was last seen; broadcast frames
+ *   (transceive, RSSI streaming) go to every port.
+ * - In router mode the Stream passed to the IcomSim constructor is not used: call
+ *   process() instead of processCIVCommand()/processSerialQueue().
+ */
+
+#ifndef ICOMSIMROUTER_H
+#define ICOMSIMROUTER_H
+
+#include "IcomSim.h"
+
+#ifndef ICOMSIM_ROUTER_MAX_PORTS
+	#define ICOMSIM_ROUTER_MAX_PORTS 4
+#endif
+#ifndef ICOMSIM_ROUTER_TX_RING_SIZE
+	#define ICOMSIM_ROUTER_TX_RING_SIZE 128         // Byte in coda per porta (potenza di 2)
+#endif
+#ifndef ICOMSIM_ROUTER_RX_BUDGET
+	#define ICOMSIM_ROUTER_RX_BUDGET 16             // Byte letti da una porta per turno
+#endif
+#ifndef ICOMSIM_ROUTER_MAX_ROUTES
+	#define ICOMSIM_ROUTER_MAX_ROUTES 8             // Indirizzi di controller ricordati
+#endif
+#define ICOMSIM_ROUTER_NO_PORT 0xFF
+
+class IcomSimRouter
+{
+public:
+	IcomSimRouter(IcomSim& radio);
+
+	int8_t addPort(Stream& port);               // Indice della porta, -1 se non c'e' posto
+	void process();
+
+	uint8_t getPortCount() const { return portCount; }
+	uint16_t getDropped(uint8_t port) const { return port < portCount ? ports[port].dropped : 0; }
+
+private:
+	typedef struct
+	{
+		Stream* stream;
+		CivParser parser;
+		CivByteRing<ICOMSIM_ROUTER_TX_RING_SIZE> txRing;
+		uint16_t dropped;                       // Frame scartati per coda piena
+	} Port_t;
+
+	typedef struct
+	{
+		uint8_t address;
+		uint8_t port;
+	} Route_t;
+
+	IcomSim& sim;
+	Port_t ports[ICOMSIM_ROUTER_MAX_PORTS];
+	uint8_t portCount;
+	uint8_t nextPort;                           // Prima porta del prossimo turno
+
+	Route_t routes[ICOMSIM_ROUTER_MAX_ROUTES];
+	uint8_t routeCount;
+	uint8_t routeVictim;                        // Prossima voce da sostituire a tabella piena
+
+	uint8_t currentPort;                        // Porta del frame in esecuzione
+	uint8_t currentAddress;                     // Mittente del frame in esecuzione
+
+	void receive(uint8_t port);
+	void transmit(uint8_t port);
+	void learn(uint8_t address, uint8_t port);
+	uint8_t lookup(uint8_t address) const;
+	bool enqueue(uint8_t port, const uint8_t* data, uint16_t length);
+
+	static bool onFrameOut(void* ctx, const uint8_t* data, uint16_t length);
+};
+#endif
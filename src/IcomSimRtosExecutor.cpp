@@ -0,0 +1,146 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimRtosExecutor.cpp
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * FreeRTOS backend of IcomSimExecutor (ESP32 only).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ */
+
+#ifdef ESP32
+
+#include "IcomSimRtosExecutor.h"
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+IcomSimRtosExecutor::IcomSimRtosExecutor(IcomSim& sim, uint32_t stackSize, UBaseType_t priority, BaseType_t core)
+    : IcomSimExecutor(sim), task(nullptr), stackSize(stackSize), priority(priority), core(core)
+{
+    mutex = xSemaphoreCreateMutex();
+    stopped = xSemaphoreCreateBinary();
+    changes = xQueueCreate(ICOMSIM_CHANGE_QUEUE_SIZE, sizeof(IcomSimChange_t));
+}
+
+IcomSimRtosExecutor::~IcomSimRtosExecutor()
+{
+    stop();
+    vQueueDelete(changes);
+    vSemaphoreDelete(stopped);
+    vSemaphoreDelete(mutex);
+}
+
+bool IcomSimRtosExecutor::start()
+{
+    if (task != nullptr) return true;
+    if (mutex == nullptr || stopped == nullptr || changes == nullptr) return false;
+
+    return xTaskCreatePinnedToCore(&IcomSimRtosExecutor::taskEntry, "IcomSim", stackSize, this, priority, &task, core) == pdPASS;
+}
+
+void IcomSimRtosExecutor::stop()
+{
+    if (task == nullptr) return;
+
+    notify(ICOMSIM_EVENT_STOP);
+    xSemaphoreTake(stopped, portMAX_DELAY);                 // Il task termina fuori dalla sezione critica
+    task = nullptr;
+}
+
+// ******************************************************************************************************************************
+// Eventi: bit di notifica del task, accumulati finche' il task non si sveglia
+// ******************************************************************************************************************************
+void IcomSimRtosExecutor::notify(uint8_t events)
+{
+    if (task != nullptr) xTaskNotify(task, events, eSetBits);
+}
+
+void IcomSimRtosExecutor::notifyFromIsr(uint8_t events)
+{
+    if (task == nullptr) return;
+
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(task, events, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void IcomSimRtosExecutor::lock()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void IcomSimRtosExecutor::unlock()
+{
+    xSemaphoreGive(mutex);
+}
+
+bool IcomSimRtosExecutor::waitChange(IcomSimChange_t& change, uint32_t timeoutMs)
+{
+    TickType_t ticks = timeoutMs == ICOMSIM_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    return xQueueReceive(changes, &change, ticks) == pdTRUE;
+}
+
+bool IcomSimRtosExecutor::postChange(const IcomSimChange_t& change)
+{
+    return xQueueSend(changes, &change, 0) == pdTRUE;
+}
+
+#if ICOMSIM_FEATURE_RX_RING
+// ******************************************************************************************************************************
+// La UART viene svuotata nel ring dal task di eventi della HardwareSerial, l'executor si sveglia subito dopo
+// ******************************************************************************************************************************
+void IcomSimRtosExecutor::attachSerial(HardwareSerial& serial)
+{
+    sim.enableRxRing(true);
+    serial.onReceive([this]()
+    {
+        sim.pumpRx();
+        notify(ICOMSIM_EVENT_RX);
+    });
+}
+#endif
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+void IcomSimRtosExecutor::taskEntry(void* arg)
+{
+    static_cast<IcomSimRtosExecutor*>(arg)->run();
+    vTaskDelete(nullptr);                                   // Dopo run() l'oggetto puo' essere gia' distrutto
+}
+
+void IcomSimRtosExecutor::run()
+{
+    uint32_t wait = 0;
+
+    for (;;)
+    {
+        uint32_t events = 0;
+        TickType_t ticks = portMAX_DELAY;
+
+        if (wait != ICOMSIM_WAIT_FOREVER)
+        {
+            ticks = pdMS_TO_TICKS(wait);
+            if (ticks == 0 && wait != 0) ticks = 1;          // Sotto il tick si arrotonda per eccesso
+        }
+
+        xTaskNotifyWait(0, 0xFFFFFFFFUL, &events, ticks);
+        if (events & ICOMSIM_EVENT_STOP) break;
+
+        wait = runOnce();
+    }
+
+    xSemaphoreGive(stopped);
+}
+
+#endif
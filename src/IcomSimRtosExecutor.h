@@ -0,0 +1,79 @@
+/*
+ * Project Name: Radio Firmware
+ * File: IcomSimRtosExecutor.h
+ *
+ * Copyright (C) 2024 Fabrizio Palumbo (IU0IJV)
+ *
+ * This program is distributed under the terms of the MIT license.
+ * You can obtain a copy of the license at:
+ * https://opensource.org/licenses/MIT
+ *
+ * DESCRIPTION:
+ * FreeRTOS backend of IcomSimExecutor (ESP32 only).
+ *
+ * AUTHOR: Fabrizio Palumbo
+ * CREATION DATE: October 27, 2024
+ *
+ * CONTACT: t.me/IU0IJV
+ *
+ * NOTES:
+ * - Events are task notification bits, so notify() costs one xTaskNotify() and
+ *   notifyFromIsr() can be called from an interrupt.
+ * - attachSerial() enables the IcomSim receive ring and feeds it from the UART
+ *   event task through HardwareSerial::onReceive().
+ */
+
+#ifndef ICOMSIMRTOSEXECUTOR_H
+#define ICOMSIMRTOSEXECUTOR_H
+
+#ifdef ESP32
+
+#include "IcomSimExecutor.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#define ICOMSIM_RTOS_STACK_SIZE 4096
+#define ICOMSIM_RTOS_PRIORITY   5
+
+class IcomSimRtosExecutor : public IcomSimExecutor
+{
+public:
+	IcomSimRtosExecutor(IcomSim& sim, uint32_t stackSize = ICOMSIM_RTOS_STACK_SIZE,
+	                    UBaseType_t priority = ICOMSIM_RTOS_PRIORITY, BaseType_t core = tskNO_AFFINITY);
+	~IcomSimRtosExecutor();
+
+	bool start() override;
+	void stop() override;
+	void notify(uint8_t events) override;
+	void notifyFromIsr(uint8_t events);
+
+	void lock() override;
+	void unlock() override;
+
+	bool waitChange(IcomSimChange_t& change, uint32_t timeoutMs) override;
+
+#if ICOMSIM_FEATURE_RX_RING
+	void attachSerial(HardwareSerial& serial);
+#endif
+
+protected:
+	bool postChange(const IcomSimChange_t& change) override;
+
+private:
+	static void taskEntry(void* arg);
+	void run();
+
+	TaskHandle_t task;
+	SemaphoreHandle_t mutex;		// Protegge VfoData_t e IcomSim
+	SemaphoreHandle_t stopped;		// Dato dal task quando termina
+	QueueHandle_t changes;
+	uint32_t stackSize;
+	UBaseType_t priority;
+	BaseType_t core;
+};
+
+#endif
+#endif
@@ -22,336 +22,1448 @@
  */
 
 #include "IcomSim.h"
-#include <ArduinoQueue.h> 
+#include "IcomSimMemory.h"
+#include "IcomSimBulk.h"
 
 #define RX_PIN A2                                           // pin usati da softwareserial
 #define TX_PIN A3
-#define QUEUE_MAX_SIZE 10  // Dimensione massima della coda
 
 
-uint8_t vfonum=0;
-#ifdef ESP32
-	// HardwareSerial debugSerial(2);
-#else
+#if ICOMSIM_DEBUG && !defined(ESP32)
 	SoftwareSerial debugSerial(RX_PIN, TX_PIN);
 #endif
       // MODE_AM = 0x00   # Codice per AM
       // MODE_FM = 0x01   # Codice per FM
       // MODE_SSB = 0x02  # Codice per SSB
 
-// Struttura per memorizzare i messaggi da inviare
-struct SerialMessage 
+
+// ******************************************************************************************************************************
+// Tabella dei comandi predefiniti: registrati nel costruttore tramite registerHandler()
+// ******************************************************************************************************************************
+const IcomSim::Builtin_t IcomSim::builtinHandlers[] =
+{
+    { COMMAND_GET_FREQUENCY, &IcomSim::onGetFrequency },
+    { COMMAND_SET_FREQUENCY, &IcomSim::onSetFrequency },
+    { COMMAND_GET_STEP,      &IcomSim::onGetStep      },
+    { COMMAND_SET_STEP,      &IcomSim::onSetStep      },
+    { COMMAND_SET_MODE,      &IcomSim::onSetMode      },
+#if ICOMSIM_FEATURE_SETTINGS
+    { COMMAND_GET_SQUELCH,   &IcomSim::onGetSquelch   },
+    { COMMAND_SET_SQUELCH,   &IcomSim::onSetSquelch   },
+    { COMMAND_GET_RFGAIN,    &IcomSim::onGetRfGain    },
+    { COMMAND_SET_RFGAIN,    &IcomSim::onSetRfGain    },
+    { COMMAND_SET_MONITOR,   &IcomSim::onSetMonitor   },
+    { COMMAND_GET_BANDWIDTH, &IcomSim::onGetBandwidth },
+    { COMMAND_SET_BANDWIDTH, &IcomSim::onSetBandwidth },
+    { COMMAND_GET_TX_POWER,  &IcomSim::onGetTxPower   },
+    { COMMAND_SET_TX_POWER,  &IcomSim::onSetTxPower   },
+#endif
+#if ICOMSIM_FEATURE_METER
+    { COMMAND_GET_RSSI,      &IcomSim::onGetRssi      },
+    { COMMAND_GET_STATUS,    &IcomSim::onGetStatus    },
+    { COMMAND_SET_AGC,       &IcomSim::onSetAgc       },
+#endif
+#if ICOMSIM_FEATURE_VFO_AB
+    { COMMAND_SELECT_VFO,    &IcomSim::onSelectVfo    },
+    { COMMAND_SPLIT,         &IcomSim::onSplit        },
+#endif
+#if ICOMSIM_FEATURE_MEMORY
+    { COMMAND_SELECT_MEMORY, &IcomSim::onSelectMemory },
+    { COMMAND_MEMORY_WRITE,  &IcomSim::onMemoryWrite  },
+    { COMMAND_MEMORY_TO_VFO, &IcomSim::onMemoryToVfo  },
+    { COMMAND_MEMORY_CLEAR,  &IcomSim::onMemoryClear  },
+#endif
+};
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+
+// Costruttore della classe IcomSim
+IcomSim::IcomSim(Stream& serial)
+{
+    serialPort = &serial;
+    VfoData[0] = nullptr;
+    VfoData[1] = nullptr;
+    civAddress = CIV_ADDRESS_RADIO;
+    frameSink = nullptr;
+    frameSinkCtx = nullptr;
+    replyMuted = false;
+#if ICOMSIM_FEATURE_CAPTURE
+    captureHook = nullptr;
+    captureCtx = nullptr;
+#endif
+    vfoSelected = ICOMSIM_VFO_A;
+    split = false;
+    memset(Flags, 0, sizeof(Flags));
+
+#if ICOMSIM_FEATURE_RX_RING
+    rxRingEnabled = false;
+    rxOverflows = 0;
+#endif
+#if ICOMSIM_FEATURE_CHANGE_API
+    memset(generation, 0, sizeof(generation));
+    memset(changeCallbacks, 0, sizeof(changeCallbacks));
+#endif
+#if ICOMSIM_FEATURE_SNAPSHOT && ICOMSIM_FEATURE_CHANGE_API
+    memset(&snapshotSeen, 0, sizeof(snapshotSeen));
+    snapshotSynced = false;
+#endif
+
+#if ICOMSIM_FEATURE_MEMORY
+    memory = nullptr;
+    memoryChannel = 0;
+    memoryMode = false;
+#endif
+
+#if ICOMSIM_FEATURE_BULK
+    memset(bulkTargets, 0, sizeof(bulkTargets));
+    memset(&bulk, 0, sizeof(bulk));
+#endif
+
+#if ICOMSIM_FEATURE_TRANSCEIVE
+    transceive = false;
+    transceiveWindow = ICOMSIM_TRANSCEIVE_WINDOW_MS;
+    transceiveSince = 0;
+    transceivePending.All = 0;
+#endif
+
+#if ICOMSIM_FEATURE_METER
+    rssi = 0;
+    rssiInterval = 0;
+    rssiAddress = CIV_ADDRESS_BROADCAST;
+    rssiLastSent = 0;
+    rssiLastTime = 0;
+    agc = AGC_AUTO;
+#endif
+
+#if ICOMSIM_HANDLER_INDEX
+    memset(handlerIndex, CIV_NO_HANDLER, sizeof(handlerIndex));
+#else
+    headCount = 0;
+#endif
+    handlerCount = 0;
+
+    for (size_t i = 0; i < sizeof(builtinHandlers) / sizeof(builtinHandlers[0]); i++)
+    {
+        registerHandler(builtinHandlers[i].command, CIV_SUBCMD_ANY, builtinHandlers[i].fn, nullptr);
+    }
+
+#if ICOMSIM_TRACE
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_TRACE_CONTROL, &IcomSim::onTraceControl, nullptr);
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_TRACE_READ, &IcomSim::onTraceRead, nullptr);
+#endif
+#if ICOMSIM_LATENCY
+    latencySlot = ICOMSIM_LATENCY_NO_SLOT;
+    latencyFrameStart = 0;
+    latencyDrainSlot = ICOMSIM_LATENCY_NO_SLOT;
+    latencyDrainLeft = 0;
+    latencyDrainStart = 0;
+    latencyDrainFrame = 0;
+#endif
+#if ICOMSIM_METRICS
+    resetMetrics();
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_METRICS_READ, &IcomSim::onMetricsRead, nullptr);
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_HITS_READ, &IcomSim::onHitsRead, nullptr);
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_METRICS_RESET, &IcomSim::onMetricsReset, nullptr);
+#endif
+#if ICOMSIM_FEATURE_SNAPSHOT
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_SNAPSHOT, &IcomSim::onSnapshot, nullptr);
+#endif
+#if ICOMSIM_FEATURE_LINE_RATE
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_LINE_RATE, &IcomSim::onLineRate, nullptr);
+#endif
+#if ICOMSIM_FEATURE_BULK
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_BULK_BEGIN, &IcomSim::onBulkBegin, nullptr);
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_BULK_DATA, &IcomSim::onBulkData, nullptr);
+    registerHandler(COMMAND_VENDOR, CIV_VENDOR_BULK_END, &IcomSim::onBulkEnd, nullptr);
+#endif
+}
+
+
+#if ICOMSIM_DEBUG
+void debug(const char* message) 
+{
+    #ifndef ESP32
+    debugSerial.println(message); // Funziona solo se debugSerial è definito
+    #endif
+}
+#else
+static inline void debug(const char*) {}                    // Messaggi e seriale di debug esclusi dalla build
+#endif
+
+// ******************************************************************************************************************************
+// Funzione di inizializzazione che accetta una struttura di dati iniziale
+// ******************************************************************************************************************************
+bool IcomSim::Initialize(VfoData_t* initData1, VfoData_t* initData2)
+{
+	// Inizializza la seriale per il debug
+    #if ICOMSIM_DEBUG && !defined(ESP32)
+		debugSerial.begin(9600);
+	#endif 
+	
+    if (initData1 == nullptr || initData2 == nullptr) 
+	{
+        debug("Puntatori errati");
+        return false;
+    }
+
+    // Assegna i puntatori ai membri della classe
+    VfoData[0] = initData1;
+    VfoData[1] = initData2;
+
+    debug("Debug Serial Attivata");
+
+    vfoSelected = ICOMSIM_VFO_A;
+    split = false;
+
+    // Resetta tutti i flag
+    memset(Flags, 0, sizeof(Flags));
+	return true;
+}
+
+
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+void IcomSim::processCIVCommand() 
+{
+#if ICOMSIM_FEATURE_RX_RING
+    if (rxRingEnabled)
+    {
+        // I byte sono gia' stati catturati dall'ISR: si svuota il ring, al massimo ICOMSIM_RX_RING_SIZE byte per chiamata
+        uint8_t byte;
+        uint16_t n = rxRing.used();
+        ICOMSIM_PEAK(ICOMSIM_METRIC_RX_HIGH_WATER, n);
+        for ( ; n > 0 && rxRing.pop(byte); n--) receiveByte(byte);
+        return;
+    }
+#endif
+
+    while (serialPort->available()) 
+    {
+        receiveByte(serialPort->read());
+    }
+}
+
+void IcomSim::receiveByte(uint8_t byte)
+{
+    ICOMSIM_LATENCY_MARK(start);
+    CivParseResult_t result = parser.feed(byte);
+#if ICOMSIM_FEATURE_LINE_RATE
+    lineRate.onByte(byte);
+#endif
+
+    switch (result)
+    {
+        case CIV_PARSE_PENDING:
+            return;
+
+        case CIV_PARSE_FRAME:                               // Frame completo: il parser espone una vista sul proprio buffer
+                                                            // (di qualunque indirizzo: il filtro e' in dispatch())
+        {
+#if ICOMSIM_FEATURE_LINE_RATE
+            lineRate.onFrame();
+#endif
+            ICOMSIM_TRACE_EVENT(CIV_TRACE_RX_FRAME, parser.frame().command, parser.frame().dataLength, 0);
+            ICOMSIM_COUNT(ICOMSIM_METRIC_RX_FRAMES);
+#if ICOMSIM_LATENCY
+            latencySlot = latency.slotFor(parser.frame().command);
+            latencyFrameStart = start;
+            ICOMSIM_LATENCY_RECORD(ICOMSIM_LATENCY_PARSE, start);
+#endif
+#if ICOMSIM_METRICS
+            uint32_t begin = micros();
+            dispatch(parser.frame());
+            uint32_t elapsed = micros() - begin;
+            ICOMSIM_PEAK(ICOMSIM_METRIC_MAX_FRAME_US, elapsed > 0xFFFF ? 0xFFFF : (uint16_t)elapsed);
+#else
+            dispatch(parser.frame());
+#endif
+#if ICOMSIM_LATENCY
+            latencySlot = ICOMSIM_LATENCY_NO_SLOT;
+#endif
+            return;
+        }
+
+        case CIV_PARSE_TOO_SHORT:
+            ICOMSIM_COUNT(ICOMSIM_METRIC_RX_TOO_SHORT);
+            debug("Messaggio CI-V non valido: troppo corto.");
+            break;
+
+        case CIV_PARSE_OVERFLOW:
+            ICOMSIM_COUNT(ICOMSIM_METRIC_RX_OVERFLOW);
+            debug("Messaggio CI-V scartato: buffer pieno.");
+            break;
+
+        default:
+            ICOMSIM_COUNT(ICOMSIM_METRIC_RX_COLLISION);
+            break;
+    }
+#if ICOMSIM_FEATURE_LINE_RATE
+    lineRate.onError();
+#endif
+    ICOMSIM_TRACE_EVENT(CIV_TRACE_RX_ERROR, 0, 0, result);
+#if ICOMSIM_FEATURE_CAPTURE
+    if (captureHook != nullptr)
+    {
+        uint8_t code = (uint8_t)result;
+        captureHook(captureCtx, CIV_CAPTURE_RX_ERROR, &code, 1);
+    }
+#endif
+}
+
+#if ICOMSIM_FEATURE_RX_RING
+// ******************************************************************************************************************************
+// Ricezione disaccoppiata dal loop: un'ISR (o un task di eventi su ESP32) cattura i byte con pushRxByte() o pumpRx()
+// e processCIVCommand() li consuma dal ring. Un solo produttore e un solo consumatore, nessun lock.
+// ******************************************************************************************************************************
+void IcomSim::enableRxRing(bool enable)
+{
+    rxRingEnabled = enable;
+}
+
+// Lato produttore: sicura in ISR
+bool IcomSim::pushRxByte(uint8_t byte)
+{
+    if (rxRing.push(byte)) return true;
+
+    ICOMSIM_STORE_RELEASE(rxOverflows, (uint16_t)(rxOverflows + 1));
+    return false;
+}
+
+// Lato produttore: sposta nel ring tutto quello che la UART ha gia' ricevuto (es. da Serial.onReceive() su ESP32)
+void IcomSim::pumpRx()
+{
+    if (!rxRingEnabled) return;                             // Senza ring processCIVCommand() legge direttamente la seriale
+
+    while (serialPort->available())
+    {
+        pushRxByte(serialPort->read());
+    }
+}
+
+uint16_t IcomSim::getRxOverflows() const
+{
+    ICOMSIM_CRITICAL_BEGIN();
+    uint16_t count = ICOMSIM_LOAD_ACQUIRE(rxOverflows);
+    ICOMSIM_CRITICAL_END();
+    return count;
+}
+#endif
+
+// ******************************************************************************************************************************
+// Registra (o sostituisce) il gestore di un comando. subcommand = CIV_SUBCMD_ANY per ricevere tutti i frame del comando,
+// altrimenti il gestore riceve solo i frame il cui primo byte dati coincide, con la vista dati che parte dopo il sottocomando.
+// fn = nullptr disabilita il gestore. Restituisce false se la tabella e' piena.
+// ******************************************************************************************************************************
+bool IcomSim::registerHandler(uint8_t command, uint16_t subcommand, CivHandler_t fn, void* ctx)
+{
+    // Sostituzione di un gestore gia' presente
+    for (uint8_t slot = firstHandler(command); slot != CIV_NO_HANDLER; slot = handlers[slot].next)
+    {
+        if (handlers[slot].subcommand == subcommand)
+        {
+            handlers[slot].fn = fn;
+            handlers[slot].ctx = ctx;
+            return true;
+        }
+    }
+
+    if (handlerCount >= ICOMSIM_MAX_HANDLERS)
+    {
+        debug("Errore: tabella dei comandi piena");
+        return false;
+    }
+
+    uint8_t slot = handlerCount++;
+    handlers[slot].fn = fn;
+    handlers[slot].ctx = ctx;
+    handlers[slot].subcommand = subcommand;
+    handlers[slot].next = CIV_NO_HANDLER;
+#if ICOMSIM_METRICS
+    handlers[slot].command = command;
+    handlers[slot].hits = 0;
+#endif
+
+    if (subcommand != CIV_SUBCMD_ANY)
+    {
+        // I sottocomandi specifici vanno in testa alla catena: hanno precedenza sul gestore generico
+        uint8_t* link = firstHandlerLink(command);
+        handlers[slot].next = *link;
+        *link = slot;
+    }
+    else
+    {
+        uint8_t* link = firstHandlerLink(command);
+        while (*link != CIV_NO_HANDLER) link = &handlers[*link].next;
+        *link = slot;
+    }
+    return true;
+}
+
+// ******************************************************************************************************************************
+// Primo slot della catena di un comando. Con ICOMSIM_HANDLER_INDEX = 0 la tabella da 256 byte e' sostituita da una lista
+// dei soli comandi registrati (al massimo ICOMSIM_MAX_HANDLERS), scorsa linearmente.
+// ******************************************************************************************************************************
+uint8_t IcomSim::firstHandler(uint8_t command) const
+{
+#if ICOMSIM_HANDLER_INDEX
+    return handlerIndex[command];
+#else
+    for (uint8_t i = 0; i < headCount; i++)
+    {
+        if (heads[i].command == command) return heads[i].first;
+    }
+    return CIV_NO_HANDLER;
+#endif
+}
+
+// Chiamata solo da registerHandler() con handlerCount < ICOMSIM_MAX_HANDLERS: c'e' sempre posto per un nuovo comando
+uint8_t* IcomSim::firstHandlerLink(uint8_t command)
+{
+#if ICOMSIM_HANDLER_INDEX
+    return &handlerIndex[command];
+#else
+    for (uint8_t i = 0; i < headCount; i++)
+    {
+        if (heads[i].command == command) return &heads[i].first;
+    }
+    heads[headCount].command = command;
+    heads[headCount].first = CIV_NO_HANDLER;
+    return &heads[headCount++].first;
+#endif
+}
+
+// ******************************************************************************************************************************
+// Devia i frame in uscita verso fn invece che verso la coda di trasmissione (nullptr ripristina la coda)
+// ******************************************************************************************************************************
+void IcomSim::setFrameSink(CivFrameSink_t fn, void* ctx)
+{
+    frameSink = fn;
+    frameSinkCtx = ctx;
+}
+
+// ******************************************************************************************************************************
+// Elabora un frame completo. I dati sono in prestito dal parser: validi solo durante la chiamata.
+// Ricerca O(1) per comando; la catena per comando contiene solo i sottocomandi registrati.
+// Il filtro sugli indirizzi e' qui e non nel parser: vale anche per i frame che arrivano da handleFrame() (router).
+// Un frame in broadcast viene eseguito ma non riceve risposta: ne' dati, ne' FB/FA.
+// ******************************************************************************************************************************
+void IcomSim::dispatch(const CivFrame_t& frame)
+{
+    if (frame.addressFrom == civAddress) return;            // Eco dei nostri frame sul bus a un filo
+    if (frame.addressTo != civAddress && frame.addressTo != CIV_ADDRESS_BROADCAST) return;     // Per un altro dispositivo
+
+#if ICOMSIM_FEATURE_CAPTURE
+    if (captureHook != nullptr)                             // Il frame ricostruito com'era sulla linea
+    {
+        uint8_t raw[CIV_MAX_FRAME_SIZE];
+        raw[0] = CIV_START_BYTE;
+        raw[1] = CIV_START_BYTE;
+        raw[2] = frame.addressTo;
+        raw[3] = frame.addressFrom;
+        raw[4] = frame.command;
+        memcpy(&raw[5], frame.data, frame.dataLength);
+        raw[5 + frame.dataLength] = CIV_END_BYTE;
+        captureHook(captureCtx, CIV_CAPTURE_RX, raw, (uint16_t)(frame.dataLength + CIV_FRAME_OVERHEAD));
+    }
+#endif
+
+    bool muted = replyMuted;                                // handleFrame() chiamata da un handler
+    replyMuted = (frame.addressTo == CIV_ADDRESS_BROADCAST);
+    route(frame);
+    replyMuted = muted;
+}
+
+void IcomSim::route(const CivFrame_t& frame)
+{
+    ICOMSIM_LATENCY_MARK(lookup);
+
+    CivFrame_t view = frame;                                // Con un sottocomando: vista sui dati che lo seguono
+    uint8_t slot;
+
+    for (slot = firstHandler(frame.command); slot != CIV_NO_HANDLER; slot = handlers[slot].next)
+    {
+        const CivHandlerSlot_t& handler = handlers[slot];
+
+        if (handler.fn == nullptr) continue;
+        if (handler.subcommand == CIV_SUBCMD_ANY) break;
+
+        if (frame.dataLength > 0 && frame.data[0] == handler.subcommand)
+        {
+            view.data++;
+            view.dataLength--;
+            break;
+        }
+    }
+
+    ICOMSIM_LATENCY_RECORD(ICOMSIM_LATENCY_DISPATCH, lookup);
+
+    if (slot == CIV_NO_HANDLER)
+    {
+        if (frame.command == CIV_ACK_OK || frame.command == CIV_ACK_NG) return;     // Mai un NG in risposta a FB/FA
+
+        debug("Comando CI-V non riconosciuto.");
+        reject(frame, 0);
+        return;
+    }
+
+#if ICOMSIM_METRICS
+    handlers[slot].hits++;
+#endif
+    ICOMSIM_LATENCY_MARK(call);
+
+    if (!handlers[slot].fn(*this, view, handlers[slot].ctx)) reject(frame, 1);
+
+    ICOMSIM_LATENCY_RECORD(ICOMSIM_LATENCY_HANDLER, call);
+}
+
+void IcomSim::reject(const CivFrame_t& frame, uint8_t reason)
+{
+    if (replyMuted) return;                                 // Broadcast: nessun NG da tracciare o contare
+
+    ICOMSIM_TRACE_EVENT(CIV_TRACE_NG, frame.command, frame.dataLength, reason);
+    ICOMSIM_COUNT(reason == 0 ? ICOMSIM_METRIC_NG_UNKNOWN : ICOMSIM_METRIC_NG_REJECTED);
+    (void)reason;                                           // Senza traccia e contatori non serve
+    send_ack(false, frame.addressFrom, frame.addressTo);
+}
+
+// ******************************************************************************************************************************
+// Decodifica una frequenza (o un passo) da 5 o 6 byte BCD. Il campo non viene modificato se i dati non sono validi.
+// ******************************************************************************************************************************
+template <typename T>
+static bool decodeFrequency(const CivFrame_t& frame, T& value)
+{
+    if (frame.dataLength >= 6) return civBcdDecode<6, CIV_BCD_RX_LAYOUT>(frame.data, value);
+    if (frame.dataLength == 5) return civBcdDecode<5, CIV_BCD_RX_LAYOUT>(frame.data, value);
+    return false;
+}
+
+// ******************************************************************************************************************************
+// Gestori dei comandi predefiniti. Restituiscono false per rispondere NG (0xFA) al controller.
+// ******************************************************************************************************************************
+
+// ---------------------------------------------------- FREQUENCY
+bool IcomSim::onGetFrequency(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    sim.send_frequency(frame.command, sim.VfoData[sim.vfoSelected]->Frequency, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+bool IcomSim::onSetFrequency(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (!decodeFrequency(frame, sim.VfoData[sim.vfoSelected]->Frequency)) return false;
+
+    sim.markChanged(sim.vfoSelected, FLAG_FREQUENCY_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- STEP
+bool IcomSim::onGetStep(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    sim.send_frequency(frame.command, sim.VfoData[sim.vfoSelected]->Step, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+bool IcomSim::onSetStep(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (!decodeFrequency(frame, sim.VfoData[sim.vfoSelected]->Step)) return false;
+
+    sim.markChanged(sim.vfoSelected, FLAG_STEP_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- MODE
+bool IcomSim::onSetMode(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0) return false;
+
+    sim.VfoData[sim.vfoSelected]->Mode = static_cast<BK4819_Mode_t>(frame.data[0]);
+    sim.markChanged(sim.vfoSelected, FLAG_MODE_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+#if ICOMSIM_FEATURE_SETTINGS
+// ---------------------------------------------------- SQUELCH
+bool IcomSim::onGetSquelch(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    sim.send_command(frame.command, sim.VfoData[sim.vfoSelected]->Sql, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+bool IcomSim::onSetSquelch(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0) return false;
+
+    sim.VfoData[sim.vfoSelected]->Sql = frame.data[0];
+    sim.markChanged(sim.vfoSelected, FLAG_SQL_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- RFGAIN
+bool IcomSim::onGetRfGain(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    sim.send_command(frame.command, sim.VfoData[sim.vfoSelected]->Gain, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+bool IcomSim::onSetRfGain(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0) return false;
+
+    sim.VfoData[sim.vfoSelected]->Gain = frame.data[0];
+    sim.markChanged(sim.vfoSelected, FLAG_GAIN_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- MONITOR
+bool IcomSim::onSetMonitor(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    sim.markChanged(ICOMSIM_RADIO_FLAGS, FLAG_MONITOR_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- BANDWITH
+bool IcomSim::onGetBandwidth(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    sim.send_command(frame.command, sim.VfoData[sim.vfoSelected]->bw, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+bool IcomSim::onSetBandwidth(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0) return false;
+
+    sim.VfoData[sim.vfoSelected]->bw = static_cast<BK4819_Filter_Bandwidth_t>(frame.data[0]);
+    sim.markChanged(sim.vfoSelected, FLAG_BW_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- TXPOWER
+bool IcomSim::onGetTxPower(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    sim.send_command(frame.command, sim.VfoData[sim.vfoSelected]->txp, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+bool IcomSim::onSetTxPower(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0) return false;
+
+    sim.VfoData[sim.vfoSelected]->txp = frame.data[0];
+    sim.markChanged(sim.vfoSelected, FLAG_TXP_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+#endif
+
+#if ICOMSIM_FEATURE_METER
+// ---------------------------------------------------- RSSI
+// Senza dati: risponde con l'ultimo valore impostato da setRssi(). Con un byte: avvia (1-99, in decine di ms)
+// o ferma (0) l'invio periodico verso chi ha fatto la richiesta.
+bool IcomSim::onGetRssi(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0)
+    {
+        sim.send_rssi(sim.rssi, frame.addressFrom, frame.addressTo);
+        return true;
+    }
+
+    uint8_t interval;
+    if (!civBcdDecode<1>(frame.data, interval)) return false;
+
+    sim.setRssiStreaming((uint16_t)interval * 10, frame.addressFrom);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- STATUS
+bool IcomSim::onGetStatus(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint8_t vfo = frame.dataLength > 0 ? frame.data[0] : sim.vfoSelected;
+    if (vfo > 1) return false;
+
+    sim.send_status(vfo, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- AGC
+// Senza dati restituisce il valore corrente, come per gli altri comandi Icom di impostazione
+bool IcomSim::onSetAgc(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0)
+    {
+        sim.send_command(frame.command, sim.agc, frame.addressFrom, frame.addressTo);
+        return true;
+    }
+
+    if (frame.data[0] > AGC_FAST) return false;
+
+    sim.agc = frame.data[0];
+    sim.markChanged(ICOMSIM_RADIO_FLAGS, FLAG_AGC_CHANGED);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+#endif
+
+#if ICOMSIM_FEATURE_VFO_AB
+// ---------------------------------------------------- VFO
+// 0x07 senza dati: modo VFO; 0x00/0x01 selezione A/B; 0xA0 A=B (copia il VFO selezionato sull'altro); 0xB0 scambio A/B
+bool IcomSim::onSelectVfo(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength > 0)
+    {
+        switch (frame.data[0])
+        {
+            case CIV_VFO_A:
+            case CIV_VFO_B:
+                sim.selectVfo(frame.data[0]);
+                break;
+
+            case CIV_VFO_EQUALIZE:
+                sim.equalizeVfo();
+                break;
+
+            case CIV_VFO_EXCHANGE:
+                sim.exchangeVfo();
+                break;
+
+            default:
+                return false;
+        }
+    }
+#if ICOMSIM_FEATURE_MEMORY
+    else if (sim.memoryMode)
+    {
+        sim.memoryMode = false;
+        sim.markChanged(ICOMSIM_RADIO_FLAGS, FLAG_VFO_CHANGED);
+    }
+#endif
+
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// ---------------------------------------------------- SPLIT
+// 0x00 disattivo, 0x01 attivo; senza dati restituisce lo stato corrente
+bool IcomSim::onSplit(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0)
+    {
+        sim.send_command(frame.command, sim.split ? 0x01 : 0x00, frame.addressFrom, frame.addressTo);
+        return true;
+    }
+
+    if (frame.data[0] > 0x01) return false;
+
+    sim.setSplit(frame.data[0] == 0x01);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+#endif
+
+#if ICOMSIM_FEATURE_MEMORY
+// ---------------------------------------------------- MEMORIE
+// 0x08 senza dati: modo memoria sul canale corrente; con 2 byte BCD (es. 00 12): seleziona il canale 12
+bool IcomSim::onSelectMemory(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint16_t channel = sim.memoryChannel;
+
+    if (frame.dataLength == 2)
+    {
+        if (!civBcdDecode<2, CIV_BCD_MSB_FIRST>(frame.data, channel)) return false;
+    }
+    else if (frame.dataLength != 0) return false;
+
+    if (!sim.selectMemory(channel)) return false;
+
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// 0x09: il VFO selezionato viene scritto nel canale selezionato
+bool IcomSim::onMemoryWrite(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength != 0 || sim.memory == nullptr) return false;
+    if (!sim.memory->store(sim.memoryChannel, *sim.VfoData[sim.vfoSelected])) return false;
+
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// 0x0A: il canale selezionato viene copiato nel VFO selezionato, la radio torna in modo VFO
+bool IcomSim::onMemoryToVfo(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength != 0 || !sim.recallMemory()) return false;
+
+    if (sim.memoryMode)
+    {
+        sim.memoryMode = false;
+        sim.markChanged(ICOMSIM_RADIO_FLAGS, FLAG_VFO_CHANGED);
+    }
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// 0x0B: cancella il canale selezionato
+bool IcomSim::onMemoryClear(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength != 0 || sim.memory == nullptr) return false;
+    if (!sim.memory->clear(sim.memoryChannel)) return false;
+
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+#endif
+
+#if ICOMSIM_TRACE || ICOMSIM_METRICS
+// Indice di partenza delle letture COMMAND_VENDOR: assente (0), 1 o 2 byte a 7 bit, byte basso prima
+static bool vendorIndex(const CivFrame_t& frame, uint16_t& index)
+{
+    index = 0;
+    if (frame.dataLength > 2) return false;
+
+    for (uint8_t i = 0; i < frame.dataLength; i++)
+    {
+        if (frame.data[i] & 0x80) return false;
+        index |= (uint16_t)frame.data[i] << (7 * i);
+    }
+    return true;
+}
+#endif
+
+#if ICOMSIM_TRACE
+// ---------------------------------------------------- TRACCIA (COMMAND_VENDOR)
+// 7F 00 01 congela, 7F 00 00 riprende; senza dati restituisce lo stato (impacchettato a 7 bit come le letture)
+bool IcomSim::onTraceControl(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength == 0)
+    {
+        uint8_t state = sim.trace.isFrozen() ? 0x01 : 0x00;
+        return sim.send_packed(frame.command, CIV_VENDOR_TRACE_CONTROL, &state, 1, frame.addressFrom, frame.addressTo);
+    }
+
+    if (frame.data[0] > 0x01) return false;
+
+    sim.trace.freeze(frame.data[0] == 0x01);
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+
+// 7F 01 [indice basso, indice alto] (7 bit ciascuno). Risposta: sequenza (2), disponibili (2), quanti (1), poi i record.
+// Va letta a traccia congelata, altrimenti gli stessi frame della lettura spostano gli indici.
+bool IcomSim::onTraceRead(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint8_t raw[5 + CIV_TRACE_PER_FRAME * CIV_TRACE_RECORD_SIZE];
+    uint16_t index;
+
+    if (!vendorIndex(frame, index)) return false;
+
+    uint16_t sequence = sim.trace.getSequence();
+    uint16_t available = sim.trace.available();
+    uint8_t count = 0;
+
+    while (count < CIV_TRACE_PER_FRAME && (uint16_t)(index + count) < available)
+    {
+        IcomSimTrace_t::serialize(sim.trace.at(index + count), &raw[5 + count * CIV_TRACE_RECORD_SIZE]);
+        count++;
+    }
+
+    raw[0] = (uint8_t)sequence;
+    raw[1] = (uint8_t)(sequence >> 8);
+    raw[2] = (uint8_t)available;
+    raw[3] = (uint8_t)(available >> 8);
+    raw[4] = count;
+
+    return sim.send_packed(frame.command, CIV_VENDOR_TRACE_READ, raw, 5 + count * CIV_TRACE_RECORD_SIZE, frame.addressFrom, frame.addressTo);
+}
+#endif
+
+#if ICOMSIM_METRICS
+// ---------------------------------------------------- CONTATORI (COMMAND_VENDOR)
+// 7F 02 [indice]. Risposta: totale, indice, quanti, poi i contatori uint16_t little endian
+bool IcomSim::onMetricsRead(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint8_t raw[3 + CIV_METRICS_PER_FRAME * 2];
+    uint16_t index;
+
+    if (!vendorIndex(frame, index)) return false;
+
+    uint8_t count = 0;
+    while (count < CIV_METRICS_PER_FRAME && index + count < ICOMSIM_METRIC_COUNT)
+    {
+        uint16_t value = sim.getMetric((uint8_t)(index + count));
+        raw[3 + count * 2] = (uint8_t)value;
+        raw[4 + count * 2] = (uint8_t)(value >> 8);
+        count++;
+    }
+
+    raw[0] = ICOMSIM_METRIC_COUNT;
+    raw[1] = (uint8_t)index;
+    raw[2] = count;
+
+    return sim.send_packed(frame.command, CIV_VENDOR_METRICS_READ, raw, 3 + count * 2, frame.addressFrom, frame.addressTo);
+}
+
+// 7F 03 [indice]. Risposta: slot registrati, indice, quanti, poi per slot comando, sottocomando (2), frame ricevuti (2)
+bool IcomSim::onHitsRead(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint8_t raw[3 + CIV_HITS_PER_FRAME * 5];
+    uint16_t index;
+
+    if (!vendorIndex(frame, index)) return false;
+
+    uint8_t count = 0;
+    while (count < CIV_HITS_PER_FRAME && index + count < sim.handlerCount)
+    {
+        const CivHandlerSlot_t& slot = sim.handlers[index + count];
+        uint8_t* p = &raw[3 + count * 5];
+        p[0] = slot.command;
+        p[1] = (uint8_t)slot.subcommand;
+        p[2] = (uint8_t)(slot.subcommand >> 8);
+        p[3] = (uint8_t)slot.hits;
+        p[4] = (uint8_t)(slot.hits >> 8);
+        count++;
+    }
+
+    raw[0] = sim.handlerCount;
+    raw[1] = (uint8_t)index;
+    raw[2] = count;
+
+    return sim.send_packed(frame.command, CIV_VENDOR_HITS_READ, raw, 3 + count * 5, frame.addressFrom, frame.addressTo);
+}
+
+bool IcomSim::onMetricsReset(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    if (frame.dataLength != 0) return false;
+
+    sim.resetMetrics();
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+#endif
+
+#if ICOMSIM_FEATURE_SNAPSHOT
+// ---------------------------------------------------- ISTANTANEA (COMMAND_VENDOR)
+static uint8_t snapshotPut32(uint8_t* out, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++) out[i] = (uint8_t)(value >> (8 * i));
+    return 4;
+}
+
+// Record di un VFO: vfo, maschera, campi presenti nell'ordine dei bit FLAG_*
+static uint8_t snapshotRecord(const VfoData_t& v, uint8_t vfo, uint16_t mask, uint8_t* out)
+{
+    uint8_t n = 0;
+
+    out[n++] = vfo;
+    out[n++] = (uint8_t)mask;
+    out[n++] = (uint8_t)(mask >> 8);
+    if (mask & FLAG_FREQUENCY_CHANGED) n += snapshotPut32(&out[n], v.Frequency);
+    if (mask & FLAG_MODE_CHANGED)      out[n++] = (uint8_t)v.Mode;
+    if (mask & FLAG_SQL_CHANGED)       out[n++] = v.Sql;
+    if (mask & FLAG_GAIN_CHANGED)      out[n++] = v.Gain;
+    if (mask & FLAG_BW_CHANGED)        out[n++] = (uint8_t)v.bw;
+    if (mask & FLAG_TXP_CHANGED)       out[n++] = v.txp;
+    if (mask & FLAG_STEP_CHANGED)      n += snapshotPut32(&out[n], v.Step);
+    return n;
+}
+
+// 7F 09 [vfo] [opzioni]: un solo scambio al posto di una richiesta per campo (layout in IcomSim.h, CIV_SNAPSHOT_VERSION)
+bool IcomSim::onSnapshot(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint8_t select = frame.dataLength > 0 ? frame.data[0] : CIV_SNAPSHOT_SELECTED;
+    uint8_t options = frame.dataLength > 1 ? frame.data[1] : 0;
+
+    if (frame.dataLength > 2 || select > CIV_SNAPSHOT_BOTH || options > CIV_SNAPSHOT_CHANGED_ONLY) return false;
+
+    uint8_t vfos = select == CIV_SNAPSHOT_SELECTED ? (uint8_t)(1 << sim.vfoSelected) : select;
+    bool changedOnly = false;
+#if ICOMSIM_FEATURE_CHANGE_API
+    changedOnly = (options & CIV_SNAPSHOT_CHANGED_ONLY) != 0;
+#endif
+
+    uint8_t raw[CIV_7BIT_RAW_SIZE(CIV_MAX_PAYLOAD - 1)];
+    raw[0] = CIV_SNAPSHOT_VERSION;
+    raw[1] = (uint8_t)((sim.vfoSelected == ICOMSIM_VFO_B ? CIV_SNAPSHOT_STATE_VFO_B : 0) |
+                       (sim.split ? CIV_SNAPSHOT_STATE_SPLIT : 0) |
+                       (changedOnly ? CIV_SNAPSHOT_STATE_CHANGED : 0));
+#if ICOMSIM_FEATURE_MEMORY
+    if (sim.memoryMode) raw[1] |= CIV_SNAPSHOT_STATE_MEMORY;
+#endif
+#if ICOMSIM_FEATURE_METER
+    raw[2] = sim.agc;
+#else
+    raw[2] = 0xFF;
+#endif
+    raw[3] = 0;
+    uint8_t n = CIV_SNAPSHOT_HEADER;
+
+    for (uint8_t vfo = ICOMSIM_VFO_A; vfo <= ICOMSIM_VFO_B; vfo++)
+    {
+        if (!(vfos & (1 << vfo))) continue;
+
+        uint16_t mask = CIV_SNAPSHOT_FIELDS;
+#if ICOMSIM_FEATURE_CHANGE_API
+        uint16_t changed = sim.pollChanges(sim.snapshotSeen, vfo) & CIV_SNAPSHOT_FIELDS;   // Anche l'istantanea completa fa da riferimento
+        if (changedOnly && sim.snapshotSynced) mask = changed;
+#endif
+
+        if ((size_t)n + CIV_SNAPSHOT_RECORD_MAX > sizeof(raw))  // Frame piccoli: un record per frame
+        {
+            sim.send_packed(frame.command, CIV_VENDOR_SNAPSHOT, raw, n, frame.addressFrom, frame.addressTo);
+            raw[3] = 0;
+            n = CIV_SNAPSHOT_HEADER;
+        }
+
+        n += snapshotRecord(*sim.VfoData[vfo], vfo, mask, &raw[n]);
+        raw[3]++;
+    }
+#if ICOMSIM_FEATURE_CHANGE_API
+    sim.snapshotSynced = true;
+#endif
+
+    return sim.send_packed(frame.command, CIV_VENDOR_SNAPSHOT, raw, n, frame.addressFrom, frame.addressTo);
+}
+#endif
+
+#if ICOMSIM_FEATURE_LINE_RATE
+// ---------------------------------------------------- VELOCITA' DELLA LINEA (COMMAND_VENDOR)
+// 7F 08: velocita' attuale (4), di base (4), stato, auto-baud. 7F 08 <baud>: ACK alla velocita' attuale, poi il cambio.
+bool IcomSim::onLineRate(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint8_t raw[10];
+
+    if (frame.dataLength == 0)
+    {
+        uint32_t rate = sim.lineRate.getRate(), base = sim.lineRate.getBaseRate();
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            raw[i] = (uint8_t)(rate >> (8 * i));
+            raw[4 + i] = (uint8_t)(base >> (8 * i));
+        }
+        raw[8] = sim.lineRate.getState();
+        raw[9] = sim.lineRate.isAutoBaud() ? 1 : 0;
+        return sim.send_packed(frame.command, CIV_VENDOR_LINE_RATE, raw, sizeof(raw), frame.addressFrom, frame.addressTo);
+    }
+
+    if (frame.dataLength != CIV_7BIT_PACKED_SIZE(4) || civUnpack7(frame.data, frame.dataLength, raw) != 4) return false;
+
+    uint32_t baud = (uint32_t)raw[0] | ((uint32_t)raw[1] << 8) | ((uint32_t)raw[2] << 16) | ((uint32_t)raw[3] << 24);
+    if (sim.frameSink != nullptr || !sim.lineRate.request(baud)) return false;   // Con un frame sink la seriale non e' di IcomSim
+
+    sim.send_ack(true, frame.addressFrom, frame.addressTo);
+    return true;
+}
+#endif
+
+#if ICOMSIM_FEATURE_BULK
+// ---------------------------------------------------- TRASFERIMENTO A BLOCCHI (COMMAND_VENDOR)
+// Risposta comune di 7F 05/06/07: esito e prossima unita' attesa
+bool IcomSim::sendBulkStatus(const CivFrame_t& frame, uint8_t subcommand, uint8_t status)
+{
+    uint8_t raw[3] = { status, (uint8_t)bulk.next, (uint8_t)(bulk.next >> 8) };
+    return send_packed(frame.command, subcommand, raw, sizeof(raw), frame.addressFrom, frame.addressTo);
+}
+
+// 7F 05 target first(2) count(2) window. La stessa richiesta a sessione aperta la riprende da next.
+bool IcomSim::onBulkBegin(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    uint8_t raw[6];
+
+    if (frame.dataLength != CIV_7BIT_PACKED_SIZE(sizeof(raw))) return false;
+    if (civUnpack7(frame.data, frame.dataLength, raw) != sizeof(raw)) return false;
+
+    uint8_t target = raw[0];
+    uint16_t first = (uint16_t)(raw[1] | (raw[2] << 8));
+    uint16_t count = (uint16_t)(raw[3] | (raw[4] << 8));
+    uint8_t window = raw[5] ? raw[5] : 1;
+
+    if (target >= ICOMSIM_BULK_TARGETS || sim.bulkTargets[target] == nullptr) return false;
+
+    IcomSimBulkTarget* t = sim.bulkTargets[target];
+    uint16_t perBlock = (CIV_BULK_RAW_MAX - CIV_BULK_BLOCK_OVERHEAD) / t->unitSize();
+    if (perBlock > t->burst()) perBlock = t->burst();
+    if (perBlock == 0 || count == 0 || (uint32_t)first + count > t->capacity()) return false;
+
+    BulkSession_t& b = sim.bulk;
+    if (!(b.active && b.target == target && b.first == first && b.count == count))
+    {
+        b.target = target;
+        b.first = first;
+        b.count = count;
+        b.next = 0;
+        b.active = true;
+    }
+    b.window = window;
+    b.unacked = 0;
+    b.nakSent = false;
+
+    uint8_t reply[5] = { CIV_BULK_OK, (uint8_t)b.next, (uint8_t)(b.next >> 8), window, (uint8_t)perBlock };
+    return sim.send_packed(frame.command, CIV_VENDOR_BULK_BEGIN, reply, sizeof(reply), frame.addressFrom, frame.addressTo);
+}
+
+// 7F 06 offset(2) unita'... crc(2). Risponde solo a fine finestra, a fine trasferimento o al primo errore.
+bool IcomSim::onBulkData(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    BulkSession_t& b = sim.bulk;
+    uint8_t raw[CIV_BULK_RAW_MAX];
+
+    if (!b.active) return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_DATA, CIV_BULK_NO_SESSION);
+
+    IcomSimBulkTarget* t = sim.bulkTargets[b.target];
+    uint8_t size = t->unitSize();
+    uint16_t n = civUnpack7(frame.data, frame.dataLength, raw);
+    uint8_t status = CIV_BULK_OK;
+
+    if (n < CIV_BULK_BLOCK_OVERHEAD + size || (n - CIV_BULK_BLOCK_OVERHEAD) % size != 0 ||
+        civCrc16(raw, n - 2) != (uint16_t)(raw[n - 2] | (raw[n - 1] << 8)))
+    {
+        status = CIV_BULK_CRC;
+    }
+    else
+    {
+        uint16_t offset = (uint16_t)(raw[0] | (raw[1] << 8));
+        uint16_t units = (n - CIV_BULK_BLOCK_OVERHEAD) / size;
+
+        if (offset < b.next && offset + units <= b.next) return true;     // Ritrasmissione di un blocco gia' scritto
+        if (offset != b.next || (uint32_t)offset + units > b.count) status = CIV_BULK_SEQUENCE;
+        else if (units > t->room()) status = CIV_BULK_BUSY;             // Il target non puo' scrivere senza bloccare
+        else
+        {
+            for (uint16_t i = 0; i < units; i++)
+            {
+                if (!t->write(b.first + b.next, &raw[2 + i * size]))
+                {
+                    b.active = false;
+                    return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_DATA, CIV_BULK_FAILED);
+                }
+                b.next++;
+            }
+
+            b.nakSent = false;
+            if (++b.unacked < b.window && b.next < b.count) return true;
+
+            b.unacked = 0;
+            return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_DATA, CIV_BULK_OK);
+        }
+    }
+
+    // Un solo NAK per perdita: i blocchi gia' in volo dietro quello perso vengono scartati in silenzio
+    if (b.nakSent) return true;
+
+    b.nakSent = true;
+    b.unacked = 0;
+    return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_DATA, status);
+}
+
+// 7F 07 chiude il trasferimento completo (finish() del target); 7F 07 01 lo annulla
+bool IcomSim::onBulkEnd(IcomSim& sim, const CivFrame_t& frame, void*)
+{
+    BulkSession_t& b = sim.bulk;
+
+    if (frame.dataLength > 1 || (frame.dataLength == 1 && frame.data[0] != 0x01)) return false;
+    if (!b.active) return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_END, CIV_BULK_NO_SESSION);
+
+    if (frame.dataLength == 1)
+    {
+        b.active = false;
+        return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_END, CIV_BULK_OK);
+    }
+
+    if (b.next < b.count) return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_END, CIV_BULK_INCOMPLETE);
+
+    b.active = false;
+    bool done = sim.bulkTargets[b.target]->finish();
+    return sim.sendBulkStatus(frame, CIV_VENDOR_BULK_END, done ? CIV_BULK_OK : CIV_BULK_FAILED);
+}
+#endif
+
+// ******************************************************************************************************************************
+// Gestione VFO A/B. Lo scambio e l'uguaglianza copiano i contenuti: i puntatori passati a Initialize() restano validi.
+// ******************************************************************************************************************************
+void IcomSim::selectVfo(uint8_t vfo)
+{
+    if (vfo > ICOMSIM_VFO_B || vfo == vfoSelected) return;
+
+    vfoSelected = vfo;
+    markChanged(ICOMSIM_RADIO_FLAGS, FLAG_VFO_CHANGED);
+}
+
+void IcomSim::equalizeVfo()
+{
+    uint8_t other = vfoSelected ^ 1;
+
+    *VfoData[other] = *VfoData[vfoSelected];
+    markChanged(other, FLAG_VFO_FIELDS);
+}
+
+void IcomSim::exchangeVfo()
 {
-    uint8_t data[32];
-    size_t length;
-};
+    VfoData_t temp = *VfoData[ICOMSIM_VFO_A];
+    *VfoData[ICOMSIM_VFO_A] = *VfoData[ICOMSIM_VFO_B];
+    *VfoData[ICOMSIM_VFO_B] = temp;
+
+    markChanged(ICOMSIM_VFO_A, FLAG_VFO_FIELDS);
+    markChanged(ICOMSIM_VFO_B, FLAG_VFO_FIELDS);
+}
 
-// Inizializza la coda con dimensione massima
-ArduinoQueue<SerialMessage> serialQueue(QUEUE_MAX_SIZE);
+void IcomSim::setSplit(bool enable)
+{
+    if (split == enable) return;
 
+    split = enable;
+    markChanged(ICOMSIM_RADIO_FLAGS, FLAG_SPLIT_CHANGED);
+}
 
+#if ICOMSIM_FEATURE_MEMORY
 // ******************************************************************************************************************************
-//
+// Canali di memoria: la selezione porta la radio in modo memoria e, se il canale e' occupato, lo carica nel VFO selezionato
 // ******************************************************************************************************************************
+bool IcomSim::selectMemory(uint16_t channel)
+{
+    if (memory == nullptr || channel >= memory->getChannelCount()) return false;
 
-// Costruttore della classe IcomSim
-IcomSim::IcomSim(Stream& serial)
+    memoryChannel = channel;
+    if (!memoryMode)
+    {
+        memoryMode = true;
+        markChanged(ICOMSIM_RADIO_FLAGS, FLAG_VFO_CHANGED);
+    }
+
+    if (memory->isUsed(channel)) recallMemory();
+    return true;
+}
+
+bool IcomSim::recallMemory()
 {
-    serialPort = &serial;
+    if (memory == nullptr || !memory->load(memoryChannel, *VfoData[vfoSelected])) return false;
+
+    markChanged(vfoSelected, FLAG_VFO_FIELDS);
+    return true;
 }
+#endif
 
+#if ICOMSIM_FEATURE_BULK
+// ******************************************************************************************************************************
+// Destinazioni dei trasferimenti a blocchi; staccare quella di una sessione aperta la chiude
+// ******************************************************************************************************************************
+bool IcomSim::attachBulkTarget(uint8_t id, IcomSimBulkTarget* target)
+{
+    if (id >= ICOMSIM_BULK_TARGETS) return false;
 
-void debug(const char* message) 
+    if (bulk.active && bulk.target == id) bulk.active = false;
+    bulkTargets[id] = target;
+    return true;
+}
+#endif
+
+#if ICOMSIM_FEATURE_METER
+// ******************************************************************************************************************************
+// Valore RSSI in cache: il firmware lo aggiorna quando legge il BK4819, le richieste CI-V non toccano mai il chip
+// ******************************************************************************************************************************
+void IcomSim::setRssi(uint16_t value)
 {
-    #ifndef ESP32
-    debugSerial.println(message); // Funziona solo se debugSerial è definito
-    #endif
+    rssi = value;
 }
 
 // ******************************************************************************************************************************
-// Funzione di inizializzazione che accetta una struttura di dati iniziale
+// Invio periodico dell'RSSI (pannelli/panadapter): al massimo un frame ogni intervalMs e solo se il valore e' cambiato.
+// intervalMs = 0 ferma l'invio.
 // ******************************************************************************************************************************
-bool IcomSim::Initialize(VfoData_t* initData1, VfoData_t* initData2)
+void IcomSim::setRssiStreaming(uint16_t intervalMs, uint8_t address)
 {
-	// Inizializza la seriale per il debug
-    #ifndef ESP32 
-		debugSerial.begin(9600);
-	#endif 
-	
-    if (initData1 == nullptr || initData2 == nullptr) 
-	{
-        debug("Puntatori errati");
-        return false;
+    if (intervalMs != 0 && intervalMs < ICOMSIM_RSSI_MIN_INTERVAL_MS) intervalMs = ICOMSIM_RSSI_MIN_INTERVAL_MS;
+
+    rssiInterval = intervalMs;
+    rssiAddress = address;
+    rssiLastSent = 0xFFFF;                                  // Il primo campione parte comunque
+    rssiLastTime = millis() - intervalMs;
+}
+
+void IcomSim::processRssiStream()
+{
+    if (rssiInterval == 0 || rssi == rssiLastSent) return;
+    if ((uint32_t)(millis() - rssiLastTime) < rssiInterval) return;
+    if (!canSend(8)) return;
+
+    send_rssi(rssi, rssiAddress, civAddress);
+    rssiLastSent = rssi;
+    rssiLastTime = millis();
+}
+#endif
+
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
+
+uint16_t IcomSim::isChanged()
+{
+    uint16_t changedFlags = 0;
+
+    for (uint8_t i = 0; i <= ICOMSIM_RADIO_FLAGS; i++)
+    {
+        changedFlags |= ICOMSIM_EXCHANGE(Flags[i].All, (uint16_t)0);
     }
 
-    // Assegna i puntatori ai membri della classe
-    VfoData[0] = initData1;
-    VfoData[1] = initData2;
+    return changedFlags; // Restituisci tutti i flag attivi (0 se nessuno è attivo)
+}
 
-    debug("Debug Serial Attivata");
+// Flag di un solo VFO (ICOMSIM_VFO_A/B) o della radio (ICOMSIM_RADIO_FLAGS: monitor, AGC, selezione VFO, split)
+uint16_t IcomSim::isChanged(uint8_t vfo)
+{
+    if (vfo > ICOMSIM_RADIO_FLAGS) return 0;
 
-    // Resetta tutti i flag
-    memset(&Flags, 0, sizeof(Flags_t));
-	return true;
+    // Lettura e azzeramento in un'unica operazione atomica: un flag impostato nel frattempo dal lato ricezione non va perso
+    return ICOMSIM_EXCHANGE(Flags[vfo].All, (uint16_t)0);
 }
 
+// ******************************************************************************************************************************
+// Registra una modifica: contatori di generazione, flag per isChanged() e callback, in quest'ordine. Chiamabile da qualunque
+// contesto (ricezione, executor, firmware): le scritture sono operazioni atomiche.
+// ******************************************************************************************************************************
+void IcomSim::markChanged(uint8_t vfo, uint16_t flags)
+{
+#if ICOMSIM_FEATURE_CHANGE_API
+    for (uint8_t field = 0; field < ICOMSIM_CHANGE_FIELDS; field++)
+    {
+        if (flags & (1u << field)) ICOMSIM_FETCH_ADD(generation[vfo][field], (IcomSimGen_t)1);
+    }
+#endif
+
+    ICOMSIM_FETCH_OR(Flags[vfo].All, flags);
 
+#if ICOMSIM_FEATURE_CHANGE_API
+    for (uint8_t i = 0; i < ICOMSIM_MAX_CHANGE_CALLBACKS; i++)
+    {
+        const ChangeCallback_t& cb = changeCallbacks[i];
+        if (cb.fn != nullptr && (cb.mask & flags)) cb.fn(*this, vfo, flags & cb.mask, cb.ctx);
+    }
+#endif
+}
 
+#if ICOMSIM_FEATURE_CHANGE_API
 // ******************************************************************************************************************************
-//
+// Consumatori multipli: ognuno tiene le generazioni gia' viste e riceve solo le modifiche successive, senza toccare i flag
+// letti da isChanged() ne' lo stato degli altri consumatori. counts (ICOMSIM_CHANGE_FIELDS elementi) riceve quante volte e'
+// cambiato ogni campo, per distinguere "cambiato due volte" da "cambiato una volta".
 // ******************************************************************************************************************************
-void IcomSim::processCIVCommand() 
+void IcomSim::subscribe(IcomSimSubscriber_t& subscriber) const
+{
+    for (uint8_t vfo = 0; vfo <= ICOMSIM_RADIO_FLAGS; vfo++)
+    {
+        for (uint8_t field = 0; field < ICOMSIM_CHANGE_FIELDS; field++) subscriber.seen[vfo][field] = getGeneration(vfo, field);
+    }
+}
+
+uint16_t IcomSim::pollChanges(IcomSimSubscriber_t& subscriber, uint8_t vfo, uint8_t* counts) const
 {
-    static uint8_t responseBuffer[32];  // Buffer statico per accumulare i dati ricevuti (32 byte come dimensione massima)
-    static uint8_t bufferIndex = 0;     // Indice per tracciare la posizione corrente nel buffer
+    if (vfo > ICOMSIM_RADIO_FLAGS) return 0;
 
-    while (serialPort->available()) 
+    uint16_t changedFlags = 0;
+    for (uint8_t field = 0; field < ICOMSIM_CHANGE_FIELDS; field++)
     {
-        uint8_t byte = serialPort->read();
+        IcomSimGen_t now = getGeneration(vfo, field);
+        IcomSimGen_t delta = (IcomSimGen_t)(now - subscriber.seen[vfo][field]);
+        subscriber.seen[vfo][field] = now;
 
-        // Aggiungi il byte al buffer
-        if (bufferIndex < sizeof(responseBuffer))
-        {
-            responseBuffer[bufferIndex++] = byte;
-        }
+        if (delta != 0) changedFlags |= (uint16_t)(1u << field);
+        if (counts != nullptr) counts[field] = delta > 0xFF ? 0xFF : (uint8_t)delta;
+    }
+    return changedFlags;
+}
 
-        // Se troviamo i due byte di inizio consecutivi (0xFE 0xFE), inizia un nuovo messaggio
-        if (bufferIndex >= 2 &&
-            responseBuffer[bufferIndex - 2] == CIV_START_BYTE &&
-            responseBuffer[bufferIndex - 1] == CIV_START_BYTE)
-        {
-            bufferIndex = 2;  // Inizia un nuovo messaggio, mantieni solo i due byte di inizio
-            // debugSerial.println("Nuovo messaggio CI-V iniziato.");
-        }
+IcomSimGen_t IcomSim::getGeneration(uint8_t vfo, uint8_t field) const
+{
+    if (vfo > ICOMSIM_RADIO_FLAGS || field >= ICOMSIM_CHANGE_FIELDS) return 0;
+    return ICOMSIM_LOAD_ACQUIRE(generation[vfo][field]);
+}
 
-        // Se troviamo il terminatore (CIV_END_BYTE), il messaggio è completo
-        if (byte == CIV_END_BYTE)
-        {
-            if (bufferIndex >= 6)  // Un messaggio CI-V valido deve avere almeno 6 byte
-            {
-                uint8_t addressTo = responseBuffer[2];
-                uint8_t addressFrom = responseBuffer[3];
-                // uint8_t command = responseBuffer[4];
-                
-                // Calcola la lunghezza dei dati (escludendo i byte di inizio e il terminatore)
-                uint8_t dataLength = bufferIndex - 6;
-
-                // Allocazione dinamica per i dati
-                uint8_t* data = (uint8_t*)malloc(dataLength);
-                if (data != nullptr)
-                {
-                    memcpy(data, &responseBuffer[5], dataLength);
-					
-					uint8_t command = responseBuffer[4];
-
-					// Debug: stampa i dati effettivamente ricevuti
-					/* Debug_Print("Dati ricevuti: ");
-					for (uint8_t i = 0; i < bufferIndex; i++) {
-						Debug_Print("0x%02X ", responseBuffer[i]);
-					}
-					Debug_Print("\n\r");
-                    
-                    Debug_Print("Comando : 0x%02X\n\r", command); */
-
-                    // Elabora il comando ricevuto
-                    switch (command)
-                    {
-						// ---------------------------------------------------- FREQUENCY
-						case COMMAND_GET_FREQUENCY:
-							send_frequency(command, VfoData[vfonum]->Frequency,addressFrom, addressTo);
-							break;
-
-                        case COMMAND_SET_FREQUENCY:
-                            if (dataLength >= 5)
-                            {
-                                uint32_t frequency = 0;
-
-                                // Decodifica i 6 byte BCD ricevuti, invertendo l'ordine dei byte e i nibble
-                                for (int i = 5; i >= 0; i--)
-                                {
-                                    // Inverti l'ordine dei nibble in ciascun byte
-                                    uint8_t inverted_byte = (data[i] << 4) | (data[i] >> 4);
-
-                                    uint8_t high_nibble = (inverted_byte >> 4) & 0x0F;  // Prendi la cifra più significativa (ora invertita)
-                                    uint8_t low_nibble = inverted_byte & 0x0F;           // Prendi la cifra meno significativa (ora invertita)
-
-                                    frequency = (frequency * 100) + (high_nibble * 10) + low_nibble;
-                                }
-
-                                VfoData[vfonum]->Frequency = frequency;
-                                Flags.frequencyChanged = true;
-
-                                // Debug: stampa la frequenza decodificata
-                                // Debug_Print("Frequenza decodificata (Hz): %ld\n\r", currentFrequency);
-                            }
-                            break;
-							
-						// ---------------------------------------------------- STEP
-						case COMMAND_GET_STEP:
-							send_frequency(command, VfoData[vfonum]->Step,addressFrom, addressTo);
-							break;	
-							
-                        case COMMAND_SET_STEP:
-                            if (dataLength >= 5)
-                            {
-                                uint32_t frequency = 0;
-
-                                // Decodifica i 6 byte BCD ricevuti, invertendo l'ordine dei byte e i nibble
-                                for (int i = 5; i >= 0; i--)
-                                {
-                                    // Inverti l'ordine dei nibble in ciascun byte
-                                    uint8_t inverted_byte = (data[i] << 4) | (data[i] >> 4);
-
-                                    uint8_t high_nibble = (inverted_byte >> 4) & 0x0F;  // Prendi la cifra più significativa (ora invertita)
-                                    uint8_t low_nibble = inverted_byte & 0x0F;           // Prendi la cifra meno significativa (ora invertita)
-
-                                    frequency = (frequency * 100) + (high_nibble * 10) + low_nibble;
-                                }
-
-                                VfoData[vfonum]->Step = frequency;
-                                Flags.stepChanged = true;
-
-                                // Debug: stampa la frequenza decodificata
-                                // Debug_Print("Frequenza decodificata (Hz): %ld\n\r", currentFrequency);
-                            }
-                            break;							
-
-						// ---------------------------------------------------- SQUELCH
-						case COMMAND_GET_SQUELCH:
-							send_command(command, VfoData[vfonum]->Sql, addressFrom, addressTo);
-							break;	
-
-                        case COMMAND_SET_SQUELCH:
-                            if (dataLength > 0)
-                            {
-                                VfoData[vfonum]->Sql = data[0];
-                                Flags.sqlChanged = true;
-                            }
-                            break;
-
-						// ---------------------------------------------------- MODE
-                        case COMMAND_SET_MODE:
-                            if (dataLength > 0)
-                            {
-                               VfoData[vfonum]->Mode = static_cast<BK4819_Mode_t>(data[0]);
-                               Flags.modeChanged = true;
-                            }
-                            break;							
-
-						// ---------------------------------------------------- RFGAIN
-						case COMMAND_GET_RFGAIN:
-							send_command(command, VfoData[vfonum]->Gain, addressFrom, addressTo);
-							break;
-							
-                        case COMMAND_SET_RFGAIN:
-                            if (dataLength > 0)
-                            {
-                                VfoData[vfonum]->Gain = data[0];
-                                Flags.gainChanged = true;
-                            }
-                            break;
-						
-						// ---------------------------------------------------- MONITOR
-						case COMMAND_SET_MONITOR:
-							Flags.monitorChanged = true;	
-							break;
-							
-						// ---------------------------------------------------- BANDWITH
-						case COMMAND_SET_BANDWIDTH:
-							if (dataLength > 0)
-                            {
-                                VfoData[vfonum]->bw = static_cast<BK4819_Filter_Bandwidth_t>(data[0]);
-                                Flags.bwChanged = true;
-                            }
-                            break;
-						
-						
-						case COMMAND_GET_BANDWIDTH:
-							send_command(command, VfoData[vfonum]->bw, addressFrom, addressTo);
-							break;
-							
-						// ---------------------------------------------------- TXPOWER
-						case COMMAND_SET_TX_POWER:
-							if (dataLength > 0)
-                            {
-                                VfoData[vfonum]->txp = data[0];
-                                Flags.txpChanged = true;
-                            }
-                            break;
-						
-						
-						case COMMAND_GET_TX_POWER:
-							send_command(command, VfoData[vfonum]->txp, addressFrom, addressTo);
-							break;	
-							
-						// ---------------------------------------------------- 
-                        default:
-                            debug("Comando CI-V non riconosciuto.");
-                            break;
-                    }
-
-                    // Libera la memoria allocata per i dati
-                    free(data);
-                }
-                else
-                {
-                    debug("Errore: memoria insufficiente per allocare i dati.");
-                }
-            }
-            else
-            {
-                debug("Messaggio CI-V non valido: troppo corto.");
-            }
+// ******************************************************************************************************************************
+// Callback sulle modifiche: mask seleziona i campi (FLAG_*). Da registrare prima di avviare la ricezione.
+// ******************************************************************************************************************************
+bool IcomSim::addChangeCallback(uint16_t mask, IcomSimChangeCallback_t fn, void* ctx)
+{
+    if (fn == nullptr || mask == 0) return false;
 
-            // Svuota il buffer dopo aver elaborato il messaggio
-            bufferIndex = 0;
-        }
+    for (uint8_t i = 0; i < ICOMSIM_MAX_CHANGE_CALLBACKS; i++)
+    {
+        ChangeCallback_t& cb = changeCallbacks[i];
+        if (cb.fn != nullptr && !(cb.fn == fn && cb.ctx == ctx)) continue;
+
+        cb.mask = mask;
+        cb.ctx = ctx;
+        cb.fn = fn;
+        return true;
+    }
+    return false;
+}
+
+void IcomSim::removeChangeCallback(IcomSimChangeCallback_t fn, void* ctx)
+{
+    for (uint8_t i = 0; i < ICOMSIM_MAX_CHANGE_CALLBACKS; i++)
+    {
+        if (changeCallbacks[i].fn == fn && changeCallbacks[i].ctx == ctx) changeCallbacks[i].fn = nullptr;
     }
 }
+#endif
 
+#if ICOMSIM_METRICS
 // ******************************************************************************************************************************
-//
+// Contatori di funzionamento: incrementi semplici sul percorso dei frame, letti dal monitoraggio con 7F 02 / 7F 03
 // ******************************************************************************************************************************
+uint16_t IcomSim::getMetric(uint8_t id) const
+{
+    if (id >= ICOMSIM_METRIC_COUNT) return 0;
+#if ICOMSIM_FEATURE_RX_RING
+    if (id == ICOMSIM_METRIC_RX_RING_LOST) return (uint16_t)(getRxOverflows() - metrics[id]);    // Contatore del produttore meno la base
+#endif
+    return metrics[id];
+}
 
-uint16_t IcomSim::isChanged()
+uint16_t IcomSim::getHandlerHits(uint8_t command, uint16_t subcommand) const
 {
-    uint16_t changedFlags = Flags.All; 											// Inizializza a 0, cioè nessun flag attivo
-
-    // if (Flags.frequencyChanged) changedFlags |= FLAG_FREQUENCY_CHANGED; 
-    // if (Flags.modeChanged)    	changedFlags |= FLAG_MODE_CHANGED; 		
-    // if (Flags.sqlChanged)     	changedFlags |= FLAG_SQL_CHANGED; 		
-    // if (Flags.gainChanged)    	changedFlags |= FLAG_GAIN_CHANGED; 		
-	// if (Flags.modeChanged)    	changedFlags |= FLAG_MODE_CHANGED; 		
-    // if (Flags.sqlChanged)     	changedFlags |= FLAG_SQL_CHANGED; 		
-    // if (Flags.monitorChanged) 	changedFlags |= FLAG_MONITOR_CHANGED; 	
-    // if (Flags.sqlChanged)     	changedFlags |= FLAG_SQL_CHANGED; 		
-	// if (Flags.bwChanged)     	changedFlags |= FLAG_BW_CHANGED; 		
-	// if (Flags.txpChanged)     	changedFlags |= FLAG_TXP_CHANGED; 
-	// if (Flags.stepChanged)     	changedFlags |= FLAG_STEP_CHANGED; 		
-	
-	Flags.All = 0;
+    for (uint8_t slot = firstHandler(command); slot != CIV_NO_HANDLER; slot = handlers[slot].next)
+    {
+        if (handlers[slot].subcommand == subcommand) return handlers[slot].hits;
+    }
+    return 0;
+}
 
-    return changedFlags; // Restituisci tutti i flag attivi (0 se nessuno è attivo)
+void IcomSim::resetMetrics()
+{
+    memset(metrics, 0, sizeof(metrics));
+    for (uint8_t i = 0; i < handlerCount; i++) handlers[i].hits = 0;
+#if ICOMSIM_FEATURE_RX_RING
+    metrics[ICOMSIM_METRIC_RX_RING_LOST] = getRxOverflows();   // rxOverflows appartiene al produttore: si sposta la base
+#endif
 }
+#endif
 
 // ******************************************************************************************************************************
 //
 // ******************************************************************************************************************************
-void IcomSim::send_frequency(uint8_t command, uint32_t frequency, uint8_t addressFrom, uint8_t addressTo)
+void IcomSim::send_frequency_bcd(uint8_t command, const uint8_t* bcd, uint8_t addressFrom, uint8_t addressTo)
 {
-    uint8_t message[16];
+    uint8_t message[12];
     message[0] = 0xFE;
     message[1] = 0xFE;
     message[2] = addressFrom;
     message[3] = addressTo;
     message[4] = command;  							// Comando di risposta per GET_FREQUENCY o GET_STEP
 
-    // Converti la frequenza in formato BCD (Binary Coded Decimal)
-    for (int i = 5; i >= 0; i--) 
-    {
-        message[5+i] = (frequency % 10) | ((frequency / 10 % 10) << 4);
-        frequency /= 100;
-    }
+    memcpy(&message[5], bcd, 6);					// Frequenza gia' in BCD, codificata da send_frequency()
 
     message[11] = 0xFD;  							// Byte di fine messaggio
 
@@ -369,9 +1481,9 @@ void IcomSim::send_rssi(uint16_t value, uint8_t addressFrom, uint8_t addressTo)
     message[2] = addressFrom;
     message[3] = addressTo;
     message[4] = COMMAND_GET_RSSI;  				// Comando di risposta
-													// Dividi il valore RSSI in due byte (LSB e MSB)
-    message[5] = value & 0xFF;       				// Byte meno significativo
-    message[6] = (value >> 8) & 0xFF; 				// Byte più significativo
+
+    // Valore in BCD su due byte (0000-9999): in binario un byte 0xFD/0xFE verrebbe letto come terminatore o preambolo
+    civBcdEncode<2, CIV_BCD_TX_LAYOUT>(value > 9999 ? 9999 : value, &message[5]);
 
     message[7] = 0xFD;  							// Byte di fine messaggio
 
@@ -384,28 +1496,21 @@ void IcomSim::send_rssi(uint16_t value, uint8_t addressFrom, uint8_t addressTo)
 void IcomSim::send_status(uint8_t vfo, uint8_t addressFrom, uint8_t addressTo)
 {
 	uint16_t value = VfoData[vfo]->Flag.Flags;
-    uint8_t message[8];
+    uint8_t message[9];
 	
     message[0] = 0xFE;
     message[1] = 0xFE;
     message[2] = addressFrom;
     message[3] = addressTo;
     message[4] = COMMAND_GET_STATUS;  				// Comando di risposta
-													// Dividi il valore RSSI in due byte (LSB e MSB)
-    message[5] = value & 0xFF;       				// Byte meno significativo
-    message[6] = (value >> 8) & 0xFF; 				// Byte più significativo
 
-    message[7] = 0xFD;  							// Byte di fine messaggio
+    civBcdEncode<3, CIV_BCD_TX_LAYOUT>(value, &message[5]);	// Flag di stato in BCD su tre byte (000000-065535)
+
+    message[8] = 0xFD;  							// Byte di fine messaggio
 
     sendToSerial(message, sizeof(message));			// Invia il messaggio usando la funzione centralizzata
 }
 
-
-
-
-
-
-
 // ******************************************************************************************************************************
 //
 // ******************************************************************************************************************************
@@ -426,39 +1531,262 @@ void IcomSim::send_command(uint8_t command, uint8_t value, uint8_t addressFrom,
 // ******************************************************************************************************************************
 //
 // ******************************************************************************************************************************
+// Risposta di conferma: OK (0xFB) oppure NG (0xFA)
+// ******************************************************************************************************************************
+void IcomSim::send_ack(bool ok, uint8_t addressFrom, uint8_t addressTo)
+{
+    uint8_t message[6];
+    message[0] = 0xFE;                        // Byte di inizio messaggio
+    message[1] = 0xFE;                        // Byte di inizio messaggio
+    message[2] = addressFrom;                 // Indirizzo del mittente
+    message[3] = addressTo;                   // Indirizzo del destinatario
+    message[4] = ok ? CIV_ACK_OK : CIV_ACK_NG;
+    message[5] = 0xFD;                        // Byte di fine messaggio
+
+    sendToSerial(message, sizeof(message));   // Invia il messaggio usando la funzione centralizzata
+}
+
+// ******************************************************************************************************************************
+// Dati binari: impacchettati a 7 bit dopo comando e sottocomando, cosi' nessun byte puo' valere FC/FD/FE
+// ******************************************************************************************************************************
+bool IcomSim::send_packed(uint8_t command, uint8_t subcommand, const uint8_t* data, uint8_t length, uint8_t addressFrom, uint8_t addressTo)
+{
+    uint8_t message[CIV_MAX_FRAME_SIZE];
+
+    if (7 + CIV_7BIT_PACKED_SIZE((uint16_t)length) > CIV_MAX_FRAME_SIZE) return false;
+
+    message[0] = 0xFE;
+    message[1] = 0xFE;
+    message[2] = addressFrom;
+    message[3] = addressTo;
+    message[4] = command;
+    message[5] = subcommand;
+
+    uint16_t packed = civPack7(data, length, &message[6]);
+    message[6 + packed] = 0xFD;
+
+    sendToSerial(message, 7 + packed);
+    return true;
+}
 
+// ******************************************************************************************************************************
+//
+// ******************************************************************************************************************************
 void IcomSim::sendToSerial(const uint8_t* data, size_t length) 
 {
-    if (serialQueue.isFull()) 
+    if (replyMuted) return;                                 // Risposta a un broadcast (vedi dispatch())
+
+    ICOMSIM_LATENCY_MARK(enqueue);
+#if ICOMSIM_TRACE
+    uint8_t command = length > 5 ? data[4] : 0;
+    uint8_t dataLength = length > 6 ? (uint8_t)(length - 6) : 0;
+#endif
+
+    if (frameSink != nullptr)
+    {
+        if (frameSink(frameSinkCtx, data, (uint16_t)length))
+        {
+#if ICOMSIM_FEATURE_CAPTURE
+            if (captureHook != nullptr) captureHook(captureCtx, CIV_CAPTURE_TX, data, (uint16_t)length);
+#endif
+            ICOMSIM_TRACE_EVENT(CIV_TRACE_TX_FRAME, command, dataLength, 0);
+            ICOMSIM_COUNT(ICOMSIM_METRIC_TX_FRAMES);
+        }
+        else
+        {
+            ICOMSIM_TRACE_EVENT(CIV_TRACE_TX_DROP, command, dataLength, 0);
+            ICOMSIM_COUNT(ICOMSIM_METRIC_TX_DROPPED);
+        }
+        return;
+    }
+
+    // Il frame entra nel buffer per intero oppure viene scartato: mai frame troncati sulla linea
+    if (length > txRing.space()) 
 	{
+        ICOMSIM_TRACE_EVENT(CIV_TRACE_TX_DROP, command, dataLength, 0);
+        ICOMSIM_COUNT(ICOMSIM_METRIC_TX_DROPPED);
         debug("Errore: coda di trasmissione piena");
         return;
     }
 
-    SerialMessage msg;
-    memcpy(msg.data, data, length);
-    msg.length = length;
-    serialQueue.enqueue(msg);
+    txRing.write(data, length);
+#if ICOMSIM_FEATURE_CAPTURE
+    if (captureHook != nullptr) captureHook(captureCtx, CIV_CAPTURE_TX, data, (uint16_t)length);
+#endif
+    ICOMSIM_TRACE_EVENT(CIV_TRACE_TX_FRAME, command, dataLength, 0);
+    ICOMSIM_COUNT(ICOMSIM_METRIC_TX_FRAMES);
+    ICOMSIM_PEAK(ICOMSIM_METRIC_TX_HIGH_WATER, txRing.used());
+    ICOMSIM_LATENCY_RECORD(ICOMSIM_LATENCY_ENQUEUE, enqueue);
+
+#if ICOMSIM_LATENCY
+    // Una risposta alla volta: si misura quando l'ultimo byte di questo frame esce dal ring
+    if (latencySlot != ICOMSIM_LATENCY_NO_SLOT && latencyDrainSlot == ICOMSIM_LATENCY_NO_SLOT)
+    {
+        latencyDrainSlot = latencySlot;
+        latencyDrainLeft = txRing.used();
+        latencyDrainStart = ICOMSIM_CYCLES();
+        latencyDrainFrame = latencyFrameStart;
+    }
+#endif
 }
 
-// Elabora la coda nel loop principale
+// Elabora la coda nel loop principale: scrive quanto la seriale accetta, il resto resta in coda per la chiamata successiva
 void IcomSim::processSerialQueue() 
 {
-    if (!serialQueue.isEmpty()) 
+#if ICOMSIM_FEATURE_TRANSCEIVE
+    processTransceive();
+#endif
+#if ICOMSIM_FEATURE_METER
+    processRssiStream();
+#endif
+#if ICOMSIM_FEATURE_MEMORY
+    if (memory != nullptr) memory->process();              // Scritture differite dei canali
+#endif
+
+    while (!txRing.isEmpty()) 
 	{
-        SerialMessage msg = serialQueue.dequeue();
+        uint16_t length;
+        const uint8_t* chunk = txRing.peek(length);	// Porzione contigua del buffer circolare
 
-        if (serialPort->availableForWrite() >= msg.length) 
-		{
-            serialPort->write(msg.data, msg.length);
-            // serialPort->flush();
-        } 
-		else 
-		{
-            debug("Errore: spazio seriale insufficiente per il messaggio");
+        int space = serialPort->availableForWrite();
+        if (space <= 0)								// Seriale piena: si riprende alla prossima chiamata
+        {
+            ICOMSIM_COUNT(ICOMSIM_METRIC_TX_STALLS);
+            break;
         }
+
+        if ((int)length > space) length = (uint16_t)space;
+
+        size_t written = serialPort->write(chunk, length);
+        txRing.consume(written);
+#if ICOMSIM_LATENCY
+        latencyDrained(written);
+#endif
+
+        if (written < length) break;
+    }
+
+#if ICOMSIM_FEATURE_LINE_RATE
+    lineRate.process(txRing.isEmpty());                     // Cambio di velocita' dopo l'uscita dell'ACK
+#endif
+}
+
+#if ICOMSIM_LATENCY
+// ******************************************************************************************************************************
+// Uscita verso la UART della risposta misurata: chiude gli stadi DRAIN e TOTAL
+// ******************************************************************************************************************************
+void IcomSim::latencyDrained(size_t written)
+{
+    if (latencyDrainSlot == ICOMSIM_LATENCY_NO_SLOT) return;
+
+    if (written < latencyDrainLeft)
+    {
+        latencyDrainLeft -= (uint16_t)written;
+        return;
+    }
+
+    uint32_t now = ICOMSIM_CYCLES();
+    latency.record(latencyDrainSlot, ICOMSIM_LATENCY_DRAIN, now - latencyDrainStart);
+    latency.record(latencyDrainSlot, ICOMSIM_LATENCY_TOTAL, now - latencyDrainFrame);
+    latencyDrainSlot = ICOMSIM_LATENCY_NO_SLOT;
+}
+#endif
+
+// ******************************************************************************************************************************
+// Un giro completo di ricezione e trasmissione, per gli executor (IcomSimExecutor.h). Restituisce i millisecondi dopo i quali
+// va richiamata anche senza nuovi eventi: 0 se c'e' ancora lavoro, ICOMSIM_WAIT_FOREVER se tutto dipende dal prossimo evento.
+// ******************************************************************************************************************************
+uint32_t IcomSim::process()
+{
+    processCIVCommand();
+    processSerialQueue();
+
+#if ICOMSIM_FEATURE_RX_RING
+    if (rxRingEnabled && !rxRing.isEmpty()) return 0;      // Byte arrivati durante l'elaborazione
+#endif
+
+    uint32_t wait = ICOMSIM_WAIT_FOREVER;
+    uint32_t now = millis();
+    (void)now;
+
+    if (!txRing.isEmpty()) wait = 1;                        // Seriale piena: si riprova appena si libera la FIFO
+
+#if ICOMSIM_FEATURE_TRANSCEIVE
+    if (transceivePending.All != 0)
+    {
+        uint32_t elapsed = now - transceiveSince;
+        uint32_t left = elapsed >= transceiveWindow ? 1 : transceiveWindow - elapsed;
+        if (left < wait) wait = left;
+    }
+#endif
+
+#if ICOMSIM_FEATURE_METER
+    if (rssiInterval != 0)
+    {
+        uint32_t elapsed = now - rssiLastTime;
+        uint32_t left = elapsed >= rssiInterval ? rssiInterval : rssiInterval - elapsed;
+        if (left < wait) wait = left;
+    }
+#endif
+
+#if ICOMSIM_FEATURE_MEMORY
+    if (memory != nullptr)
+    {
+        uint32_t left = memory->getFlushDelay();
+        if (left < wait) wait = left;
+    }
+#endif
+
+#if ICOMSIM_FEATURE_LINE_RATE
+    uint32_t rateLeft = lineRate.getDelay();
+    if (rateLeft < wait) wait = rateLeft;
+#endif
+
+    return wait;
+}
+
+#if ICOMSIM_FEATURE_TRANSCEIVE
+// ******************************************************************************************************************************
+// Transceive: il firmware segnala le modifiche fatte localmente (manopola, scansione) e IcomSim le invia all'indirizzo
+// broadcast con i comandi 0x00/0x01. Le modifiche che arrivano entro windowMs dalla prima vengono accorpate in un solo frame.
+// ******************************************************************************************************************************
+void IcomSim::setTransceive(bool enable, uint16_t windowMs)
+{
+    transceive = enable;
+    transceiveWindow = windowMs;
+    transceivePending.All = 0;
+}
+
+void IcomSim::notifyLocalChange(uint16_t flags)
+{
+    if (!transceive) return;
+
+    flags &= FLAG_FREQUENCY_CHANGED | FLAG_MODE_CHANGED;
+    if (flags == 0) return;
+
+    if (transceivePending.All == 0) transceiveSince = millis();	// Apre la finestra di accorpamento
+    transceivePending.All |= flags;
+}
+
+void IcomSim::processTransceive()
+{
+    if (transceivePending.All == 0 || VfoData[vfoSelected] == nullptr) return;
+    if ((uint32_t)(millis() - transceiveSince) < transceiveWindow) return;
+
+    // Si invia solo se entrambi i frame entrano in coda, altrimenti si riprova al giro successivo
+    if (!canSend(12 + 7)) return;
+
+    if (transceivePending.frequencyChanged)
+    {
+        send_frequency(COMMAND_TRANSCEIVE_FREQUENCY, VfoData[vfoSelected]->Frequency, CIV_ADDRESS_BROADCAST, civAddress);
     }
+    if (transceivePending.modeChanged)
+    {
+        send_command(COMMAND_TRANSCEIVE_MODE, VfoData[vfoSelected]->Mode, CIV_ADDRESS_BROADCAST, civAddress);
+    }
+    transceivePending.All = 0;
 }
+#endif
 
 /* void IcomSim::sendToSerial(const uint8_t* data, size_t length)
 {
@@ -504,15 +1832,7 @@ void IcomSim::processSerialQueue()
 
 
 
-// ******************************************************************************************************************************
-//
-// ******************************************************************************************************************************
-void IcomSim::sendResponse(const String& response)
-{
-    serialPort->println(response);
-}
-
-
+#if ICOMSIM_DEBUG
 // ******************************************************************************************************************************
 //
 // ******************************************************************************************************************************
@@ -525,4 +1845,5 @@ void IcomSim::Debug_Print(const char *format, ...)
     va_end(args);
 
     debug(buffer); // Stampa sulla seriale di debug
-}
\ No newline at end of file
+}
+#endif